@@ -12,6 +12,10 @@
 {
     NSString* m_name;
     
+    // prefab the actor was spawned from, only retained while the actor isn't in its pool
+    Prefab* m_prefab;
+    BOOL m_pooled;
+    
     // root lua state object
     Script* m_script;
     
@@ -21,6 +25,10 @@
     // every actor is a rigid body (for the transform)
 	cpBody* m_body;
     
+    // transform at the start of the last simulation tick
+    cpVect m_prevPos;
+    cpVect m_prevRot;
+    
     // physics properties
     BOOL m_trigger;
     BOOL m_kinematic;
@@ -31,6 +39,12 @@
     
     // true if the actor should render itself
     BOOL m_visible;
+    
+    // true if the actor was outside the camera the last time it was rendered
+    BOOL m_culled;
+    
+    // true if a static layer needs to render the actor again
+    BOOL m_dirty;
 }
 
 // create a new actor from a prefab
@@ -39,6 +53,12 @@
 // initialization methods
 - (id)initWithPrefab:(Prefab*)prefab;
 
+// put a pooled actor back the way the prefab created it
+- (void)reset;
+
+// the prefab's pool owns the actor while it's pooled
+- (void)setPooled:(BOOL)pooled;
+
 // set the name of the actor (optional)
 - (void)setName:(NSString*)name;
 
@@ -55,8 +75,10 @@
 - (BOOL)hasTag:(NSString*)tag;
 
 // accessors
+- (Prefab*)prefab;
 - (Script*)script;
 - (cpBody*)body;
+- (NSArray*)components;
 
 // tagging
 - (void)addTag:(NSString*)tag;
@@ -75,7 +97,10 @@
 - (float)x;
 - (float)y;
 
-// transform application
+// snapshot the transform before a simulation tick
+- (void)saveTransform;
+
+// transform application, interpolated between simulation ticks
 - (void)applyTransform;
 - (void)loadTransform;
 
@@ -83,6 +108,9 @@
 - (NSPoint)transformPoint:(NSPoint)point;
 - (NSPoint)rotatePoint:(NSPoint)point;
 
+// lua methods of the transform namespace
++ (NSArray*)transformMethods;
+
 // transform methods
 - (void)setPosition:(NSPoint)point;
 - (void)setAngle:(float)degrees;
@@ -97,13 +125,25 @@
 // true if the actor should render itself
 - (BOOL)isVisible;
 
-// frame stages
+// world space bounds of all the components, NO if none of them have bounds
+- (BOOL)bounds:(NSRect*)rect;
+
+// bounding box of a rectangle in actor space, transformed to world space
+- (NSRect)transformRect:(NSRect)rect;
+
+// test against the visible area of the camera, updating isCulled
+- (BOOL)cull:(NSRect)view;
+
+// true if the actor was off screen the last time it rendered
+- (BOOL)isCulled;
+
+// static layers only render again once an actor in them is dirty
+- (void)setDirty:(BOOL)flag;
+- (BOOL)isDirty;
+
+// the layer's component store runs the other frame stages
 - (void)start;
-- (void)advance;
-- (void)render;
-- (void)update;
 - (void)leave;
-- (void)gui;
 
 // collision handlers
 - (BOOL)beginCollision:(Actor*)actor;
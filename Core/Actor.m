@@ -5,6 +5,7 @@
 //
 
 #import "Actor.h"
+#import "Batch.h"
 #import "Behavior.h"
 #import "Component.h"
 #import "Engine.h"
@@ -19,14 +20,6 @@ static const float PI = 3.141592f;
 // ensure an angle doesn't get insane
 #define clampAngle(x) fmod(x, PI * 2.0f)
 
-// shared 4x4 matrix
-static float M[16] = {
-    1.0f, 0.0f, 0.0f, 0.0f,
-    0.0f, 1.0f, 0.0f, 0.0f, 
-    0.0f, 0.0f, 1.0f, 0.0f, 
-    0.0f, 0.0f, 0.0f, 1.0f, 
-};
-
 @implementation Actor
 
 + (Actor*)actorFromPrefab:(NSString*)name
@@ -49,31 +42,28 @@ static float M[16] = {
     
     // initialize members
     m_name = nil;
+    m_prefab = [prefab retain];
+    m_pooled = NO;
     m_script = [[theEngine script] newThread];
     m_components = [[NSMutableArray alloc] init];
 	m_body = cpBodyNew(1.0f, 1.0f);
     m_dead = NO;
     m_visible = YES;
+    m_culled = NO;
+    m_dirty = NO;
     m_kinematic = YES;
     
     // set this actor to the user-defined data for the rigid body
     m_body->data = self;
     
+    // nothing to interpolate from yet
+    [self saveTransform];
+    
     // register global actor functions
     [m_script registerObject:self withNamespace:nil];
     
     // register the transform methods with the script
-    [m_script registerMethods:[NSArray arrayWithObjects:
-                               script_Method(@"set_position", @selector(l_setPosition:)),
-                               script_Method(@"set_angle", @selector(l_setAngle:)),
-                               script_Method(@"position", @selector(l_position:)),
-                               script_Method(@"angle", @selector(l_angle:)),
-                               script_Method(@"translate", @selector(l_translateBy:)),
-                               script_Method(@"rotate", @selector(l_rotateBy:)),
-                               script_Method(@"rotate_point", @selector(l_rotatePoint:)),
-                               script_Method(@"velocity", @selector(l_velocity:)),
-                               script_Method(@"clamp_velocity", @selector(l_clampVelocity:)),
-                               nil]
+    [m_script registerMethods:[Actor transformMethods]
                     constants:nil
                     forObject:self
                 withNamespace:@"transform"];
@@ -86,7 +76,7 @@ static float M[16] = {
         Class cls = NSClassFromString(className);
         NSArray* components = [[prefab components] objectForKey:className];
         
-        for(NSArray* props in components) {
+        for(PropertyValues* props in components) {
             id component = [[cls alloc] initWithActor:self properties:props];
             
             // instantiate an instance of the component
@@ -109,6 +99,11 @@ static float M[16] = {
     if (m_body) {
         cpBodyDestroy(m_body);
     }
+    
+    // a pooled actor doesn't hold the prefab that owns it
+    if (m_pooled == NO) {
+        [m_prefab release];
+    }
 
     [m_name release];
     [m_script release];
@@ -117,6 +112,82 @@ static float M[16] = {
     [super dealloc];
 }
 
+- (void)setPooled:(BOOL)pooled
+{
+    if (pooled == m_pooled) {
+        return;
+    }
+    
+    // set first, letting go of the prefab can free its pool and this actor with it
+    m_pooled = pooled;
+    
+    // the prefab and its pool would keep each other alive otherwise
+    if (pooled) {
+        [m_prefab release];
+    } else {
+        [m_prefab retain];
+    }
+}
+
+- (void)reset
+{
+    NSEnumerator* components = [m_components objectEnumerator];
+    
+    [m_name release];
+    [m_tags release];
+    
+    // the same members initWithPrefab sets
+    m_name = nil;
+    m_tags = [[m_prefab tags] mutableCopy];
+    m_dead = NO;
+    m_visible = YES;
+    m_culled = NO;
+    m_dirty = NO;
+    m_trigger = NO;
+    m_kinematic = YES;
+    
+    // the body keeps nothing from its last life
+    cpBodySetPos(m_body, cpvzero);
+    cpBodySetAngle(m_body, 0.0f);
+    cpBodySetVel(m_body, cpvzero);
+    cpBodySetAngVel(m_body, 0.0f);
+    cpBodySetVelLimit(m_body, INFINITY);
+    cpBodySetMass(m_body, 1.0f);
+    cpBodySetMoment(m_body, 1.0f);
+    cpBodyResetForces(m_body);
+    
+    [self saveTransform];
+    
+    // components were created in the order of the prefab
+    for(NSString* className in [m_prefab components]) {
+        for(PropertyValues* props in [[m_prefab components] objectForKey:className]) {
+            [[components nextObject] resetWithProperties:props];
+        }
+    }
+}
+
++ (NSArray*)transformMethods
+{
+    static NSArray* methods = nil;
+    
+    // built once, the script binds them once for every actor
+    if (methods == nil) {
+        methods = [[NSArray alloc] initWithObjects:
+                   script_Method(@"set_position", @selector(l_setPosition:)),
+                   script_Method(@"set_angle", @selector(l_setAngle:)),
+                   script_Method(@"position", @selector(l_position:)),
+                   script_Method(@"angle", @selector(l_angle:)),
+                   script_Method(@"translate", @selector(l_translateBy:)),
+                   script_Method(@"rotate", @selector(l_rotateBy:)),
+                   script_Method(@"rotate_point", @selector(l_rotatePoint:)),
+                   script_Method(@"velocity", @selector(l_velocity:)),
+                   script_Method(@"clamp_velocity", @selector(l_clampVelocity:)),
+                   nil];
+    }
+    
+    return methods;
+}
+
 - (NSArray*)scriptMethods
 {
     return [NSArray arrayWithObjects:
@@ -124,6 +195,9 @@ static float M[16] = {
             script_Method(@"is_dead", @selector(l_isDead:)),
             script_Method(@"set_visible", @selector(l_setVisible:)),
             script_Method(@"is_visible", @selector(l_isVisible:)),
+            script_Method(@"is_culled", @selector(l_isCulled:)),
+            script_Method(@"mark_dirty", @selector(l_markDirty:)),
+            script_Method(@"bounds", @selector(l_bounds:)),
             script_Method(@"has_tag", @selector(l_hasTag:)),
             script_Method(@"add_tag", @selector(l_addTag:)),
             script_Method(@"remove_tag", @selector(l_removeTag:)),
@@ -132,6 +206,9 @@ static float M[16] = {
 
 - (void)setName:(NSString*)name
 {
+    [m_name release];
+    
+    // pooled actors are named again every time they're spawned
     m_name = [name retain];
 }
 
@@ -158,6 +235,11 @@ static float M[16] = {
     return [m_tags member:[tag lowercaseString]] != nil;
 }
 
+- (Prefab*)prefab
+{
+    return [[m_prefab retain] autorelease];
+}
+
 - (Script*)script
 {
     return [[m_script retain] autorelease];
@@ -168,6 +250,11 @@ static float M[16] = {
     return m_body;
 }
 
+- (NSArray*)components
+{
+    return [[m_components retain] autorelease];
+}
+
 - (void)addTag:(NSString*)tag
 {
     [m_tags addObject:[tag lowercaseString]];
@@ -213,38 +300,44 @@ static float M[16] = {
     return cpBodyGetPos(m_body).y;
 }
 
-- (void)applyTransform
+- (void)saveTransform
 {
-    cpVect pos = m_body->p;
-    cpVect rot = m_body->rot;
+    m_prevPos = m_body->p;
+    m_prevRot = m_body->rot;
+}
+
+- (Transform)interpolateTransform
+{
+    float alpha = [theClock alpha];
+    
+    // blend from the previous tick's transform to the current one
+    cpVect pos = cpvlerp(m_prevPos, m_body->p, alpha);
+    cpVect rot = cpvnormalize_safe(cpvlerp(m_prevRot, m_body->rot, alpha));
     
     // set the transformation
-    M[ 0] =  rot.x;
-    M[ 1] =  rot.y;
-    M[ 4] = -rot.y;
-    M[ 5] =  rot.x;
-    M[12] =  pos.x;
-    M[13] =  pos.y;
+    Transform m = {
+         rot.x, rot.y,
+        -rot.y, rot.x,
+         pos.x, pos.y,
+    };
+    
+    return m;
+}
+
+- (void)applyTransform
+{
+    Transform m = [self interpolateTransform];
     
     // apply it
-    glMultMatrixf(M);
+    batchMultTransform(&m);
 }
 
 - (void)loadTransform
 {
-    cpVect pos = m_body->p;
-    cpVect rot = m_body->rot;
-    
-    // set the transformation
-    M[ 0] =  rot.x;
-    M[ 1] =  rot.y;
-    M[ 4] = -rot.y;
-    M[ 5] =  rot.x;
-    M[12] =  pos.x;
-    M[13] =  pos.y;
+    Transform m = [self interpolateTransform];
     
     // load it
-    glLoadMatrixf(M);
+    batchLoadTransform(&m);
 }
 
 - (NSPoint)transformPoint:(NSPoint)point
@@ -302,68 +395,81 @@ static float M[16] = {
     return m_visible;
 }
 
-- (void)start
+- (BOOL)bounds:(NSRect*)rect
 {
+    BOOL found = NO;
+    
+    // union of every enabled component with something to bound
     for(BaseComponent* component in m_components) {
-        if ([component isEnabled]) {
-            [component start];
+        NSRect r;
+        
+        if ([component isEnabled] && [component bounds:&r]) {
+            *rect = found ? NSUnionRect(*rect, r) : r;
+            found = YES;
         }
     }
+    
+    return found;
 }
 
-- (void)advance
+- (NSRect)transformRect:(NSRect)rect
 {
-    for(BaseComponent* component in m_components) {
-        if ([component isEnabled]) {
-            [component advance];
-        }
-    }
+    cpVect rot = m_body->rot;
+    
+    // half extents of the rotated box
+    float hw = rect.size.width / 2;
+    float hh = rect.size.height / 2;
+    float ex = fabsf(rot.x) * hw + fabsf(rot.y) * hh;
+    float ey = fabsf(rot.y) * hw + fabsf(rot.x) * hh;
+    
+    // rotated and translated center of the box
+    cpVect c = cpvadd(m_body->p, cpvrotate(cpv(NSMidX(rect), NSMidY(rect)), rot));
+    
+    return NSMakeRect(c.x - ex, c.y - ey, ex * 2, ey * 2);
 }
 
-- (void)render
+- (BOOL)cull:(NSRect)view
 {
-    if (m_visible == NO) {
-        return;
-    }
+    NSRect rect;
     
-    // save the current transform state
-    glPushMatrix();
-    {
-        [self applyTransform];
-        
-        // perform this actor's rendering components
-        for(BaseComponent* component in m_components) {
-            if ([component isEnabled]) {
-                [component render];
-            }
-        }
-    }
-    glPopMatrix();
+    // actors without bounds are always drawn
+    m_culled = [self bounds:&rect] && NSIntersectsRect(rect, view) == NO;
+    
+    return m_culled;
 }
 
-- (void)update
+- (BOOL)isCulled
 {
-    for(BaseComponent* component in m_components) {
-        if ([component isEnabled]) {
-            [component update];
-        }
-    }
+    return m_culled;
 }
 
-- (void)leave
+- (void)setDirty:(BOOL)flag
 {
+    m_dirty = flag;
+}
+
+- (BOOL)isDirty
+{
+    return m_dirty;
+}
+
+- (void)start
+{
+    // don't interpolate from wherever the prefab was spawned
+    [self saveTransform];
+    
     for(BaseComponent* component in m_components) {
         if ([component isEnabled]) {
-            [component leave];
+            [component start];
         }
     }
 }
 
-- (void)gui
+- (void)leave
 {
     for(BaseComponent* component in m_components) {
         if ([component isEnabled]) {
-            [component gui];
+            [component leave];
         }
     }
 }
@@ -405,6 +511,41 @@ static float M[16] = {
     return lua_pushboolean(L, [self isDead]), 1;
 }
 
+- (int)l_isCulled:(lua_State*)L
+{
+    return lua_pushboolean(L, [self isCulled]), 1;
+}
+
+- (int)l_markDirty:(lua_State*)L
+{
+    return [self setDirty:YES], 0;
+}
+
+- (int)l_bounds:(lua_State*)L
+{
+    NSRect rect;
+    
+    if ([self bounds:&rect] == NO) {
+        return lua_pushnil(L), 1;
+    }
+    
+    lua_newtable(L);
+    lua_pushnumber(L, NSMinX(rect));
+    lua_setfield(L, -2, "left");
+    lua_pushnumber(L, NSMinY(rect));
+    lua_setfield(L, -2, "bottom");
+    lua_pushnumber(L, NSMaxX(rect));
+    lua_setfield(L, -2, "right");
+    lua_pushnumber(L, NSMaxY(rect));
+    lua_setfield(L, -2, "top");
+    lua_pushnumber(L, NSWidth(rect));
+    lua_setfield(L, -2, "width");
+    lua_pushnumber(L, NSHeight(rect));
+    lua_setfield(L, -2, "height");
+    
+    return 1;
+}
+
 - (int)l_setVisible:(lua_State*)L
 {
     return [self setVisible:lua_toboolean(L, 1)], 0;
@@ -15,6 +15,9 @@
     // used to load and identify in project
     NSString* m_name;
     NSString* m_path;
+    
+    // keep CPU-side data around after it's been handed to the GPU
+    BOOL m_keepsData;
 }
 
 // initialization methods
@@ -25,6 +28,10 @@
 - (NSString*)name;
 - (NSString*)path;
 
+// opt in to keeping CPU-side data (e.g. texture pixels) after upload
+- (BOOL)keepsData;
+- (void)setKeepsData:(BOOL)keep;
+
 // true if the asset is already in memory
 - (BOOL)isLoaded;
 
@@ -21,6 +21,9 @@
     // zero reference count
     m_refs = 0;
     
+    // release data once the GPU has it
+    m_keepsData = NO;
+    
     return self;
 }
 
@@ -48,6 +51,16 @@
     return [[m_path retain] autorelease];
 }
 
+- (BOOL)keepsData
+{
+    return m_keepsData;
+}
+
+- (void)setKeepsData:(BOOL)keep
+{
+    m_keepsData = keep;
+}
+
 - (BOOL)isLoaded
 {
     return m_refs > 0;
@@ -79,8 +79,6 @@
 {
     NSXMLElement* root;
     NSString* textureFileName;
-    NSData* textureData;
-    NSImage* textureImage;
     Texture* texture;
     
     // try and parse the prefab document
@@ -99,20 +97,8 @@
         return FALSE;
     }
     
-    // attempt to load the image file
-    if ((textureData = [theProject dataWithContentsOfFile:textureFileName]) == nil) {
-        NSLog(@"Failed to load texture file %@ in atlas %@\n", textureFileName, [self name]);
-        return FALSE;
-    }
-    
-    // attempt to open the image file
-    if ((textureImage = [[NSImage alloc] initWithData:textureData]) == nil) {
-        NSLog(@"Invalid texture %@ for atlas %@\n", textureFileName, [self name]);
-        return FALSE;
-    }
-    
-    // create the texture
-    if ((texture = [Texture textureFromImage:[textureImage autorelease]]) == nil) {
+    // load the image, or the region of the shared page it was packed into
+    if ((texture = [Texture textureWithContentsOfFile:textureFileName]) == nil) {
         NSLog(@"Invalid texture %@ for atlas %@\n", textureFileName, [self name]);
         return FALSE;
     }
@@ -120,6 +106,10 @@
     // we now have a valid texture for the atlas
     m_texture = [texture retain];
     
+    // stream it to OpenGL, keeping the pixels if the atlas asks to
+    [m_texture setKeepsData:[self keepsData]];
+    [m_texture queueUpload];
+    
     // parse and load all the texture frames
     for(NSXMLElement* frames in [root elementsForName:@"frames"]) {
         for(NSXMLElement* frame in [frames elementsForName:@"frame"]) {
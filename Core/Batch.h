@@ -0,0 +1,135 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import <OpenGL/gl.h>
+#import "Texture.h"
+
+// 2D affine transform, laid out like the columns of a GL matrix
+typedef struct {
+    float a, b;
+    float c, d;
+    float x, y;
+} Transform;
+
+// a frame's worth of recorded drawing, replayed later by batchDraw
+typedef struct BatchList BatchList;
+
+// layers with their own draw counters, later layers are counted in the last
+#define BATCH_STATS_LAYERS 32
+
+// GL work issued for a frame or a layer
+typedef struct {
+    unsigned int drawCalls;
+    unsigned int textureBinds;
+    unsigned int blendChanges;
+    unsigned int vertices;
+    
+    // calls skipped because they wouldn't have changed anything
+    unsigned int stateSkipped;
+    
+    // pixels filled, estimated from the area of everything submitted
+    float pixels;
+} BatchCounters;
+
+typedef struct {
+    BatchCounters total;
+    BatchCounters layers[BATCH_STATS_LAYERS];
+    
+    // layers drawn, including those drawn into targets
+    unsigned int layerCount;
+    
+    // pixels filled over the pixels of the display
+    float overdraw;
+} BatchStats;
+
+// an offscreen texture that can be drawn into
+typedef struct BatchTarget BatchTarget;
+
+// quads kept in a static vertex buffer
+typedef struct BatchMesh BatchMesh;
+
+// a texture's frame quads, looked up by the sprite shader
+typedef struct BatchFrames BatchFrames;
+
+// draw sprites as instances with shaders, NO if unsupported (needs a current context)
+BOOL batchEnableShaders(void);
+BOOL batchIsInstancing(void);
+
+// reset the batch at the start of a frame
+void batchBegin(void);
+
+// end the current pass, quads are only sorted against others in the same pass
+void batchFlush(void);
+
+// clear the viewport and reset the GL state
+void batchClear(GLint width, GLint height, const GLfloat* rgb);
+
+// orthographic projection and optional view transform for everything after it
+void batchSetProjection(float left, float right, float bottom, float top, const Transform* view);
+
+// create a render target texture, released targets are deleted once no longer drawn
+BatchTarget* batchCreateTarget(GLsizei width, GLsizei height);
+void batchReleaseTarget(BatchTarget* target);
+GLuint batchTargetTexture(const BatchTarget* target);
+
+// create a static mesh from quads, released meshes are deleted once no longer drawn
+BatchMesh* batchCreateMesh(const Quad* quads, unsigned int count);
+void batchReleaseMesh(BatchMesh* mesh);
+
+// create a frame table for instanced sprites, released tables are deleted once no longer drawn
+BatchFrames* batchCreateFrames(const Quad* quads, unsigned int count);
+
+// write frames from first on into a table, NO if it has no room for them
+BOOL batchAppendFrames(BatchFrames* frames, const Quad* quads, unsigned int first, unsigned int count);
+void batchReleaseFrames(BatchFrames* frames);
+
+// draw everything after this into a target (cleared first) or the display if NULL
+void batchSetTarget(BatchTarget* target);
+
+// finish recording the frame, the next one is recorded into the other list
+BatchList* batchSwap(void);
+
+// issue all the GL calls for a recorded frame, needs a current context
+void batchDraw(BatchList* list);
+
+// render state, recorded with each quad (changes never flush)
+void batchSetBlend(GLenum src, GLenum dst);
+void batchSetColor(float r, float g, float b, float a);
+void batchSetColorv(const float* rgba);
+
+// sort order, quads in later layers draw on top, then by depth within a layer
+void batchNextLayer(void);
+void batchSetDepth(int depth);
+
+// draw in submission order instead of grouping by texture and blend mode
+void batchSetOrdered(BOOL ordered);
+
+// index of the layer quads are being added to, for matching up stats
+unsigned int batchLayerIndex(void);
+
+// counters of the last frame drawn
+void batchGetStats(BatchStats* stats);
+
+// transform stack, replaces the GL modelview stack for anything batched
+void batchPushMatrix(void);
+void batchPopMatrix(void);
+void batchLoadIdentity(void);
+void batchLoadTransform(const Transform* m);
+void batchMultTransform(const Transform* m);
+void batchTranslate(float x, float y);
+void batchScale(float sx, float sy);
+
+// append a textured quad transformed by the top of the stack, texture 0 is solid
+void batchQuad(GLuint tex, const Quad* quad);
+
+// append a frame as a single instance, or the quad when not instancing (frames is NULL)
+void batchSprite(GLuint tex, BatchFrames* frames, unsigned int frame, const Quad* quad);
+
+// append a textured quad with an absolute transform (ignores the stack)
+void batchTransformedQuad(GLuint tex, const Quad* quad, const Transform* t);
+
+// draw a whole mesh with the top of the stack, in order with the quads around it
+void batchMesh(GLuint tex, BatchMesh* mesh);
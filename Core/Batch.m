@@ -0,0 +1,1648 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import <OpenGL/glext.h>
+#import <pthread.h>
+#import "Batch.h"
+
+// most quads submitted with a single draw call (indices must fit a short)
+#define BATCH_MAX_QUADS 4096
+
+// distinct blend modes per pass
+#define BATCH_MAX_BLENDS 256
+
+// deepest the transform stack can go
+#define BATCH_STACK_SIZE 32
+
+// widest a frame table texture gets, 4 texels per frame
+#define BATCH_FRAMES_WIDTH 1024
+
+// vertex attributes of the sprite shader
+enum {
+    BATCH_ATTRIB_CORNER,
+    BATCH_ATTRIB_TRANSFORM,
+    BATCH_ATTRIB_POSITION,
+    BATCH_ATTRIB_FRAME,
+    BATCH_ATTRIB_COLOR,
+};
+
+typedef struct {
+    GLfloat x, y;
+    GLfloat u, v;
+    GLubyte rgba[4];
+} BatchVert;
+
+// per-instance attributes of an instanced sprite
+typedef struct {
+    GLfloat a, b, c, d;
+    GLfloat x, y;
+    GLfloat frame;
+    GLubyte rgba[4];
+} BatchInstance;
+
+// a queued quad, already transformed, or a sprite instance, and where it sorts
+typedef struct {
+    uint64_t key;
+    GLuint tex;
+    GLenum src, dst;
+    BatchFrames* frames;
+    
+    union {
+        BatchVert v[4];
+        BatchInstance instance;
+    };
+} BatchCommand;
+
+// what the radix sort shuffles around
+typedef struct {
+    uint64_t key;
+    uint32_t index;
+} BatchSortItem;
+
+// everything that isn't a quad is replayed in the order it was recorded
+typedef enum {
+    BATCH_OP_CLEAR,
+    BATCH_OP_PROJECTION,
+    BATCH_OP_QUADS,
+    BATCH_OP_TARGET,
+    BATCH_OP_MESH,
+} BatchOpType;
+
+typedef struct {
+    BatchOpType type;
+    
+    union {
+        struct {
+            GLint width, height;
+            GLfloat rgb[3];
+        } clear;
+        
+        struct {
+            GLfloat left, right, bottom, top;
+            GLfloat view[16];
+        } projection;
+        
+        struct {
+            unsigned int first, count;
+        } quads;
+        
+        struct {
+            BatchTarget* target;
+        } target;
+        
+        struct {
+            BatchMesh* mesh;
+            unsigned int layer;
+            GLuint tex;
+            GLenum src, dst;
+            GLubyte rgba[4];
+            GLfloat transform[16];
+        } mesh;
+    };
+} BatchOp;
+
+struct BatchList {
+    BatchCommand* commands;
+    unsigned int count;
+    unsigned int capacity;
+    
+    // quads recorded before this are in a closed pass
+    unsigned int passStart;
+    
+    BatchOp* ops;
+    unsigned int opCount;
+    unsigned int opCapacity;
+    
+    // radix sort scratch, only touched while drawing
+    BatchSortItem* sortItems;
+    BatchSortItem* sortTemp;
+    unsigned int sortCapacity;
+    
+    // counted while drawing
+    BatchStats stats;
+    
+    // pixels filled per layer and the size of the display, counted while recording
+    GLfloat pixels[BATCH_STATS_LAYERS];
+    GLfloat displayPixels;
+    
+    // number of the frame, released objects are kept until it's drawn
+    unsigned int frame;
+};
+
+struct BatchTarget {
+    GLuint tex;
+    GLsizei width, height;
+    
+    // framebuffers aren't shared between contexts, so it's created when drawn
+    GLuint fbo;
+    
+    // next target waiting to be deleted, once the frame it was released in is drawn
+    BatchTarget* next;
+    unsigned int released;
+};
+
+struct BatchMesh {
+    unsigned int count;
+    
+    // total area of the quads, for the fill estimate
+    GLfloat area;
+    
+    // vertices until the render thread creates the buffer
+    Quad* quads;
+    GLuint vbo;
+    
+    // next mesh waiting to be deleted, once the frame it was released in is drawn
+    BatchMesh* next;
+    unsigned int released;
+};
+
+struct BatchFrames {
+    GLuint tex;
+    GLsizei width, height;
+    
+    // frames the texture has room for, so frames added later don't need a new table
+    unsigned int capacity;
+    
+    // sorts instances of the same page texture by table
+    unsigned int group;
+    
+    // next table waiting to be deleted, once the frame it was released in is drawn
+    BatchFrames* next;
+    unsigned int released;
+};
+
+// the corner's frame quad vertex is fetched from the table and transformed
+static const GLchar* batchVertexShader =
+    "#version 120\n"
+    "attribute float corner;\n"
+    "attribute vec4 transform;\n"
+    "attribute vec2 position;\n"
+    "attribute float frame;\n"
+    "attribute vec4 color;\n"
+    "uniform sampler2D frames;\n"
+    "uniform vec2 framesSize;\n"
+    "void main() {\n"
+    "    float i = frame * 4.0 + corner;\n"
+    "    vec2 at = vec2(mod(i, framesSize.x) + 0.5, floor(i / framesSize.x) + 0.5) / framesSize;\n"
+    "    vec4 v = texture2DLod(frames, at, 0.0);\n"
+    "    vec2 p = transform.xy * v.x + transform.zw * v.y + position;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(p, 0.0, 1.0);\n"
+    "    gl_TexCoord[0] = vec4(v.zw, 0.0, 1.0);\n"
+    "    gl_FrontColor = color;\n"
+    "}\n";
+
+static const GLchar* batchFragmentShader =
+    "#version 120\n"
+    "uniform sampler2D image;\n"
+    "void main() {\n"
+    "    gl_FragColor = texture2D(image, gl_TexCoord[0].xy) * gl_Color;\n"
+    "}\n";
+
+// one list is recorded while the other is drawn
+static BatchList batchLists[2];
+static BatchList* batchList = &batchLists[0];
+
+// pending vertices or instances and the shared quad indices
+static BatchVert batchVerts[BATCH_MAX_QUADS * 4];
+static BatchInstance batchInstances[BATCH_MAX_QUADS];
+static GLushort batchIndices[BATCH_MAX_QUADS * 6];
+
+// targets, meshes and frame tables released but maybe still in a frame to draw
+static BatchTarget* batchReleased = NULL;
+static BatchMesh* batchReleasedMeshes = NULL;
+static BatchFrames* batchReleasedFrames = NULL;
+static pthread_mutex_t batchReleaseLock = PTHREAD_MUTEX_INITIALIZER;
+
+// number of the frame being recorded
+static unsigned int batchFrame = 0;
+
+// set while drawing into a target, which keeps premultiplied color
+static BOOL batchInTarget = NO;
+
+// size of the display, for switching back from a target
+static GLsizei batchViewport[2] = { 0, 0 };
+
+// size of the display and whatever is being recorded into, and pixels per unit of area
+static GLsizei batchDisplaySize[2] = { 0, 0 };
+static GLsizei batchRecordSize[2] = { 0, 0 };
+static GLfloat batchPixelScale = 0.0f;
+
+// counters of the list being drawn, and of the last one finished
+static BatchStats* batchStats = NULL;
+static BatchCounters* batchLayerStats = NULL;
+static BatchStats batchLastStats;
+static pthread_mutex_t batchStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// GL state of the render context, so calls that wouldn't change it are skipped
+typedef struct {
+    GLuint tex[2];
+    GLuint unit;
+    GLint texturing;
+    GLenum blend[2];
+    uint64_t color;
+    GLuint arrayBuffer;
+    GLuint elementBuffer;
+    GLint colorArray;
+    
+    // array pointers into the streaming buffer
+    GLint quadPointers;
+    GLint instancePointers;
+} BatchState;
+
+static BatchState batchState;
+
+// streaming vertex and static index buffers
+static GLuint batchVBO = 0;
+static GLuint batchIBO = 0;
+
+// sprite shader, set once the pipeline is known to work
+static BOOL batchInstancing = NO;
+static GLuint batchProgram = 0;
+static GLint batchFramesSize = -1;
+
+// sort groups of live frame tables, zero is for quads
+static unsigned char batchFreeGroups[255];
+static unsigned int batchFreeGroupCount = 0;
+static unsigned int batchNextGroup = 1;
+
+// corner numbers of a quad, the per-vertex input of every instance
+static GLuint batchCornerVBO = 0;
+
+// blend modes used in the current pass, the key stores the index
+static GLenum batchBlends[BATCH_MAX_BLENDS][2];
+static unsigned int batchBlendCount = 0;
+static unsigned int batchBlend = 0;
+
+// current sort state
+static unsigned int batchLayer = 0;
+static int batchDepth = 0;
+static BOOL batchOrdered = NO;
+static unsigned int batchSequence = 0;
+
+// current render state
+static GLubyte batchColor[4] = { 255, 255, 255, 255 };
+static const GLubyte batchWhite[4] = { 255, 255, 255, 255 };
+
+// transform stack
+static Transform batchStack[BATCH_STACK_SIZE] = {{ 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f }};
+static int batchTop = 0;
+
+// pushes refused because the stack was full, their pops are ignored too
+static int batchOverflow = 0;
+
+static void batchCreateBuffers(void)
+{
+    GLfloat corners[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    
+    for(int i = 0;i < BATCH_MAX_QUADS;i++) {
+        GLushort* index = &batchIndices[i * 6];
+        GLushort base = i * 4;
+        
+        // two triangles per quad, same winding as the original fan
+        index[0] = base + 0;
+        index[1] = base + 1;
+        index[2] = base + 2;
+        index[3] = base + 0;
+        index[4] = base + 2;
+        index[5] = base + 3;
+    }
+    
+    glGenBuffers(1, &batchVBO);
+    glGenBuffers(1, &batchIBO);
+    
+    // the index buffer never changes
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batchIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(batchIndices), batchIndices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    
+    // instances all share the same four corners
+    glGenBuffers(1, &batchCornerVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, batchCornerVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static BOOL batchHasExtension(const char* name)
+{
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    size_t len = strlen(name);
+    
+    // match whole names only
+    for(const char* p = extensions;p && (p = strstr(p, name)) != NULL;p += len) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return YES;
+        }
+    }
+    
+    return NO;
+}
+
+static GLuint batchCompileShader(GLenum type, const GLchar* source)
+{
+    GLuint shader = glCreateShader(type);
+    GLint ok;
+    
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    
+    if (ok == GL_FALSE) {
+        GLchar log[1024];
+        
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        NSLog(@"Failed to compile sprite shader: %s\n", log);
+        
+        glDeleteShader(shader);
+        return 0;
+    }
+    
+    return shader;
+}
+
+static void batchMatrix(const Transform* t, GLfloat* m)
+{
+    memset(m, 0, sizeof(GLfloat) * 16);
+    
+    // column-major 4x4 of the transform
+    m[0] = t ? t->a : 1.0f;
+    m[1] = t ? t->b : 0.0f;
+    m[4] = t ? t->c : 0.0f;
+    m[5] = t ? t->d : 1.0f;
+    m[10] = 1.0f;
+    m[12] = t ? t->x : 0.0f;
+    m[13] = t ? t->y : 0.0f;
+    m[15] = 1.0f;
+}
+
+static GLfloat batchQuadArea(const Quad* quad)
+{
+    GLfloat area = 0.0f;
+    
+    // shoelace, the winding doesn't matter
+    for(int i = 0;i < 4;i++) {
+        const Vert* a = &quad->v[i];
+        const Vert* b = &quad->v[(i + 1) & 3];
+        
+        area += a->x * b->y - b->x * a->y;
+    }
+    
+    return fabsf(area) * 0.5f;
+}
+
+static void batchFill(GLfloat area, const Transform* t)
+{
+    BatchList* list = batchList;
+    
+    // scaled by the transform, then by the projection
+    area *= fabsf(t->a * t->d - t->b * t->c);
+    
+    list->pixels[MIN(batchLayer, BATCH_STATS_LAYERS - 1)] += area * batchPixelScale;
+}
+
+static void batchCountLayer(unsigned int layer)
+{
+    layer = MIN(layer, BATCH_STATS_LAYERS - 1);
+    
+    batchStats->layerCount = MAX(batchStats->layerCount, layer + 1);
+    batchLayerStats = &batchStats->layers[layer];
+}
+
+static void batchCount(unsigned int draws, unsigned int vertices)
+{
+    batchStats->total.drawCalls += draws;
+    batchStats->total.vertices += vertices;
+    
+    batchLayerStats->drawCalls += draws;
+    batchLayerStats->vertices += vertices;
+}
+
+static void batchSkipped(void)
+{
+    batchStats->total.stateSkipped++;
+    batchLayerStats->stateSkipped++;
+}
+
+static void batchInvalidateState(void)
+{
+    // nothing matches, so the next call of each is made
+    memset(&batchState, 0xFF, sizeof(batchState));
+}
+
+static void batchBindTexture(GLuint unit, GLuint tex)
+{
+    if (batchState.tex[unit] == tex) {
+        batchSkipped();
+        return;
+    }
+    
+    if (batchState.unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        batchState.unit = unit;
+    }
+    
+    glBindTexture(GL_TEXTURE_2D, tex);
+    batchState.tex[unit] = tex;
+    
+    batchStats->total.textureBinds++;
+    batchLayerStats->textureBinds++;
+}
+
+static void batchEnableTexturing(BOOL enabled)
+{
+    if (batchState.texturing == (GLint)enabled) {
+        batchSkipped();
+        return;
+    }
+    
+    // only unit 0 is ever used by fixed-function
+    if (batchState.unit != 0) {
+        glActiveTexture(GL_TEXTURE0);
+        batchState.unit = 0;
+    }
+    
+    if (enabled) {
+        glEnable(GL_TEXTURE_2D);
+    } else {
+        glDisable(GL_TEXTURE_2D);
+    }
+    
+    batchState.texturing = enabled;
+}
+
+static void batchBlendFunc(GLenum src, GLenum dst)
+{
+    if (src == batchState.blend[0] && dst == batchState.blend[1]) {
+        batchSkipped();
+        return;
+    }
+    
+    // alpha is accumulated as coverage so the target can be composited premultiplied
+    if (batchInTarget) {
+        glBlendFuncSeparate(src, dst, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    } else {
+        glBlendFunc(src, dst);
+    }
+    
+    batchState.blend[0] = src;
+    batchState.blend[1] = dst;
+    
+    batchStats->total.blendChanges++;
+    batchLayerStats->blendChanges++;
+}
+
+static void batchDrawColor(const GLubyte* rgba)
+{
+    uint64_t color = ((uint64_t)rgba[0] << 24) | (rgba[1] << 16) | (rgba[2] << 8) | rgba[3];
+    
+    if (batchState.color == color) {
+        batchSkipped();
+        return;
+    }
+    
+    glColor4ubv(rgba);
+    batchState.color = color;
+}
+
+static void batchBindBuffer(GLenum target, GLuint buffer)
+{
+    GLuint* bound = (target == GL_ARRAY_BUFFER) ? &batchState.arrayBuffer : &batchState.elementBuffer;
+    
+    if (*bound == buffer) {
+        batchSkipped();
+        return;
+    }
+    
+    glBindBuffer(target, buffer);
+    *bound = buffer;
+}
+
+static void batchColorArray(BOOL enabled)
+{
+    if (batchState.colorArray == (GLint)enabled) {
+        batchSkipped();
+        return;
+    }
+    
+    // drawing with colors per vertex leaves the current color undefined
+    if (enabled) {
+        glEnableClientState(GL_COLOR_ARRAY);
+        batchState.color = ~0ULL;
+    } else {
+        glDisableClientState(GL_COLOR_ARRAY);
+    }
+    
+    batchState.colorArray = enabled;
+}
+
+static void batchResetBlends(GLenum src, GLenum dst)
+{
+    batchBlends[0][0] = src;
+    batchBlends[0][1] = dst;
+    batchBlendCount = 1;
+    batchBlend = 0;
+}
+
+static void* batchReserve(void* items, unsigned int* capacity, unsigned int count, size_t size)
+{
+    if (count < *capacity) {
+        return items;
+    }
+    
+    // double the storage, it's kept for the life of the list
+    *capacity = *capacity ? *capacity * 2 : 1024;
+    
+    return realloc(items, *capacity * size);
+}
+
+static BatchOp* batchAddOp(BatchOpType type)
+{
+    BatchList* list = batchList;
+    BatchOp* op;
+    
+    list->ops = batchReserve(list->ops, &list->opCapacity, list->opCount, sizeof(BatchOp));
+    
+    op = &list->ops[list->opCount++];
+    op->type = type;
+    
+    return op;
+}
+
+static BatchSortItem* batchSort(BatchList* list, unsigned int first, unsigned int count)
+{
+    unsigned int counts[8][256] = {{0}};
+    BatchSortItem* src;
+    BatchSortItem* dst;
+    
+    // scratch space for the largest pass seen so far
+    if (count > list->sortCapacity) {
+        list->sortCapacity = count;
+        list->sortItems = realloc(list->sortItems, count * sizeof(BatchSortItem));
+        list->sortTemp = realloc(list->sortTemp, count * sizeof(BatchSortItem));
+    }
+    
+    src = list->sortItems;
+    dst = list->sortTemp;
+    
+    // histogram every byte of the keys in one pass
+    for(unsigned int i = 0;i < count;i++) {
+        uint64_t key = list->commands[first + i].key;
+        
+        src[i].key = key;
+        src[i].index = first + i;
+        
+        for(int b = 0;b < 8;b++) {
+            counts[b][(key >> (b * 8)) & 0xFF]++;
+        }
+    }
+    
+    // stable LSD radix sort, so equal keys stay in submission order
+    for(int b = 0;b < 8;b++) {
+        unsigned int offset = 0;
+        
+        // every key has the same byte here, nothing would move
+        if (counts[b][(src[0].key >> (b * 8)) & 0xFF] == count) {
+            continue;
+        }
+        
+        // turn the counts into starting offsets
+        for(int n = 0;n < 256;n++) {
+            unsigned int bucket = counts[b][n];
+            
+            counts[b][n] = offset;
+            offset += bucket;
+        }
+        
+        for(unsigned int i = 0;i < count;i++) {
+            dst[counts[b][(src[i].key >> (b * 8)) & 0xFF]++] = src[i];
+        }
+        
+        // swap buffers
+        BatchSortItem* t = src;
+        
+        src = dst;
+        dst = t;
+    }
+    
+    return src;
+}
+
+static void batchDrawQuads(const BatchCommand* cmd, unsigned int quads)
+{
+    // texture 0 is a solid colored quad
+    if (cmd->tex == 0) {
+        batchEnableTexturing(NO);
+    } else {
+        batchEnableTexturing(YES);
+        batchBindTexture(0, cmd->tex);
+    }
+    
+    batchBlendFunc(cmd->src, cmd->dst);
+    batchCount(1, quads * 4);
+    
+    // orphan the previous contents so the driver doesn't stall
+    glBufferData(GL_ARRAY_BUFFER, sizeof(BatchVert) * quads * 4, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(BatchVert) * quads * 4, batchVerts);
+    
+    // interleaved position, texcoord and color, the offsets never change
+    if (batchState.quadPointers == YES) {
+        batchSkipped();
+    } else {
+        glVertexPointer(2, GL_FLOAT, sizeof(BatchVert), (const GLvoid*)offsetof(BatchVert, x));
+        glTexCoordPointer(2, GL_FLOAT, sizeof(BatchVert), (const GLvoid*)offsetof(BatchVert, u));
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(BatchVert), (const GLvoid*)offsetof(BatchVert, rgba));
+        
+        batchState.quadPointers = YES;
+    }
+    
+    glDrawElements(GL_TRIANGLES, quads * 6, GL_UNSIGNED_SHORT, NULL);
+}
+
+static void batchDrawInstances(const BatchCommand* cmd, unsigned int count)
+{
+    const BatchFrames* frames = cmd->frames;
+    
+    // the frame table is read by the vertex shader
+    batchBindTexture(1, frames->tex);
+    batchBindTexture(0, cmd->tex);
+    
+    batchBlendFunc(cmd->src, cmd->dst);
+    batchCount(1, count * 4);
+    
+    glUniform2f(batchFramesSize, frames->width, frames->height);
+    
+    glBufferData(GL_ARRAY_BUFFER, sizeof(BatchInstance) * count, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(BatchInstance) * count, batchInstances);
+    
+    // one record per instance
+    if (batchState.instancePointers == YES) {
+        batchSkipped();
+    } else {
+        glVertexAttribPointer(BATCH_ATTRIB_TRANSFORM, 4, GL_FLOAT, GL_FALSE, sizeof(BatchInstance), (const GLvoid*)offsetof(BatchInstance, a));
+        glVertexAttribPointer(BATCH_ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(BatchInstance), (const GLvoid*)offsetof(BatchInstance, x));
+        glVertexAttribPointer(BATCH_ATTRIB_FRAME, 1, GL_FLOAT, GL_FALSE, sizeof(BatchInstance), (const GLvoid*)offsetof(BatchInstance, frame));
+        glVertexAttribPointer(BATCH_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(BatchInstance), (const GLvoid*)offsetof(BatchInstance, rgba));
+        
+        batchState.instancePointers = YES;
+    }
+    
+    glDrawElementsInstancedARB(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, NULL, count);
+}
+
+static void batchSetInstanced(BOOL instanced)
+{
+    if (instanced) {
+        glUseProgram(batchProgram);
+        
+        // swap the fixed-function arrays for the shader's attributes
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        batchColorArray(NO);
+        
+        for(GLuint i = BATCH_ATTRIB_CORNER;i <= BATCH_ATTRIB_COLOR;i++) {
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisorARB(i, (i == BATCH_ATTRIB_CORNER) ? 0 : 1);
+        }
+        
+        batchBindBuffer(GL_ARRAY_BUFFER, batchCornerVBO);
+        glVertexAttribPointer(BATCH_ATTRIB_CORNER, 1, GL_FLOAT, GL_FALSE, 0, NULL);
+        
+        // attribute 0 aliases the vertex array
+        batchState.quadPointers = NO;
+    } else {
+        glUseProgram(0);
+        
+        for(GLuint i = BATCH_ATTRIB_CORNER;i <= BATCH_ATTRIB_COLOR;i++) {
+            glVertexAttribDivisorARB(i, 0);
+            glDisableVertexAttribArray(i);
+        }
+        
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        batchColorArray(YES);
+    }
+    
+    batchBindBuffer(GL_ARRAY_BUFFER, batchVBO);
+}
+
+static void batchDrawRun(const BatchCommand* cmd, unsigned int count)
+{
+    // a run spanning layers is counted in the first
+    batchCountLayer((unsigned int)(cmd->key >> 48));
+    
+    if (cmd->frames != NULL) {
+        batchDrawInstances(cmd, count);
+    } else {
+        batchDrawQuads(cmd, count);
+    }
+}
+
+static void batchDrawPass(BatchList* list, unsigned int first, unsigned int count)
+{
+    BatchSortItem* sorted;
+    const BatchCommand* run;
+    unsigned int quads = 0;
+    
+    // lazily create the buffers the first time there's a context to do it
+    if (batchVBO == 0) {
+        batchCreateBuffers();
+    }
+    
+    // order by layer, depth, blend and texture
+    sorted = batchSort(list, first, count);
+    
+    batchColorArray(YES);
+    batchBindBuffer(GL_ARRAY_BUFFER, batchVBO);
+    batchBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batchIBO);
+    
+    run = &list->commands[sorted[0].index];
+    
+    if (run->frames != NULL) {
+        batchSetInstanced(YES);
+    }
+    
+    for(unsigned int i = 0;i < count;i++) {
+        const BatchCommand* cmd = &list->commands[sorted[i].index];
+        
+        // draw what's collected so far on a state change or when full, keys alone may collide
+        if (cmd->tex != run->tex || cmd->src != run->src || cmd->dst != run->dst || cmd->frames != run->frames || quads == BATCH_MAX_QUADS) {
+            batchDrawRun(run, quads);
+            
+            // switch between instances and quads
+            if ((cmd->frames == NULL) != (run->frames == NULL)) {
+                batchSetInstanced(cmd->frames != NULL);
+            }
+            
+            run = cmd;
+            quads = 0;
+        }
+        
+        if (cmd->frames != NULL) {
+            batchInstances[quads++] = cmd->instance;
+        } else {
+            memcpy(&batchVerts[quads++ * 4], cmd->v, sizeof(cmd->v));
+        }
+    }
+    
+    batchDrawRun(run, quads);
+    
+    // the next pass may not have any instances
+    if (run->frames != NULL) {
+        batchSetInstanced(NO);
+    }
+}
+
+static void batchDrawClear(const BatchOp* op)
+{
+    batchViewport[0] = op->clear.width;
+    batchViewport[1] = op->clear.height;
+    
+    // setup the viewport that we're render to
+    glViewport(0, 0, op->clear.width, op->clear.height);
+    
+    // set default render state
+    batchEnableTexturing(YES);
+    glEnable(GL_BLEND);
+    
+    // set the default blending mode
+    batchBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    
+    // use vertex and texture coordinate buffers
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    
+    // erase the display
+    glClearColor(op->clear.rgb[0], op->clear.rgb[1], op->clear.rgb[2], 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    
+    // batched vertices are already transformed
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    
+    // reset the render state
+    batchDrawColor(batchWhite);
+}
+
+static void batchDrawProjection(const BatchOp* op)
+{
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(op->projection.left, op->projection.right, op->projection.bottom, op->projection.top, 0.0f, 1.0f);
+    glMultMatrixf(op->projection.view);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+static void batchDrawTarget(const BatchOp* op)
+{
+    BatchTarget* target = op->target.target;
+    
+    // the blend function for alpha depends on where it's drawn
+    batchInTarget = (target != NULL);
+    batchState.blend[0] = batchState.blend[1] = (GLenum)-1;
+    
+    // back to the display
+    if (target == NULL) {
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+        glViewport(0, 0, batchViewport[0], batchViewport[1]);
+        return;
+    }
+    
+    if (target->fbo == 0) {
+        glGenFramebuffersEXT(1, &target->fbo);
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, target->fbo);
+        glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, target->tex, 0);
+    } else {
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, target->fbo);
+    }
+    
+    glViewport(0, 0, target->width, target->height);
+    
+    // start with nothing
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+static void batchDrawMesh(const BatchOp* op)
+{
+    BatchMesh* mesh = op->mesh.mesh;
+    
+    // the mesh shares the quad index buffer
+    if (batchIBO == 0) {
+        batchCreateBuffers();
+    }
+    
+    // upload the first time it's drawn, the vertices aren't needed after
+    if (mesh->vbo == 0) {
+        glGenBuffers(1, &mesh->vbo);
+        batchBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Quad) * mesh->count, mesh->quads, GL_STATIC_DRAW);
+        
+        free(mesh->quads);
+        mesh->quads = NULL;
+    } else {
+        batchBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+    }
+    
+    batchCountLayer(op->mesh.layer);
+    
+    // one color for the whole mesh
+    batchEnableTexturing(YES);
+    batchBindTexture(0, op->mesh.tex);
+    batchBlendFunc(op->mesh.src, op->mesh.dst);
+    batchColorArray(NO);
+    batchDrawColor(op->mesh.rgba);
+    
+    // the vertices aren't transformed yet
+    glLoadMatrixf(op->mesh.transform);
+    batchBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batchIBO);
+    
+    // the quad pointers are replaced by the mesh's
+    batchState.quadPointers = NO;
+    
+    // as many quads at a time as the index buffer allows
+    for(unsigned int first = 0;first < mesh->count;first += BATCH_MAX_QUADS) {
+        unsigned int quads = MIN(mesh->count - first, BATCH_MAX_QUADS);
+        size_t offset = sizeof(Quad) * first;
+        
+        glVertexPointer(2, GL_FLOAT, sizeof(Vert), (const GLvoid*)(offset + offsetof(Vert, x)));
+        glTexCoordPointer(2, GL_FLOAT, sizeof(Vert), (const GLvoid*)(offset + offsetof(Vert, u)));
+        glDrawElements(GL_TRIANGLES, quads * 6, GL_UNSIGNED_SHORT, NULL);
+        batchCount(1, quads * 4);
+    }
+    
+    // back to pre-transformed batches
+    glLoadIdentity();
+}
+
+// unlinks everything released while recording frames up to and including drawn
+#define batchTakeReleased(T, head, drawn, taken) \
+    for(T** link = &(head);*link != NULL;) { \
+        T* item = *link; \
+        if ((int)(item->released - (drawn)) <= 0) { \
+            *link = item->next; \
+            item->next = (taken); \
+            (taken) = item; \
+        } else { \
+            link = &item->next; \
+        } \
+    }
+
+static void batchDeleteReleased(unsigned int drawn)
+{
+    BatchTarget* target = NULL;
+    BatchMesh* mesh = NULL;
+    BatchFrames* frames = NULL;
+    
+    // the frames after this one may still use the rest
+    pthread_mutex_lock(&batchReleaseLock);
+    {
+        batchTakeReleased(BatchTarget, batchReleased, drawn, target);
+        batchTakeReleased(BatchMesh, batchReleasedMeshes, drawn, mesh);
+        batchTakeReleased(BatchFrames, batchReleasedFrames, drawn, frames);
+    }
+    pthread_mutex_unlock(&batchReleaseLock);
+    
+    while (frames != NULL) {
+        BatchFrames* next = frames->next;
+        
+        glDeleteTextures(1, &frames->tex);
+        free(frames);
+        
+        frames = next;
+    }
+    
+    while (mesh != NULL) {
+        BatchMesh* next = mesh->next;
+        
+        if (mesh->vbo != 0) {
+            glDeleteBuffers(1, &mesh->vbo);
+        }
+        
+        free(mesh->quads);
+        free(mesh);
+        
+        mesh = next;
+    }
+    
+    while (target != NULL) {
+        BatchTarget* next = target->next;
+        
+        if (target->fbo != 0) {
+            glDeleteFramebuffersEXT(1, &target->fbo);
+        }
+        
+        glDeleteTextures(1, &target->tex);
+        free(target);
+        
+        target = next;
+    }
+}
+
+BOOL batchEnableShaders(void)
+{
+    GLint units = 0;
+    GLuint vs, fs;
+    GLint ok;
+    
+    if (batchProgram != 0) {
+        return batchInstancing = YES;
+    }
+    
+    glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &units);
+    
+    // instancing, float frame tables and reading them in the vertex shader
+    if (batchHasExtension("GL_ARB_instanced_arrays") == NO || batchHasExtension("GL_ARB_texture_float") == NO || units < 1) {
+        return NO;
+    }
+    
+    if ((vs = batchCompileShader(GL_VERTEX_SHADER, batchVertexShader)) == 0) {
+        return NO;
+    }
+    
+    if ((fs = batchCompileShader(GL_FRAGMENT_SHADER, batchFragmentShader)) == 0) {
+        glDeleteShader(vs);
+        return NO;
+    }
+    
+    // programs are shared with the render thread's context
+    batchProgram = glCreateProgram();
+    glAttachShader(batchProgram, vs);
+    glAttachShader(batchProgram, fs);
+    
+    // corner is attribute 0, so it's the one that's per-vertex
+    glBindAttribLocation(batchProgram, BATCH_ATTRIB_CORNER, "corner");
+    glBindAttribLocation(batchProgram, BATCH_ATTRIB_TRANSFORM, "transform");
+    glBindAttribLocation(batchProgram, BATCH_ATTRIB_POSITION, "position");
+    glBindAttribLocation(batchProgram, BATCH_ATTRIB_FRAME, "frame");
+    glBindAttribLocation(batchProgram, BATCH_ATTRIB_COLOR, "color");
+    
+    glLinkProgram(batchProgram);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    glGetProgramiv(batchProgram, GL_LINK_STATUS, &ok);
+    
+    if (ok == GL_FALSE) {
+        glDeleteProgram(batchProgram);
+        batchProgram = 0;
+        return NO;
+    }
+    
+    // the image is on unit 0 and the frame table on 1
+    glUseProgram(batchProgram);
+    glUniform1i(glGetUniformLocation(batchProgram, "image"), 0);
+    glUniform1i(glGetUniformLocation(batchProgram, "frames"), 1);
+    glUseProgram(0);
+    
+    batchFramesSize = glGetUniformLocation(batchProgram, "framesSize");
+    
+    return batchInstancing = YES;
+}
+
+BOOL batchIsInstancing(void)
+{
+    return batchInstancing;
+}
+
+void batchBegin(void)
+{
+    BatchList* list = batchList;
+    
+    // reuse the list's storage
+    list->count = 0;
+    list->passStart = 0;
+    list->opCount = 0;
+    
+    memset(list->pixels, 0, sizeof(list->pixels));
+    list->displayPixels = 0.0f;
+    
+    batchLayer = 0;
+    batchDepth = 0;
+    batchOrdered = NO;
+    batchSequence = 0;
+    
+    // default blend mode
+    batchResetBlends(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    
+    // opaque white
+    batchSetColor(1.0f, 1.0f, 1.0f, 1.0f);
+    
+    // identity transform
+    batchTop = 0;
+    batchOverflow = 0;
+    batchLoadIdentity();
+}
+
+void batchFlush(void)
+{
+    BatchList* list = batchList;
+    BatchOp* op;
+    
+    if (list->count == list->passStart) {
+        return;
+    }
+    
+    // close the pass, it's sorted when drawn
+    op = batchAddOp(BATCH_OP_QUADS);
+    op->quads.first = list->passStart;
+    op->quads.count = list->count - list->passStart;
+    
+    list->passStart = list->count;
+    batchSequence = 0;
+    
+    // only the current blend mode is still needed
+    batchResetBlends(batchBlends[batchBlend][0], batchBlends[batchBlend][1]);
+}
+
+void batchClear(GLint width, GLint height, const GLfloat* rgb)
+{
+    BatchOp* op;
+    
+    batchFlush();
+    
+    op = batchAddOp(BATCH_OP_CLEAR);
+    op->clear.width = width;
+    op->clear.height = height;
+    
+    // what overdraw is measured against
+    batchDisplaySize[0] = batchRecordSize[0] = width;
+    batchDisplaySize[1] = batchRecordSize[1] = height;
+    batchList->displayPixels = (GLfloat)width * (GLfloat)height;
+    
+    memcpy(op->clear.rgb, rgb, sizeof(op->clear.rgb));
+}
+
+void batchSetProjection(float left, float right, float bottom, float top, const Transform* view)
+{
+    BatchOp* op;
+    
+    // anything batched was meant for the previous projection
+    batchFlush();
+    
+    op = batchAddOp(BATCH_OP_PROJECTION);
+    op->projection.left = left;
+    op->projection.right = right;
+    op->projection.bottom = bottom;
+    op->projection.top = top;
+    
+    batchMatrix(view, op->projection.view);
+    
+    // pixels covered by a unit of area drawn after this
+    batchPixelScale = (GLfloat)batchRecordSize[0] * (GLfloat)batchRecordSize[1] / fabsf((right - left) * (top - bottom));
+    
+    if (view != NULL) {
+        batchPixelScale *= fabsf(view->a * view->d - view->b * view->c);
+    }
+}
+
+BatchTarget* batchCreateTarget(GLsizei width, GLsizei height)
+{
+    BatchTarget* target = calloc(1, sizeof(BatchTarget));
+    
+    target->width = width;
+    target->height = height;
+    
+    // the texture is shared with the render thread's context
+    glGenTextures(1, &target->tex);
+    glBindTexture(GL_TEXTURE_2D, target->tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    return target;
+}
+
+void batchReleaseTarget(BatchTarget* target)
+{
+    if (target == NULL) {
+        return;
+    }
+    
+    // frames up to the one being recorded may still draw it, so the render thread deletes it
+    pthread_mutex_lock(&batchReleaseLock);
+    {
+        target->released = batchFrame;
+        target->next = batchReleased;
+        batchReleased = target;
+    }
+    pthread_mutex_unlock(&batchReleaseLock);
+}
+
+BatchMesh* batchCreateMesh(const Quad* quads, unsigned int count)
+{
+    BatchMesh* mesh = calloc(1, sizeof(BatchMesh));
+    
+    mesh->count = count;
+    mesh->quads = malloc(sizeof(Quad) * count);
+    
+    memcpy(mesh->quads, quads, sizeof(Quad) * count);
+    
+    for(unsigned int i = 0;i < count;i++) {
+        mesh->area += batchQuadArea(&quads[i]);
+    }
+    
+    return mesh;
+}
+
+void batchReleaseMesh(BatchMesh* mesh)
+{
+    if (mesh == NULL) {
+        return;
+    }
+    
+    // frames up to the one being recorded may still draw it, so the render thread deletes it
+    pthread_mutex_lock(&batchReleaseLock);
+    {
+        mesh->released = batchFrame;
+        mesh->next = batchReleasedMeshes;
+        batchReleasedMeshes = mesh;
+    }
+    pthread_mutex_unlock(&batchReleaseLock);
+}
+
+static void batchFrameTexels(const Quad* quad, GLfloat* texels)
+{
+    // a texel per corner: position and texcoord
+    for(int n = 0;n < 4;n++) {
+        const Vert* v = &quad->v[n];
+        GLfloat* texel = &texels[n * 4];
+        
+        texel[0] = v->x;
+        texel[1] = v->y;
+        texel[2] = v->u;
+        texel[3] = v->v;
+    }
+}
+
+BatchFrames* batchCreateFrames(const Quad* quads, unsigned int count)
+{
+    BatchFrames* frames = calloc(1, sizeof(BatchFrames));
+    unsigned int texels;
+    GLfloat* data;
+    
+    // leave room to add frames, rows hold a whole number of frames
+    for(frames->capacity = 16;frames->capacity < count;frames->capacity *= 2);
+    
+    texels = frames->capacity * 4;
+    
+    frames->width = MIN(texels, BATCH_FRAMES_WIDTH);
+    frames->height = (texels + frames->width - 1) / frames->width;
+    
+    // tables only share a group once there are more than 255 of them
+    if (batchFreeGroupCount > 0) {
+        frames->group = batchFreeGroups[--batchFreeGroupCount];
+    } else if (batchNextGroup <= 255) {
+        frames->group = batchNextGroup++;
+    } else {
+        frames->group = 1 + (batchNextGroup++ % 255);
+    }
+    
+    data = calloc(frames->width * frames->height * 4, sizeof(GLfloat));
+    
+    for(unsigned int i = 0;i < count;i++) {
+        batchFrameTexels(&quads[i], &data[i * 16]);
+    }
+    
+    // the texture is shared with the render thread's context
+    glGenTextures(1, &frames->tex);
+    glBindTexture(GL_TEXTURE_2D, frames->tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, frames->width, frames->height, 0, GL_RGBA, GL_FLOAT, data);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    free(data);
+    
+    return frames;
+}
+
+BOOL batchAppendFrames(BatchFrames* frames, const Quad* quads, unsigned int first, unsigned int count)
+{
+    GLfloat texels[16];
+    
+    if (frames == NULL || first + count > frames->capacity) {
+        return NO;
+    }
+    
+    // frames drawn before only read the texels they already had
+    glBindTexture(GL_TEXTURE_2D, frames->tex);
+    
+    for(unsigned int i = 0;i < count;i++) {
+        unsigned int texel = (first + i) * 4;
+        
+        batchFrameTexels(&quads[i], texels);
+        
+        glTexSubImage2D(GL_TEXTURE_2D, 0, texel % frames->width, texel / frames->width, 4, 1, GL_RGBA, GL_FLOAT, texels);
+    }
+    
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    return YES;
+}
+
+void batchReleaseFrames(BatchFrames* frames)
+{
+    if (frames == NULL) {
+        return;
+    }
+    
+    // the group can go to the next table, it's only used for sorting
+    if (frames->group <= 255 && batchFreeGroupCount < 255) {
+        batchFreeGroups[batchFreeGroupCount++] = (unsigned char)frames->group;
+    }
+    
+    // frames up to the one being recorded may still draw it, so the render thread deletes it
+    pthread_mutex_lock(&batchReleaseLock);
+    {
+        frames->released = batchFrame;
+        frames->next = batchReleasedFrames;
+        batchReleasedFrames = frames;
+    }
+    pthread_mutex_unlock(&batchReleaseLock);
+}
+
+GLuint batchTargetTexture(const BatchTarget* target)
+{
+    return target->tex;
+}
+
+void batchSetTarget(BatchTarget* target)
+{
+    BatchOp* op;
+    
+    // quads so far go to the previous target
+    batchFlush();
+    
+    op = batchAddOp(BATCH_OP_TARGET);
+    op->target.target = target;
+    
+    // a projection for the new size is set next
+    batchRecordSize[0] = target ? target->width : batchDisplaySize[0];
+    batchRecordSize[1] = target ? target->height : batchDisplaySize[1];
+}
+
+BatchList* batchSwap(void)
+{
+    BatchList* list = batchList;
+    
+    // close the last pass
+    batchFlush();
+    
+    // frames are drawn in the order they were recorded
+    list->frame = batchFrame++;
+    
+    // record the next frame into the other list
+    batchList = (list == &batchLists[0]) ? &batchLists[1] : &batchLists[0];
+    
+    return list;
+}
+
+void batchDraw(BatchList* list)
+{
+    // start counting the frame
+    memset(&list->stats, 0, sizeof(list->stats));
+    
+    batchStats = &list->stats;
+    batchLayerStats = &list->stats.layers[0];
+    
+    // the fill estimate was counted while recording
+    for(unsigned int i = 0;i < BATCH_STATS_LAYERS;i++) {
+        list->stats.layers[i].pixels = list->pixels[i];
+        list->stats.total.pixels += list->pixels[i];
+    }
+    
+    if (list->displayPixels > 0.0f) {
+        list->stats.overdraw = list->stats.total.pixels / list->displayPixels;
+    }
+    
+    // other contexts may have deleted or reused objects since the last frame
+    batchInvalidateState();
+    batchInTarget = NO;
+    
+    for(unsigned int i = 0;i < list->opCount;i++) {
+        const BatchOp* op = &list->ops[i];
+        
+        switch (op->type) {
+            case BATCH_OP_CLEAR:
+                batchDrawClear(op);
+                break;
+            case BATCH_OP_PROJECTION:
+                batchDrawProjection(op);
+                break;
+            case BATCH_OP_QUADS:
+                batchDrawPass(list, op->quads.first, op->quads.count);
+                break;
+            case BATCH_OP_TARGET:
+                batchDrawTarget(op);
+                break;
+            case BATCH_OP_MESH:
+                batchDrawMesh(op);
+                break;
+        }
+    }
+    
+    // publish the counters for the main thread
+    pthread_mutex_lock(&batchStatsLock);
+    {
+        batchLastStats = list->stats;
+    }
+    pthread_mutex_unlock(&batchStatsLock);
+    
+    // nothing released before or during this frame can be drawn again
+    batchDeleteReleased(list->frame);
+}
+
+void batchGetStats(BatchStats* stats)
+{
+    pthread_mutex_lock(&batchStatsLock);
+    {
+        *stats = batchLastStats;
+    }
+    pthread_mutex_unlock(&batchStatsLock);
+}
+
+void batchSetBlend(GLenum src, GLenum dst)
+{
+    unsigned int i;
+    
+    for(i = 0;i < batchBlendCount;i++) {
+        if (batchBlends[i][0] == src && batchBlends[i][1] == dst) {
+            batchBlend = i;
+            return;
+        }
+    }
+    
+    // out of blend modes, start a new pass
+    if (batchBlendCount == BATCH_MAX_BLENDS) {
+        batchFlush();
+        batchResetBlends(src, dst);
+        return;
+    }
+    
+    batchBlends[batchBlendCount][0] = src;
+    batchBlends[batchBlendCount][1] = dst;
+    batchBlend = batchBlendCount++;
+}
+
+void batchNextLayer(void)
+{
+    batchLayer++;
+    batchDepth = 0;
+}
+
+unsigned int batchLayerIndex(void)
+{
+    return batchLayer;
+}
+
+void batchSetDepth(int depth)
+{
+    batchDepth = depth;
+}
+
+void batchSetOrdered(BOOL ordered)
+{
+    batchOrdered = ordered;
+}
+
+void batchSetColor(float r, float g, float b, float a)
+{
+    batchColor[0] = (GLubyte)(r * 255.0f + 0.5f);
+    batchColor[1] = (GLubyte)(g * 255.0f + 0.5f);
+    batchColor[2] = (GLubyte)(b * 255.0f + 0.5f);
+    batchColor[3] = (GLubyte)(a * 255.0f + 0.5f);
+}
+
+void batchSetColorv(const float* rgba)
+{
+    batchSetColor(rgba[0], rgba[1], rgba[2], rgba[3]);
+}
+
+void batchPushMatrix(void)
+{
+    static BOOL logged = NO;
+    
+    // refuse the push, the matching pop is skipped so the levels below stay intact
+    if (batchTop == BATCH_STACK_SIZE - 1) {
+        if (logged == NO) {
+            NSLog(@"Transform stack overflow, more than %d pushes are ignored\n", BATCH_STACK_SIZE - 1);
+            logged = YES;
+        }
+        
+        batchOverflow++;
+        return;
+    }
+    
+    batchStack[batchTop + 1] = batchStack[batchTop];
+    batchTop++;
+}
+
+void batchPopMatrix(void)
+{
+    if (batchOverflow > 0) {
+        batchOverflow--;
+    } else if (batchTop > 0) {
+        batchTop--;
+    }
+}
+
+static Transform* batchCurrent(void)
+{
+    return &batchStack[batchTop];
+}
+
+void batchLoadIdentity(void)
+{
+    Transform* m = batchCurrent();
+    
+    m->a = 1.0f, m->b = 0.0f;
+    m->c = 0.0f, m->d = 1.0f;
+    m->x = 0.0f, m->y = 0.0f;
+}
+
+void batchLoadTransform(const Transform* m)
+{
+    *batchCurrent() = *m;
+}
+
+void batchMultTransform(const Transform* m)
+{
+    Transform* t = batchCurrent();
+    Transform r;
+    
+    r.a = t->a * m->a + t->c * m->b;
+    r.b = t->b * m->a + t->d * m->b;
+    r.c = t->a * m->c + t->c * m->d;
+    r.d = t->b * m->c + t->d * m->d;
+    r.x = t->a * m->x + t->c * m->y + t->x;
+    r.y = t->b * m->x + t->d * m->y + t->y;
+    
+    *t = r;
+}
+
+void batchTranslate(float x, float y)
+{
+    Transform* t = batchCurrent();
+    
+    t->x += t->a * x + t->c * y;
+    t->y += t->b * x + t->d * y;
+}
+
+void batchScale(float sx, float sy)
+{
+    Transform* t = batchCurrent();
+    
+    t->a *= sx, t->b *= sx;
+    t->c *= sy, t->d *= sy;
+}
+
+static BatchCommand* batchAddCommand(GLuint tex, BatchFrames* frames)
+{
+    BatchList* list = batchList;
+    BatchCommand* cmd;
+    uint64_t layer, depth, group;
+    
+    // out of sequence numbers to keep the order
+    if (batchSequence == 0xFFFF) {
+        batchFlush();
+    }
+    
+    list->commands = batchReserve(list->commands, &list->capacity, list->count, sizeof(BatchCommand));
+    
+    // ordered commands sort in the order they were submitted
+    if (batchOrdered) {
+        depth = batchSequence++;
+    } else {
+        depth = (uint64_t)(MAX(-32768, MIN(32767, batchDepth)) + 32768);
+    }
+    
+    layer = batchLayer & 0xFFFF;
+    group = frames ? frames->group : 0;
+    
+    cmd = &list->commands[list->count++];
+    cmd->tex = tex;
+    cmd->src = batchBlends[batchBlend][0];
+    cmd->dst = batchBlends[batchBlend][1];
+    cmd->frames = frames;
+    
+    // layer, depth, blend mode, frame table, then texture (only the low bits fit, runs end on the full name)
+    cmd->key = (layer << 48) | (depth << 32) | ((uint64_t)batchBlend << 24) | (group << 16) | (tex & 0xFFFF);
+    
+    return cmd;
+}
+
+void batchTransformedQuad(GLuint tex, const Quad* quad, const Transform* t)
+{
+    BatchCommand* cmd = batchAddCommand(tex, NULL);
+    
+    // transform the corners on the CPU
+    for(int i = 0;i < 4;i++) {
+        const Vert* src = &quad->v[i];
+        
+        cmd->v[i].x = t->a * src->x + t->c * src->y + t->x;
+        cmd->v[i].y = t->b * src->x + t->d * src->y + t->y;
+        cmd->v[i].u = src->u;
+        cmd->v[i].v = src->v;
+        
+        // tint
+        memcpy(cmd->v[i].rgba, batchColor, sizeof(batchColor));
+    }
+    
+    batchFill(batchQuadArea(quad), t);
+}
+
+void batchQuad(GLuint tex, const Quad* quad)
+{
+    batchTransformedQuad(tex, quad, batchCurrent());
+}
+
+void batchSprite(GLuint tex, BatchFrames* frames, unsigned int frame, const Quad* quad)
+{
+    const Transform* t = batchCurrent();
+    BatchCommand* cmd;
+    
+    // untextured or fixed-function
+    if (frames == NULL || tex == 0) {
+        batchTransformedQuad(tex, quad, t);
+        return;
+    }
+    
+    cmd = batchAddCommand(tex, frames);
+    
+    // the corners are placed by the shader
+    cmd->instance.a = t->a;
+    cmd->instance.b = t->b;
+    cmd->instance.c = t->c;
+    cmd->instance.d = t->d;
+    cmd->instance.x = t->x;
+    cmd->instance.y = t->y;
+    cmd->instance.frame = frame;
+    
+    memcpy(cmd->instance.rgba, batchColor, sizeof(batchColor));
+    
+    batchFill(batchQuadArea(quad), t);
+}
+
+void batchMesh(GLuint tex, BatchMesh* mesh)
+{
+    BatchOp* op;
+    
+    // draws between the quads before and after it
+    batchFlush();
+    
+    op = batchAddOp(BATCH_OP_MESH);
+    op->mesh.mesh = mesh;
+    op->mesh.layer = batchLayer;
+    op->mesh.tex = tex;
+    op->mesh.src = batchBlends[batchBlend][0];
+    op->mesh.dst = batchBlends[batchBlend][1];
+    
+    memcpy(op->mesh.rgba, batchColor, sizeof(batchColor));
+    
+    batchMatrix(batchCurrent(), op->mesh.transform);
+    batchFill(mesh->area, batchCurrent());
+}
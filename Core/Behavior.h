@@ -10,12 +10,16 @@
 @interface Behavior : BaseComponent <ComponentInterface>
 {
     Script* m_script;
+    
+    // file the script was loaded from, kept when the behavior is pooled
+    NSString* m_scriptFile;
 }
 
 // accessors
 - (Script*)script;
 
 // frame phases
+- (void)reset;
 - (void)start;
 - (void)advance;
 - (void)update;
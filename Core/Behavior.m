@@ -7,6 +7,14 @@
 #import "Behavior.h"
 #import "Engine.h"
 
+// script function called for each frame stage, behaviors don't render
+static const char* behaviorHooks[COMPONENT_PHASES] = {
+    "advance",
+    NULL,
+    "update",
+    "ui",
+};
+
 @implementation Behavior
 
 - (id)init
@@ -17,6 +25,7 @@
     
     // initialize members
     m_script = nil;
+    m_scriptFile = nil;
     
     return self;
 }
@@ -24,15 +33,14 @@
 - (void)dealloc
 {
     [m_script release];
+    [m_scriptFile release];
     [super dealloc];
 }
 
 + (NSArray*)properties
 {
     return [[NSArray arrayWithObjects:
-             prop_WIRE(@"name", @selector(setName:)),
              prop_WIRE(@"script", @selector(setScript:)),
-             prop_WIRE(@"enabled", @selector(setEnabled:)),
              nil]
             arrayByAddingObjectsFromArray:[super properties]];
 }
@@ -41,11 +49,18 @@
 {
     Script* script;
     
-    // free the current script if it exists
-    if (m_script != nil) {
-        [m_script release];
+    // a pooled behavior keeps its script and environment
+    if (m_script != nil && [value isEqualToString:m_scriptFile]) {
+        return;
     }
     
+    // free the current script if it exists
+    [m_script release];
+    [m_scriptFile release];
+    
+    m_script = nil;
+    m_scriptFile = nil;
+    
     // create the script
     if ((script = [[[m_actor script] newThread] autorelease]) == nil) {
         return;
@@ -58,6 +73,7 @@
     
     // save it
     m_script = [script retain];
+    m_scriptFile = [value retain];
 }
 
 - (Script*)script
@@ -65,9 +81,28 @@
     return [[m_script retain] autorelease];
 }
 
+- (BOOL)handlesPhase:(ComponentPhase)phase
+{
+    const char* hook = behaviorHooks[phase];
+    
+    // only subscribe to the stages the script has a function for
+    return hook != NULL && [m_script hasFunction:hook];
+}
+
+- (void)reset
+{
+    [m_script call:"reset"];
+    
+    // reset() may have defined or removed stage functions
+    [m_store invalidate:self];
+}
+
 - (void)start
 {
     [m_script call:"start"];
+    
+    // so may start(), check again before the next stage
+    [m_store invalidate:self];
 }
 
 - (void)advance
@@ -24,6 +24,9 @@
 - (float)right;
 - (float)top;
 
+// world space rectangle containing everything the projection can see
+- (NSRect)visibleRect;
+
 // transform accessors
 - (float)x;
 - (float)y;
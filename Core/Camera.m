@@ -4,6 +4,7 @@
 // All rights reserved.
 //
 
+#import "Batch.h"
 #import "Camera.h"
 #import "Engine.h"
 
@@ -104,6 +105,34 @@ typedef struct {
     return [self projection]->top;
 }
 
+- (NSRect)visibleRect
+{
+    Projection* proj = [self projection];
+    
+    // undo the camera rotation and zoom
+    float c = cosf(-proj->angle * 3.141592f / 180.0f) / proj->z;
+    float s = sinf(-proj->angle * 3.141592f / 180.0f) / proj->z;
+    
+    // corners of the view in the space before the camera transform
+    float xs[2] = { proj->left + proj->x, proj->right + proj->x };
+    float ys[2] = { proj->bottom + proj->y, proj->top + proj->y };
+    
+    float x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+    
+    // bounding box of the corners in world space
+    for(int i = 0;i < 4;i++) {
+        float vx = xs[i & 1];
+        float vy = ys[i >> 1];
+        float wx = vx * c - vy * s;
+        float wy = vx * s + vy * c;
+        
+        x0 = MIN(x0, wx), x1 = MAX(x1, wx);
+        y0 = MIN(y0, wy), y1 = MAX(y1, wy);
+    }
+    
+    return NSMakeRect(x0, y0, x1 - x0, y1 - y0);
+}
+
 - (float)x
 {
     return [self projection]->x;
@@ -126,27 +155,18 @@ typedef struct {
 
 - (void)loadProjectionMatrix
 {
-    Projection* proj;
-    GLint mode;
-    
-    // fetch the current mode
-    glGetIntegerv(GL_MATRIX_MODE, &mode);
-    
-    // switch to projection mode
-    glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
+    Projection* proj = [self projection];
+    float r = proj->angle * M_PI / 180.0f;
     
-    // get the top-most projection
-    proj = [self projection];
+    // translate, then rotate, then zoom
+    Transform view = {
+         cosf(r) * proj->z, sinf(r) * proj->z,
+        -sinf(r) * proj->z, cosf(r) * proj->z,
+        -proj->x, -proj->y,
+    };
     
     // setup the orthographic projection using the world space bounds
-    glOrtho(proj->left, proj->right, proj->bottom, proj->top, 0.0f, 1.0f);
-    glTranslatef(-proj->x, -proj->y, 0.0f);
-    glRotatef(proj->angle, 0.0f, 0.0f, 1.0f);
-    glScalef(proj->z, proj->z, 1.0f);
-    
-    // switch back to the previous mode
-	glMatrixMode(mode);
+    batchSetProjection(proj->left, proj->right, proj->bottom, proj->top, &view);
 }
 
 - (void)applyScaleMatrix
@@ -158,7 +178,7 @@ typedef struct {
     float sy = (proj->top - proj->bottom) / proj->height;
     
     // ensure that textures render pixel-perfect
-    glScalef(sx, sy, 1.0f);
+    batchScale(sx, sy);
 }
 
 - (void)pushDefaultProjection:(NSSize)size
@@ -24,9 +24,9 @@
 + (NSArray*)properties
 {
     return [[NSArray arrayWithObjects:
-             prop_WIRE(@"radius", @selector(setRadius:)),
-             prop_WIRE(@"x", @selector(setX:)), 
-             prop_WIRE(@"y", @selector(setY:)), 
+             prop_VALUE(@"radius", "m_radius", float, propertyParseFloat),
+             prop_FIELD(@"x", "m_offset", cpVect, x, propertyParseReal(cpFloat)),
+             prop_FIELD(@"y", "m_offset", cpVect, y, propertyParseReal(cpFloat)),
              nil]
             arrayByAddingObjectsFromArray:[super properties]];
 }
@@ -46,21 +46,6 @@
     return m_offset.y;
 }
 
-- (void)setRadius:(NSString*)value
-{
-    m_radius = [value floatValue];
-}
-
-- (void)setXOffset:(NSString*)value
-{
-    m_offset.x = [value floatValue];
-}
-
-- (void)setYOffset:(NSString*)value
-{
-    m_offset.y = [value floatValue];
-}
-
 - (cpShape*)createShape
 {
     return cpCircleShapeNew([m_actor body], m_radius, m_offset);
@@ -15,9 +15,19 @@
     // current frame counter
     unsigned int m_frame;
 	
-	// seconds since the last advance and average fps
-	float m_deltaTime;
+	// real seconds since the last frame and average fps
+	float m_frameTime;
 	float m_fps;
+    
+    // fixed simulation timestep and unsimulated time
+    float m_step;
+    float m_accumulator;
+    
+    // most simulation ticks allowed to run in a single frame
+    unsigned int m_maxTicks;
+    
+    // number of ticks run so far this frame
+    unsigned int m_ticks;
 	
 	// true if locking the framerate (useful in debugging)
 	BOOL m_lockFps;
@@ -26,15 +36,28 @@
 // initialization methods
 - (id)init;
 
-// set to true in order to hard lock the framerate to 60 FPS
+// set the fixed simulation timestep and catch-up limit
+- (void)setTimestep:(float)step maxTicks:(unsigned int)n;
+
+// set to true in order to hard lock one simulation tick per frame
 - (void)lockFPS:(BOOL)flag;
 
-// called once per frame to advance the framecount and delta time
+// called once per frame to advance the framecount and accumulate time
 - (void)advance;
 
+// consumes one fixed timestep, returns NO when caught up
+- (BOOL)tick;
+
 // member accessors
 - (float)time;
 - (float)deltaTime;
+- (float)frameTime;
 - (float)fps;
 
+// number of simulation ticks run this frame
+- (unsigned int)ticks;
+
+// fraction of a timestep left over, used to interpolate rendering
+- (float)alpha;
+
 @end
@@ -18,8 +18,12 @@
     m_firstFrameTime = [[NSDate date] retain];
 	m_lastFrameTime = nil;
     m_frame = 0;
-	m_deltaTime = 0.0f;
+	m_frameTime = 0.0f;
 	m_fps = 0.0f;
+    m_step = 1 / 60.0f;
+    m_accumulator = 0.0f;
+    m_maxTicks = 5;
+    m_ticks = 0;
 	m_lockFps = NO;
 	
 	return self;
@@ -39,11 +43,18 @@
     return [NSArray arrayWithObjects:
             script_Method(@"time", @selector(l_time:)),
             script_Method(@"delta_time", @selector(l_deltaTime:)),
+            script_Method(@"frame_time", @selector(l_frameTime:)),
             script_Method(@"frame", @selector(l_frame:)),
             script_Method(@"fps", @selector(l_fps:)),
             nil];
 }
 
+- (void)setTimestep:(float)step maxTicks:(unsigned int)n
+{
+    m_step = step;
+    m_maxTicks = n > 0 ? n : 1;
+}
+
 - (void)lockFPS:(BOOL)flag
 {
     m_lockFps = flag;
@@ -57,9 +68,9 @@
 		m_lastFrameTime = [[NSDate date] retain];
 	}
 	
-	// calculate the timestep since the last simulation frame
-	m_deltaTime = [now timeIntervalSinceDate:m_lastFrameTime];
-	m_fps = 1.0f / m_deltaTime;
+	// calculate the real time since the last rendered frame
+	m_frameTime = [now timeIntervalSinceDate:m_lastFrameTime];
+	m_fps = 1.0f / m_frameTime;
 	
 	// release the last time
 	[m_lastFrameTime release];
@@ -67,6 +78,34 @@
 	// keep this one and advance the frame counter
 	m_lastFrameTime = [now retain];
     m_frame++;
+    
+    // accumulate time that needs to be simulated
+    if (m_lockFps) {
+        m_accumulator = m_step;
+    } else {
+        m_accumulator += m_frameTime;
+    }
+    
+    // after a hitch, drop whatever time can't be caught up this frame
+    if (m_accumulator > m_step * m_maxTicks) {
+        m_accumulator = m_step * m_maxTicks;
+    }
+    
+    // no simulation has happened yet this frame
+    m_ticks = 0;
+}
+
+- (BOOL)tick
+{
+    if (m_accumulator < m_step) {
+        return NO;
+    }
+    
+    // consume a single timestep
+    m_accumulator -= m_step;
+    m_ticks++;
+    
+    return YES;
 }
 
 - (float)time
@@ -76,12 +115,27 @@
 
 - (float)deltaTime
 {
-	return m_lockFps ? 1 / 60.0f : m_deltaTime;
+	return m_step;
+}
+
+- (float)frameTime
+{
+    return m_lockFps ? m_step : m_frameTime;
 }
 
 - (float)fps
 {
-	return m_lockFps ? 60.0f : m_fps;
+	return m_lockFps ? 1.0f / m_step : m_fps;
+}
+
+- (unsigned int)ticks
+{
+    return m_ticks;
+}
+
+- (float)alpha
+{
+    return m_accumulator / m_step;
 }
 
 /*
@@ -95,7 +149,12 @@
 
 - (int)l_deltaTime:(lua_State*)L
 {
-    return lua_pushnumber(L, m_deltaTime), 1;
+    return lua_pushnumber(L, [self deltaTime]), 1;
+}
+
+- (int)l_frameTime:(lua_State*)L
+{
+    return lua_pushnumber(L, [self frameTime]), 1;
 }
 
 - (int)l_frame:(lua_State*)L
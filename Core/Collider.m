@@ -31,11 +31,36 @@
     [super dealloc];
 }
 
+- (void)reset
+{
+    // out of the world since the actor left, start creates a new one
+    if (m_shape) {
+        cpShapeFree(m_shape);
+        m_shape = NULL;
+    }
+}
+
 - (cpShape*)shape
 {
     return m_shape;
 }
 
+- (BOOL)bounds:(NSRect*)rect
+{
+    cpBB bb;
+    
+    if (m_shape == NULL) {
+        return NO;
+    }
+    
+    // update the shape's cached bounding box to the body
+    bb = cpShapeCacheBB(m_shape);
+    
+    *rect = NSMakeRect(bb.l, bb.b, bb.r - bb.l, bb.t - bb.b);
+    
+    return YES;
+}
+
 - (cpShape*)createShape
 {
     return NULL;
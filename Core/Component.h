@@ -6,10 +6,76 @@
 
 #import "Actor.h"
 
+@class BaseComponent;
+@class ComponentStore;
+
+// frame stages a component can be subscribed to
+typedef enum {
+    COMPONENT_ADVANCE,
+    COMPONENT_RENDER,
+    COMPONENT_UPDATE,
+    COMPONENT_GUI,
+    COMPONENT_PHASES,
+} ComponentPhase;
+
+// slot of a component that isn't subscribed to a stage
+#define COMPONENT_UNSUBSCRIBED UINT_MAX
+
+// where a component is packed in its layer's component store
+typedef struct {
+    unsigned int type;
+    unsigned int slots[COMPONENT_PHASES];
+} ComponentHandle;
+
+// how a prefab property gets into a component
+typedef enum {
+    PROP_SETTER,    // the string is passed to a setter, for values with side effects
+    PROP_VALUE,     // parsed once when the prefab loads and copied into a member
+    PROP_ASSET,     // looked up by name once and copied into a member
+    PROP_FRAME,     // frame number in the component's atlas, looked up once
+    PROP_ANIM,      // animation in the component's atlas, looked up once
+} PropertyKind;
+
+// parses a prefab value into the bytes of the member it's copied to
+typedef void (*PropertyParser)(NSString* value, void* member);
+
+// parsers for the member types components use
+void propertyParseFloat(NSString* value, void* member);
+void propertyParseDouble(NSString* value, void* member);
+void propertyParseInt(NSString* value, void* member);
+void propertyParseBool(NSString* value, void* member);
+void propertyParseColor(NSString* value, void* member);
+
+// parser for a floating point type that is either a float or a double
+#define propertyParseReal(type) (sizeof(type) == sizeof(double) ? propertyParseDouble : propertyParseFloat)
+
 // property object used to set component values
 @interface Property : NSObject
 @property (readwrite,assign) NSString* value;
 @property (readwrite,assign) SEL sel;
+@property (readwrite,assign) PropertyKind kind;
+@property (readwrite,assign) ptrdiff_t offset;
+@property (readwrite,assign) size_t size;
+@property (readwrite,assign) PropertyParser parser;
+@property (readwrite,assign) Class assetClass;
+@end
+
+// the properties of one prefab component, parsed once and copied into every instance
+@interface PropertyValues : NSObject
+{
+    struct PropertyValue* m_values;
+    unsigned int m_count;
+    
+    // assets, frames and anims have been looked up
+    BOOL m_resolved;
+}
+
+// parse a value for a wired property
+- (void)addProperty:(Property*)prop value:(NSString*)value;
+
+// copy all the values into a component
+- (void)applyTo:(BaseComponent*)component;
+
 @end
 
 @interface BaseComponent : NSObject
@@ -21,6 +87,10 @@
     
     // true if the component is active
     BOOL m_enabled;
+    
+    // set by the component store when the actor is added to a layer
+    ComponentStore* m_store;
+    ComponentHandle m_handle;
 }
 
 // returns the component subclass for a given string
@@ -29,13 +99,40 @@
 // create a wired property
 + (Property*)wireProperty:(NSString*)value to:(SEL)sel;
 
+// create a property copied into an instance variable, the size must match its type
++ (Property*)wireProperty:(NSString*)name ivar:(const char*)ivar size:(size_t)size parser:(PropertyParser)parser;
+
+// create a property copied into a field of an instance variable, it must fit inside it
++ (Property*)wireProperty:(NSString*)name ivar:(const char*)ivar field:(size_t)offset size:(size_t)size parser:(PropertyParser)parser;
+
+// create a property looked up by name and copied into an instance variable
++ (Property*)wireProperty:(NSString*)name ivar:(const char*)ivar kind:(PropertyKind)kind asset:(Class)cls;
+
 // initialization methods
-- (id)initWithActor:(Actor*)actor properties:(NSArray*)props;
+- (id)initWithActor:(Actor*)actor properties:(PropertyValues*)props;
+
+// reuse a pooled component, enabling it, resetting it and wiring the properties again
+- (void)resetWithProperties:(PropertyValues*)props;
+
+// called once all the prefab properties are wired in
+- (void)didWireProperties;
+
+// drop whatever state the last actor using the component left behind
+- (void)reset;
 
 // accessors
 - (NSString*)name;
 - (Actor*)actor;
 
+// store and location in it, set while the actor is in a layer
+- (ComponentStore*)store;
+- (ComponentHandle)handle;
+- (void)setStore:(ComponentStore*)store handle:(ComponentHandle)handle;
+- (void)setHandle:(ComponentHandle)handle;
+
+// NO if an instance doesn't need a stage its class implements
+- (BOOL)handlesPhase:(ComponentPhase)phase;
+
 // wiring for prefab component properties
 + (NSArray*)properties;
 
@@ -49,6 +146,9 @@
 // true if this behavior should run
 - (BOOL)isEnabled;
 
+// world space bounds of what the component renders, NO if it has none
+- (BOOL)bounds:(NSRect*)rect;
+
 // frame stages
 - (void)start;
 - (void)advance;
@@ -67,4 +167,11 @@
 #define component_CLASS(cls) [NSValue valueWithPointer:[cls class]]
 
 // helper macro to create property wirings
-#define prop_WIRE(value,sel) [BaseComponent wireProperty:value to:sel]
\ No newline at end of file
+#define prop_WIRE(value,sel) [BaseComponent wireProperty:value to:sel]
+
+// helper macros to create typed properties, only usable in +properties
+#define prop_VALUE(name,ivar,type,parser) [self wireProperty:name ivar:ivar size:sizeof(type) parser:parser]
+#define prop_FIELD(name,ivar,type,field,parser) [self wireProperty:name ivar:ivar field:offsetof(type, field) size:sizeof(((type*)0)->field) parser:parser]
+#define prop_ASSET(name,ivar,cls) [self wireProperty:name ivar:ivar kind:PROP_ASSET asset:[cls class]]
+#define prop_FRAME(name,ivar) [self wireProperty:name ivar:ivar kind:PROP_FRAME asset:Nil]
+#define prop_ANIM(name,ivar) [self wireProperty:name ivar:ivar kind:PROP_ANIM asset:Nil]
\ No newline at end of file
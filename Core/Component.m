@@ -4,17 +4,83 @@
 // All rights reserved.
 //
 
+#import <objc/runtime.h>
+
+#import "Atlas.h"
 #import "Behavior.h"
 #import "CircleCollider.h"
 #import "Component.h"
+#import "ComponentStore.h"
 #import "Emitter.h"
+#import "Engine.h"
 #import "RigidBody.h"
+#import "Scanners.h"
 #import "SegmentCollider.h"
 #import "Sprite.h"
+#import "Tilemap.h"
+
+// largest member a parsed value is copied into (a color)
+#define PROPERTY_VALUE_SIZE 16
+
+// a parsed property value, or the name to look up the first time it's used
+struct PropertyValue {
+    PropertyKind kind;
+    
+    // setters are passed the original string
+    SEL sel;
+    NSString* string;
+    
+    // where the value is copied to
+    ptrdiff_t offset;
+    size_t size;
+    
+    // class of asset properties, and the asset once found (retained)
+    Class assetClass;
+    id asset;
+    
+    // the bytes copied into the component
+    uint8_t bytes[PROPERTY_VALUE_SIZE];
+};
+
+void propertyParseFloat(NSString* value, void* member)
+{
+    *(float*)member = [value floatValue];
+}
+
+void propertyParseDouble(NSString* value, void* member)
+{
+    *(double*)member = [value doubleValue];
+}
+
+void propertyParseInt(NSString* value, void* member)
+{
+    *(int*)member = [value intValue];
+}
+
+void propertyParseBool(NSString* value, void* member)
+{
+    *(BOOL*)member = [value boolValue];
+}
+
+void propertyParseColor(NSString* value, void* member)
+{
+    NSColor* color = [value colorValue];
+    float* rgba = member;
+    
+    rgba[0] = [color redComponent];
+    rgba[1] = [color greenComponent];
+    rgba[2] = [color blueComponent];
+    rgba[3] = [color alphaComponent];
+}
 
 @implementation Property
 @synthesize value;
 @synthesize sel;
+@synthesize kind;
+@synthesize offset;
+@synthesize size;
+@synthesize parser;
+@synthesize assetClass;
 
 - (void)dealloc
 {
@@ -23,6 +89,131 @@
 }
 @end
 
+@implementation PropertyValues
+
+- (id)init
+{
+    if ((self = [super init]) == nil) {
+        return nil;
+    }
+    
+    // initialize members
+    m_values = NULL;
+    m_count = 0;
+    m_resolved = YES;
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    for(unsigned int i = 0;i < m_count;i++) {
+        [m_values[i].string release];
+        [m_values[i].asset release];
+    }
+    
+    free(m_values);
+    
+    [super dealloc];
+}
+
+- (void)addProperty:(Property*)prop value:(NSString*)value
+{
+    struct PropertyValue* v;
+    
+    m_values = realloc(m_values, (m_count + 1) * sizeof(struct PropertyValue));
+    
+    v = &m_values[m_count++];
+    memset(v, 0, sizeof(struct PropertyValue));
+    
+    v->kind = prop.kind;
+    v->sel = prop.sel;
+    v->offset = prop.offset;
+    v->size = prop.size;
+    v->assetClass = prop.assetClass;
+    
+    switch (prop.kind) {
+        case PROP_VALUE:
+            prop.parser(value, v->bytes);
+            break;
+        case PROP_SETTER:
+            v->string = [value retain];
+            break;
+        default:
+            v->string = [value retain];
+            
+            // asset references wait until the first instance, assets load later
+            m_resolved = NO;
+            break;
+    }
+}
+
+- (void)resolve
+{
+    Atlas* atlas = nil;
+    BOOL found = YES;
+    
+    // assets first, frames and anims are looked up in the atlas
+    for(unsigned int i = 0;i < m_count;i++) {
+        struct PropertyValue* v = &m_values[i];
+        
+        if (v->kind != PROP_ASSET) {
+            continue;
+        }
+        
+        [v->asset release];
+        
+        // held on to so the copied pointer stays valid
+        if ((v->asset = [[theProject assetWithName:v->string type:v->assetClass] retain]) == nil) {
+            found = NO;
+        }
+        
+        if ([v->asset isKindOfClass:[Atlas class]]) {
+            atlas = v->asset;
+        }
+        
+        memcpy(v->bytes, &v->asset, sizeof(id));
+    }
+    
+    for(unsigned int i = 0;i < m_count;i++) {
+        struct PropertyValue* v = &m_values[i];
+        
+        if (v->kind == PROP_FRAME) {
+            unsigned long frame = atlas ? [atlas frameNamed:v->string] : -1UL;
+            
+            memcpy(v->bytes, &frame, sizeof(frame));
+        } else if (v->kind == PROP_ANIM) {
+            const AnimSeq* anim = [atlas animNamed:v->string];
+            
+            memcpy(v->bytes, &anim, sizeof(anim));
+        }
+    }
+    
+    // try again next time if an asset isn't loaded yet
+    m_resolved = found;
+}
+
+- (void)applyTo:(BaseComponent*)component
+{
+    if (m_resolved == NO) {
+        [self resolve];
+    }
+    
+    for(unsigned int i = 0;i < m_count;i++) {
+        struct PropertyValue* v = &m_values[i];
+        
+        if (v->kind == PROP_SETTER) {
+            [component performSelector:v->sel withObject:v->string];
+        } else {
+            memcpy((uint8_t*)component + v->offset, v->bytes, v->size);
+        }
+    }
+    
+    [component didWireProperties];
+}
+
+@end
+
 @implementation BaseComponent
 
 + (Class)componentInterfaceForName:(NSString*)name
@@ -33,6 +224,7 @@
                              component_CLASS(RigidBody), @"rigidbody",
                              component_CLASS(SegmentCollider), @"segmentcollider",
                              component_CLASS(Sprite), @"sprite",
+                             component_CLASS(Tilemap), @"tilemap",
                              component_CLASS(Behavior), @"behavior",
                              nil];
     
@@ -40,7 +232,7 @@
     return [[classes objectForKey:[name lowercaseString]] pointerValue];
 }
 
-- (id)initWithActor:(Actor*)actor properties:(NSArray*)props
+- (id)initWithActor:(Actor*)actor properties:(PropertyValues*)props
 {
     if ((self = [self init]) == nil) {
         return nil;
@@ -49,16 +241,32 @@
     // initialize members
     m_actor = actor;
     m_enabled = YES;
+    m_store = nil;
     
     // wire in all the property values
-    for(Property* prop in props) {
-        [self performSelector:prop.sel
-                   withObject:prop.value];
-    }
+    [props applyTo:self];
     
     return self;
 }
 
+- (void)resetWithProperties:(PropertyValues*)props
+{
+    m_enabled = YES;
+    
+    [self reset];
+    
+    // prefab values, anything else set by scripts is kept
+    [props applyTo:self];
+}
+
+- (void)reset
+{
+}
+
+- (void)didWireProperties
+{
+}
+
 - (void)dealloc
 {
     [m_name release];
@@ -72,6 +280,78 @@
     // initialize the property
     prop.value = [value retain];
     prop.sel = sel;
+    prop.kind = PROP_SETTER;
+    
+    return [prop autorelease];
+}
+
++ (Ivar)wiredIvar:(const char*)ivar forProperty:(NSString*)name offset:(size_t)offset size:(size_t)size whole:(BOOL)whole
+{
+    Ivar member = class_getInstanceVariable(self, ivar);
+    NSUInteger ivarSize = 0;
+    
+    // values are copied straight into the object, so a bad wiring would overwrite other members
+    if (member == NULL) {
+        [NSException raise:NSInvalidArgumentException format:@"No instance variable %s in %@", ivar, self];
+    }
+    
+    NSGetSizeAndAlignment(ivar_getTypeEncoding(member), &ivarSize, NULL);
+    
+    // a whole ivar has to match exactly, a field has to fit inside it
+    if (offset + size > ivarSize || (whole && size != ivarSize)) {
+        [NSException raise:NSInvalidArgumentException
+                    format:@"Property %@ doesn't match the type of %s in %@", name, ivar, self];
+    }
+    
+    return member;
+}
+
++ (Property*)wireProperty:(NSString*)name ivar:(const char*)ivar offset:(size_t)offset size:(size_t)size parser:(PropertyParser)parser whole:(BOOL)whole
+{
+    Ivar member = [self wiredIvar:ivar forProperty:name offset:offset size:size whole:whole];
+    Property* prop = [[Property alloc] init];
+    
+    if (size > PROPERTY_VALUE_SIZE) {
+        [NSException raise:NSInvalidArgumentException format:@"Property %@ is too large", name];
+    }
+    
+    // initialize the property
+    prop.value = [name retain];
+    prop.kind = PROP_VALUE;
+    prop.offset = ivar_getOffset(member) + offset;
+    prop.size = size;
+    prop.parser = parser;
+    
+    return [prop autorelease];
+}
+
++ (Property*)wireProperty:(NSString*)name ivar:(const char*)ivar size:(size_t)size parser:(PropertyParser)parser
+{
+    return [self wireProperty:name ivar:ivar offset:0 size:size parser:parser whole:YES];
+}
+
++ (Property*)wireProperty:(NSString*)name ivar:(const char*)ivar field:(size_t)offset size:(size_t)size parser:(PropertyParser)parser
+{
+    return [self wireProperty:name ivar:ivar offset:offset size:size parser:parser whole:NO];
+}
+
++ (Property*)wireProperty:(NSString*)name ivar:(const char*)ivar kind:(PropertyKind)kind asset:(Class)cls
+{
+    size_t size = (kind == PROP_FRAME) ? sizeof(unsigned long) : sizeof(void*);
+    Ivar member = [self wiredIvar:ivar forProperty:name offset:0 size:size whole:YES];
+    Property* prop = [[Property alloc] init];
+    
+    // assets are retained, so they can only go into object members
+    if (kind == PROP_ASSET && ivar_getTypeEncoding(member)[0] != '@') {
+        [NSException raise:NSInvalidArgumentException format:@"Property %@ needs an object for %s in %@", name, ivar, self];
+    }
+    
+    // initialize the property, assets and anims are pointers, frames are numbers
+    prop.value = [name retain];
+    prop.kind = kind;
+    prop.offset = ivar_getOffset(member);
+    prop.size = size;
+    prop.assetClass = cls;
     
     return [prop autorelease];
 }
@@ -86,11 +366,37 @@
     return [[m_actor retain] autorelease];
 }
 
+- (ComponentStore*)store
+{
+    return m_store;
+}
+
+- (ComponentHandle)handle
+{
+    return m_handle;
+}
+
+- (void)setStore:(ComponentStore*)store handle:(ComponentHandle)handle
+{
+    m_store = store;
+    m_handle = handle;
+}
+
+- (void)setHandle:(ComponentHandle)handle
+{
+    m_handle = handle;
+}
+
+- (BOOL)handlesPhase:(ComponentPhase)phase
+{
+    return YES;
+}
+
 + (NSArray*)properties
 {
     return [NSArray arrayWithObjects:
             prop_WIRE(@"name", @selector(setName:)),
-            prop_WIRE(@"enabled", @selector(setEnabled:)),
+            prop_VALUE(@"enabled", "m_enabled", BOOL, propertyParseBool),
             nil];
 }
 
@@ -106,22 +412,26 @@
 
 - (void)setName:(NSString*)value
 {
+    [m_name release];
+    
+    // set again when a pooled component is reset
     m_name = [value retain];
 }
 
-- (void)setEnabled:(NSString*)value
-{
-    m_enabled = [value boolValue];
-}
-
 - (void)enable
 {
     m_enabled = YES;
+    
+    // subscribe to the frame stages again
+    [m_store invalidate:self];
 }
 
 - (void)disable
 {
     m_enabled = NO;
+    
+    // unsubscribe from the frame stages
+    [m_store invalidate:self];
 }
 
 - (BOOL)isEnabled
@@ -129,6 +439,11 @@
     return m_enabled;
 }
 
+- (BOOL)bounds:(NSRect*)rect
+{
+    return NO;
+}
+
 - (void)start
 {
     // subclass responsibility
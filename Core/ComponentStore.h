@@ -0,0 +1,59 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import "Actor.h"
+#import "Component.h"
+
+// packed subscribers to one frame stage, with the actors they belong to
+typedef struct {
+    BaseComponent** components;
+    Actor** actors;
+    
+    unsigned int count;
+    unsigned int capacity;
+} ComponentList;
+
+// every component of one class in a layer
+typedef struct {
+    Class cls;
+    
+    // class name used for profiling scopes
+    const char* name;
+    
+    // stage implementations, NULL where the class doesn't override BaseComponent
+    IMP phases[COMPONENT_PHASES];
+    
+    // enabled components subscribed to each stage, swapped with the last entry on removal
+    ComponentList lists[COMPONENT_PHASES];
+} ComponentArray;
+
+@interface ComponentStore : NSObject
+{
+    // one array per component class, in the order the classes were first added
+    ComponentArray* m_arrays;
+    unsigned int m_count;
+    
+    // components enabled or disabled since the last stage ran
+    NSMutableArray* m_pending;
+}
+
+// add or remove all the components of an actor
+- (void)addActor:(Actor*)actor;
+- (void)removeActor:(Actor*)actor;
+
+// subscribe or unsubscribe a component again before the next stage runs
+- (void)invalidate:(BaseComponent*)component;
+
+// number of components subscribed to a stage
+- (unsigned int)countForPhase:(ComponentPhase)phase;
+
+// frame stages, run one component class at a time
+- (void)advance;
+- (void)render;
+- (void)update;
+- (void)gui;
+
+@end
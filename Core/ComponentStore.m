@@ -0,0 +1,293 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import <objc/runtime.h>
+
+#import "Batch.h"
+#import "ComponentStore.h"
+#import "Profiler.h"
+
+// signature of the cached stage methods
+typedef void (*ComponentStage)(id, SEL);
+
+// selectors of each frame stage
+static SEL componentSelectors[COMPONENT_PHASES];
+
+static void componentSubscribe(ComponentList* list, BaseComponent* component, Actor* actor, unsigned int* slot)
+{
+    // grow both arrays together
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->components = realloc(list->components, list->capacity * sizeof(BaseComponent*));
+        list->actors = realloc(list->actors, list->capacity * sizeof(Actor*));
+    }
+    
+    *slot = list->count++;
+    
+    list->components[*slot] = component;
+    list->actors[*slot] = actor;
+}
+
+static void componentUnsubscribe(ComponentList* list, ComponentPhase phase, unsigned int slot)
+{
+    unsigned int last = --list->count;
+    
+    // move the last component into the hole and fix its handle
+    if (slot < last) {
+        BaseComponent* moved = list->components[last];
+        ComponentHandle handle = [moved handle];
+        
+        list->components[slot] = moved;
+        list->actors[slot] = list->actors[last];
+        
+        handle.slots[phase] = slot;
+        
+        [moved setHandle:handle];
+    }
+}
+
+@implementation ComponentStore
+
++ (void)initialize
+{
+    componentSelectors[COMPONENT_ADVANCE] = @selector(advance);
+    componentSelectors[COMPONENT_RENDER] = @selector(render);
+    componentSelectors[COMPONENT_UPDATE] = @selector(update);
+    componentSelectors[COMPONENT_GUI] = @selector(gui);
+}
+
+- (id)init
+{
+    if ((self = [super init]) == nil) {
+        return nil;
+    }
+    
+    // initialize members
+    m_arrays = NULL;
+    m_count = 0;
+    m_pending = [[NSMutableArray alloc] init];
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    for(unsigned int i = 0;i < m_count;i++) {
+        for(int p = 0;p < COMPONENT_PHASES;p++) {
+            free(m_arrays[i].lists[p].components);
+            free(m_arrays[i].lists[p].actors);
+        }
+    }
+    
+    free(m_arrays);
+    
+    [m_pending release];
+    [super dealloc];
+}
+
+- (unsigned int)typeOfClass:(Class)cls
+{
+    ComponentArray* array;
+    
+    // there are only ever a handful of component classes
+    for(unsigned int i = 0;i < m_count;i++) {
+        if (m_arrays[i].cls == cls) {
+            return i;
+        }
+    }
+    
+    m_arrays = realloc(m_arrays, (m_count + 1) * sizeof(ComponentArray));
+    
+    array = &m_arrays[m_count];
+    memset(array, 0, sizeof(ComponentArray));
+    
+    array->cls = cls;
+    array->name = class_getName(cls);
+    
+    // the base implementations do nothing, so they're never subscribed
+    for(int p = 0;p < COMPONENT_PHASES;p++) {
+        IMP imp = [cls instanceMethodForSelector:componentSelectors[p]];
+        
+        if (imp != [BaseComponent instanceMethodForSelector:componentSelectors[p]]) {
+            array->phases[p] = imp;
+        }
+    }
+    
+    return m_count++;
+}
+
+- (void)subscribe:(BaseComponent*)component
+{
+    ComponentHandle handle = [component handle];
+    ComponentArray* array = &m_arrays[handle.type];
+    BOOL enabled = [component isEnabled];
+    
+    for(int p = 0;p < COMPONENT_PHASES;p++) {
+        BOOL wanted = enabled && array->phases[p] != NULL && [component handlesPhase:p];
+        BOOL subscribed = handle.slots[p] != COMPONENT_UNSUBSCRIBED;
+        
+        if (wanted && subscribed == NO) {
+            componentSubscribe(&array->lists[p], component, [component actor], &handle.slots[p]);
+        } else if (wanted == NO && subscribed) {
+            componentUnsubscribe(&array->lists[p], p, handle.slots[p]);
+            
+            handle.slots[p] = COMPONENT_UNSUBSCRIBED;
+        }
+    }
+    
+    [component setHandle:handle];
+}
+
+- (void)unsubscribe:(BaseComponent*)component
+{
+    ComponentHandle handle = [component handle];
+    ComponentArray* array = &m_arrays[handle.type];
+    
+    for(int p = 0;p < COMPONENT_PHASES;p++) {
+        if (handle.slots[p] != COMPONENT_UNSUBSCRIBED) {
+            componentUnsubscribe(&array->lists[p], p, handle.slots[p]);
+        }
+    }
+}
+
+- (void)flush
+{
+    if ([m_pending count] == 0) {
+        return;
+    }
+    
+    // components removed since being invalidated don't belong to the store anymore
+    for(BaseComponent* component in m_pending) {
+        if ([component store] == self) {
+            [self subscribe:component];
+        }
+    }
+    
+    [m_pending removeAllObjects];
+}
+
+- (void)addActor:(Actor*)actor
+{
+    for(BaseComponent* component in [actor components]) {
+        ComponentHandle handle;
+        
+        handle.type = [self typeOfClass:[component class]];
+        
+        for(int p = 0;p < COMPONENT_PHASES;p++) {
+            handle.slots[p] = COMPONENT_UNSUBSCRIBED;
+        }
+        
+        [component setStore:self handle:handle];
+        
+        // only the stages it implements and will actually use
+        [self subscribe:component];
+    }
+}
+
+- (void)removeActor:(Actor*)actor
+{
+    for(BaseComponent* component in [actor components]) {
+        ComponentHandle handle = [component handle];
+        
+        [self unsubscribe:component];
+        
+        [component setStore:nil handle:handle];
+    }
+}
+
+- (void)invalidate:(BaseComponent*)component
+{
+    // the stage lists can't change while they're being run
+    [m_pending addObject:component];
+}
+
+- (unsigned int)countForPhase:(ComponentPhase)phase
+{
+    unsigned int count = 0;
+    
+    for(unsigned int i = 0;i < m_count;i++) {
+        count += m_arrays[i].lists[phase].count;
+    }
+    
+    return count;
+}
+
+- (void)run:(ComponentPhase)phase profile:(const char*)name
+{
+    SEL sel = componentSelectors[phase];
+    
+    [self flush];
+    
+    for(unsigned int i = 0;i < m_count;i++) {
+        ComponentList* list = &m_arrays[i].lists[phase];
+        ComponentStage stage = (ComponentStage)m_arrays[i].phases[phase];
+        
+        if (list->count == 0) {
+            continue;
+        }
+        
+        profile_BEGIN(name, m_arrays[i].name);
+        {
+            for(unsigned int j = 0;j < list->count;j++) {
+                stage(list->components[j], sel);
+            }
+        }
+        profile_END();
+    }
+}
+
+- (void)advance
+{
+    [self run:COMPONENT_ADVANCE profile:"advance"];
+}
+
+- (void)render
+{
+    [self flush];
+    
+    for(unsigned int i = 0;i < m_count;i++) {
+        ComponentList* list = &m_arrays[i].lists[COMPONENT_RENDER];
+        ComponentStage render = (ComponentStage)m_arrays[i].phases[COMPONENT_RENDER];
+        
+        if (list->count == 0) {
+            continue;
+        }
+        
+        profile_BEGIN("render", m_arrays[i].name);
+        {
+            for(unsigned int j = 0;j < list->count;j++) {
+                Actor* actor = list->actors[j];
+                
+                // the layer culled the actors before rendering
+                if ([actor isVisible] == NO || [actor isCulled]) {
+                    continue;
+                }
+                
+                batchPushMatrix();
+                {
+                    [actor applyTransform];
+                    
+                    // render in the actor's space
+                    render(list->components[j], @selector(render));
+                }
+                batchPopMatrix();
+            }
+        }
+        profile_END();
+    }
+}
+
+- (void)update
+{
+    [self run:COMPONENT_UPDATE profile:"update"];
+}
+
+- (void)gui
+{
+    [self run:COMPONENT_GUI profile:"gui"];
+}
+
+@end
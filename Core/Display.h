@@ -4,7 +4,9 @@
 // All rights reserved.
 //
 
+#import "Font.h"
 #import "Input.h"
+#import "Renderer.h"
 #import "Script.h"
 
 @interface Display : NSWindow <ScriptInterface>
@@ -12,6 +14,15 @@
     // input event handler
     Input* m_inputDelegate;
     
+    // draws recorded frames with the view's context
+    Renderer* m_renderer;
+    
+    // shares objects with the view, used to create and upload textures
+    NSOpenGLContext* m_loadContext;
+    
+    // font asset of the stats overlay, nil when hidden
+    NSString* m_statsFont;
+    
     // cached values
     NSSize m_size;
     
@@ -30,8 +41,24 @@
 // input delegate
 - (Input*)inputDelegate;
 
+// start drawing frames, on a render thread if threaded
+- (void)createRendererThreaded:(BOOL)threaded;
+
+// draw sprites as instances with the shader pipeline, NO if unsupported
+- (BOOL)enableShaders;
+
 // ready the viewport and cleanup
 - (void)prepare;
 - (void)present;
 
+// wait until everything presented has been drawn
+- (void)finishRendering;
+
+// render counters of the last frame drawn, in total and per layer of the scene
+- (NSDictionary*)stats;
+
+// show the stats overlay with a font, or hide it with nil
+- (void)setStatsFont:(NSString*)name;
+- (Font*)statsFont;
+
 @end
\ No newline at end of file
@@ -4,7 +4,43 @@
 // All rights reserved.
 //
 
+#import <OpenGL/OpenGL.h>
+#import "Batch.h"
 #import "Display.h"
+#import "Engine.h"
+#import "Layer.h"
+#import "Profiler.h"
+#import "Texture.h"
+
+// the view resizes its context from the main thread while the render thread may be drawing with it
+@interface DisplayView : NSOpenGLView
+@end
+
+@implementation DisplayView
+
+- (void)update
+{
+    CGLContextObj cgl = [[self openGLContext] CGLContextObj];
+    
+    CGLLockContext(cgl);
+    {
+        [super update];
+    }
+    CGLUnlockContext(cgl);
+}
+
+- (void)reshape
+{
+    CGLContextObj cgl = [[self openGLContext] CGLContextObj];
+    
+    CGLLockContext(cgl);
+    {
+        [super reshape];
+    }
+    CGLUnlockContext(cgl);
+}
+
+@end
 
 @implementation Display
 
@@ -18,7 +54,7 @@
     
     // initiaze the viewport
     if (self != nil) {
-        NSOpenGLView* view = [[NSOpenGLView alloc] initWithFrame:frame];
+        NSOpenGLView* view = [[DisplayView alloc] initWithFrame:frame];
         
         // setup the window
         [self setContentView:view];
@@ -27,6 +63,9 @@
         
         // initialize members
         m_inputDelegate = nil;
+        m_renderer = nil;
+        m_loadContext = nil;
+        m_statsFont = nil;
         m_size = frame.size;
         m_r = 0.0f;
         m_g = 0.0f;
@@ -39,6 +78,12 @@
 - (void)dealloc
 {
     [m_inputDelegate release];
+    
+    // the render thread retains the renderer until it exits
+    [m_renderer stop];
+    [m_renderer release];
+    [m_loadContext release];
+    [m_statsFont release];
     [super dealloc];
 }
 
@@ -46,6 +91,8 @@
 {
     return [NSArray arrayWithObjects:
             script_Method(@"set_background_color", @selector(l_setBackgroundColor:)),
+            script_Method(@"stats", @selector(l_stats:)),
+            script_Method(@"show_stats", @selector(l_showStats:)),
             nil];
 }
 
@@ -72,48 +119,70 @@
     return [[m_inputDelegate retain] autorelease];
 }
 
-- (void)prepare
+- (void)createRendererThreaded:(BOOL)threaded
 {
     NSOpenGLView* view = [self contentView];
     
-    // make the opengl context the active one
-    [[view openGLContext] makeCurrentContext];
-	
-	// setup the viewport that we're render to
-	glViewport(0, 0, m_size.width, m_size.height);
-	
-	// set default render state
-    glEnable(GL_TEXTURE_2D);
-	glEnable(GL_BLEND);
+    // textures are created on this thread, but drawn with the view's context
+    m_loadContext = [[NSOpenGLContext alloc] initWithFormat:[view pixelFormat]
+                                               shareContext:[view openGLContext]];
     
-    // set the default blending mode
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    m_renderer = [[Renderer alloc] initWithContext:[view openGLContext] threaded:threaded];
+}
+
+- (BOOL)enableShaders
+{
+    // the program is shared with the view's context
+    [m_loadContext makeCurrentContext];
     
-    // use vertex and texture coordinate buffers
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    return batchEnableShaders();
+}
+
+- (void)prepare
+{
+    GLfloat rgb[3] = { m_r, m_g, m_b };
     
-    // erase the display
-    glClearColor(m_r, m_g, m_b, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // make the loading context the active one
+    [m_loadContext makeCurrentContext];
     
-    // ready to begin rendering to the display
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    // start batching sprites
+    batchBegin();
     
-    // reset the render state
-    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+    // erase the display
+    batchClear(m_size.width, m_size.height, rgb);
 }
 
 - (void)present
 {
-    NSOpenGLView* view = [self contentView];
-    
-    // finish pending commands
+    // make textures uploaded this frame visible to the view's context
     glFlush();
     
-    // present the backbuffer
-    [[view openGLContext] flushBuffer];
+    profile_BEGIN("Render wait", NULL);
+    {
+        // draw the frame (waits for the previous one)
+        [m_renderer submit];
+    }
+    profile_END();
+    
+    // counters of the frame the renderer finished last
+    if (profileEnabled) {
+        BatchStats stats;
+        
+        batchGetStats(&stats);
+        
+        profileCounter("Draw calls", stats.total.drawCalls);
+        profileCounter("Texture binds", stats.total.textureBinds);
+        profileCounter("Blend changes", stats.total.blendChanges);
+        profileCounter("Vertices", stats.total.vertices);
+        profileCounter("State calls skipped", stats.total.stateSkipped);
+        profileCounter("Overdraw", stats.overdraw);
+        profileCounter("Texture bytes", [Texture residentBytes]);
+    }
+}
+
+- (void)finishRendering
+{
+    [m_renderer finish];
 }
 
 - (void)keyDown:(NSEvent*)event
@@ -163,6 +232,66 @@
  */
 
 
+- (NSDictionary*)stats
+{
+    NSMutableArray* layers = [NSMutableArray array];
+    unsigned int culled = 0;
+    float displayPixels;
+    BatchStats stats;
+    
+    batchGetStats(&stats);
+    
+    // per layer overdraw is measured against the whole display too
+    displayPixels = MAX(m_size.width * m_size.height, 1.0f);
+    
+    // layers of the scene, matched up with what the batch drew for them
+    for(Layer* layer in [theScene layers]) {
+        unsigned int index = MIN([layer batchLayer], BATCH_STATS_LAYERS - 1);
+        const BatchCounters* counters = &stats.layers[index];
+        
+        [layers addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                           [layer name], @"name",
+                           [NSNumber numberWithUnsignedInt:counters->drawCalls], @"draw_calls",
+                           [NSNumber numberWithUnsignedInt:counters->textureBinds], @"texture_binds",
+                           [NSNumber numberWithUnsignedInt:counters->blendChanges], @"blend_changes",
+                           [NSNumber numberWithUnsignedInt:counters->vertices], @"vertices",
+                           [NSNumber numberWithUnsignedInt:counters->stateSkipped], @"state_skipped",
+                           [NSNumber numberWithFloat:counters->pixels / displayPixels], @"overdraw",
+                           [NSNumber numberWithUnsignedInt:[layer culledActors]], @"culled_actors",
+                           nil]];
+        
+        culled += [layer culledActors];
+    }
+    
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithUnsignedInt:stats.total.drawCalls], @"draw_calls",
+            [NSNumber numberWithUnsignedInt:stats.total.textureBinds], @"texture_binds",
+            [NSNumber numberWithUnsignedInt:stats.total.blendChanges], @"blend_changes",
+            [NSNumber numberWithUnsignedInt:stats.total.vertices], @"vertices",
+            [NSNumber numberWithUnsignedInt:stats.total.stateSkipped], @"state_skipped",
+            [NSNumber numberWithFloat:stats.overdraw], @"overdraw",
+            [NSNumber numberWithUnsignedInt:culled], @"culled_actors",
+            [NSNumber numberWithUnsignedLong:[Texture residentBytes]], @"texture_bytes",
+            layers, @"layers",
+            nil];
+}
+
+- (void)setStatsFont:(NSString*)name
+{
+    [m_statsFont release];
+    m_statsFont = [name copy];
+}
+
+- (Font*)statsFont
+{
+    if (m_statsFont == nil) {
+        return nil;
+    }
+    
+    // looked up every frame, the font may be loaded later
+    return [theProject assetWithName:m_statsFont type:[Font class]];
+}
+
 - (int)l_setBackgroundColor:(lua_State*)L
 {
     m_r = lua_tonumber(L, 1);
@@ -172,4 +301,19 @@
     return 0;
 }
 
+- (int)l_stats:(lua_State*)L
+{
+    return [Script push:[self stats] to:L] ? 1 : (lua_pushnil(L), 1);
+}
+
+- (int)l_showStats:(lua_State*)L
+{
+    const char* name = lua_tostring(L, 1);
+    
+    // no font hides the overlay
+    [self setStatsFont:name ? [NSString stringWithUTF8String:name] : nil];
+    
+    return 0;
+}
+
 @end
\ No newline at end of file
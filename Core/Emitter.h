@@ -6,28 +6,7 @@
 
 #import "Atlas.h"
 #import "Component.h"
-
-typedef struct {
-    float x;
-    float y;
-    float dirx;
-    float diry;
-    float rotx;
-    float roty;
-    float age;
-    float lifetime;
-    float scale;
-    float speed;
-    float angularVel;
-    float tangentialAccelX;
-    float tangentialAccelY;
-    float radialAccelX;
-    float radialAccelY;
-    float r;
-    float g;
-    float b;
-    float a;
-} Particle;
+#import "Particles.h"
 
 @interface Emitter : BaseComponent <ComponentInterface>
 {
@@ -57,8 +36,8 @@ typedef struct {
     float m_endScale;
     
     // initial and ending colors for particles
-    NSColor* m_startColor;
-    NSColor* m_endColor;
+    float m_startColor[4];
+    float m_endColor[4];
     
     // position offset from the actor
     NSPoint m_pos;
@@ -69,12 +48,27 @@ typedef struct {
     // true while the emitter is active
     BOOL m_active;
     
-    // total number of particles ever emitted and active
+    // blend mode particles are rendered with
+    GLenum m_blendSrc;
+    GLenum m_blendDst;
+    
+    // true if rendered with other emitters in the layer sharing atlas and blend
+    BOOL m_merge;
+    
+    // total number of particles ever emitted
     unsigned int m_total;
-    unsigned int m_count;
     
-    // fixed-buffer of particles
-    Particle m_particles[500];
+    // emission time, slowed down when the particle budget is scaling rates
+    float m_emitTime;
+    
+    // most particles this emitter can have alive
+    unsigned int m_capacity;
+    
+    // color and scale over the lifetime of a particle
+    ParticleRamp m_ramp;
+    
+    // pooled storage, only held while the emitter is running
+    Particles* m_particles;
 }
 
 // true if currently emitting particles
@@ -93,4 +87,16 @@ typedef struct {
 - (void)startEmitter;
 - (void)stopEmitter;
 
+// recalculate the color and scale ramp
+- (void)buildRamp;
+
+// render all the particles with a single batch
+- (void)renderParticles;
+
+// render all merged emitters queued since the last call (end of each layer)
++ (void)renderMerged;
+
+// sort merged emitters by atlas and blend mode
+- (NSComparisonResult)mergeOrderWith:(Emitter*)emitter;
+
 @end
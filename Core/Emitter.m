@@ -4,9 +4,51 @@
 // All rights reserved.
 //
 
+#import "Batch.h"
 #import "Engine.h"
 #import "Emitter.h"
-#import "Scanners.h"
+
+// default number of live particles a single emitter can have
+#define EMITTER_DEFAULT_CAPACITY 500
+
+// shortest a particle can live, anything shorter makes 1/lifetime overflow
+#define EMITTER_MIN_PARTICLE_LIFE 0.001f
+
+// emitters waiting to be rendered together at the end of the layer
+static NSMutableArray* mergedEmitters = nil;
+
+// lifetime is a number of seconds, "infinite" or "one shot"
+static void emitterParseLifetime(NSString* value, void* member)
+{
+    if ([value isCaseInsensitiveLike:@"infinite"]) {
+        *(float*)member = NAN;
+    } else if ([value isCaseInsensitiveLike:@"one shot"]) {
+        *(float*)member = 0.0f;
+    } else {
+        *(float*)member = [value floatValue];
+    }
+}
+
+static void emitterParseParticleLife(NSString* value, void* member)
+{
+    *(float*)member = MAX([value floatValue], EMITTER_MIN_PARTICLE_LIFE);
+}
+
+static void emitterParseAngle(NSString* value, void* member)
+{
+    *(float*)member = fmodf([value floatValue], 360.0f);
+}
+
+// blend is either "alpha" or additive
+static void emitterParseBlend(NSString* value, void* member)
+{
+    *(GLenum*)member = [value isCaseInsensitiveLike:@"alpha"] ? GL_ONE_MINUS_SRC_ALPHA : GL_ONE;
+}
+
+static void emitterParseCapacity(NSString* value, void* member)
+{
+    *(unsigned int*)member = (unsigned int)MIN(MAX([value intValue], 1), PARTICLE_MAX_CAPACITY);
+}
 
 @implementation Emitter
 
@@ -16,13 +58,16 @@
         return nil;
     }
     
-    // default particle color
-    NSColor* white = [NSColor colorWithDeviceRed:1.0f 
-                                           green:1.0f 
-                                            blue:1.0f 
-                                           alpha:1.0f];
-    
     // initialize members
+    m_particles = NULL;
+    
+    [self reset];
+    
+    return self;
+}
+
+- (void)reset
+{
     m_atlas = nil;
     m_frame = -1UL;
     m_rate = 10.0f;
@@ -41,53 +86,68 @@
     m_tangentialAccelMin = 0.0f;
     m_tangentialAccelMax = 0.0f;
     m_active = NO;
+    m_blendSrc = GL_SRC_ALPHA;
+    m_blendDst = GL_ONE;
+    m_merge = NO;
     m_total = 0;
-    m_count = 0;
+    m_emitTime = 0.0f;
+    m_capacity = EMITTER_DEFAULT_CAPACITY;
     m_pos = NSMakePoint(0.0f, 0.0f);
     m_gravity = NSMakePoint(0.0f, 0.0f);
-    m_startColor = [white retain];
-    m_endColor = [white retain];
     m_startScale = 1.0f;
     m_endScale = 1.0f;
     
-    return self;
+    // default particle color is white
+    for(int i = 0;i < 4;i++) {
+        m_startColor[i] = 1.0f;
+        m_endColor[i] = 1.0f;
+    }
+    
+    // particles from the last actor using a pooled emitter are gone
+    particlesFree(m_particles);
+    m_particles = NULL;
+    
+    // precompute the color and scale ramp
+    [self buildRamp];
 }
 
 - (void)dealloc
 {
-    [m_startColor release];
-    [m_endColor release];
+    particlesFree(m_particles);
     [super dealloc];
 }
 
 + (NSArray*)properties
 {
     return [[NSArray arrayWithObjects:
-             prop_WIRE(@"atlas", @selector(setAtlas:)),
-             prop_WIRE(@"frame", @selector(setFrame:)),
-             prop_WIRE(@"active", @selector(setActive:)),
-             prop_WIRE(@"rate", @selector(setRate:)),
-             prop_WIRE(@"lifetime", @selector(setLifetime:)),
-             prop_WIRE(@"minparticlelife", @selector(setMinLife:)),
-             prop_WIRE(@"maxparticlelife", @selector(setMaxLife:)),
-             prop_WIRE(@"x", @selector(setX:)),
-             prop_WIRE(@"y", @selector(setY:)),
-             prop_WIRE(@"angle", @selector(setAngle:)),
-             prop_WIRE(@"spread", @selector(setSpread:)),
-             prop_WIRE(@"minspeed", @selector(setMinSpeed:)),
-             prop_WIRE(@"maxspeed", @selector(setMaxSpeed:)),
-             prop_WIRE(@"minangularvelocity", @selector(setMinAngularVelocity:)),
-             prop_WIRE(@"maxangularvelocity", @selector(setMaxAngularVelocity:)),
-             prop_WIRE(@"minradialaccel", @selector(setMinRadialAccel:)),
-             prop_WIRE(@"maxradialaccel", @selector(setMaxRadialAccel:)),
-             prop_WIRE(@"mintangentialaccel", @selector(setMinTangentialAccel:)),
-             prop_WIRE(@"maxtangentialaccel", @selector(setMaxTangentialAccel:)),
-             prop_WIRE(@"gravityx", @selector(setGravityX:)),
-             prop_WIRE(@"gravityy", @selector(setGravityY:)),
-             prop_WIRE(@"startcolor", @selector(setStartColor:)),
-             prop_WIRE(@"endcolor", @selector(setEndColor:)),
-             prop_WIRE(@"startscale", @selector(setStartScale:)),
-             prop_WIRE(@"endscale", @selector(setEndScale:)),
+             prop_ASSET(@"atlas", "m_atlas", Atlas),
+             prop_FRAME(@"frame", "m_frame"),
+             prop_VALUE(@"active", "m_active", BOOL, propertyParseBool),
+             prop_VALUE(@"rate", "m_rate", float, propertyParseFloat),
+             prop_VALUE(@"lifetime", "m_lifetime", float, emitterParseLifetime),
+             prop_VALUE(@"minparticlelife", "m_particleLifeMin", float, emitterParseParticleLife),
+             prop_VALUE(@"maxparticlelife", "m_particleLifeMax", float, emitterParseParticleLife),
+             prop_FIELD(@"x", "m_pos", NSPoint, x, propertyParseReal(CGFloat)),
+             prop_FIELD(@"y", "m_pos", NSPoint, y, propertyParseReal(CGFloat)),
+             prop_VALUE(@"angle", "m_angle", float, emitterParseAngle),
+             prop_VALUE(@"spread", "m_spread", float, propertyParseFloat),
+             prop_VALUE(@"minspeed", "m_speedMin", float, propertyParseFloat),
+             prop_VALUE(@"maxspeed", "m_speedMax", float, propertyParseFloat),
+             prop_VALUE(@"minangularvelocity", "m_angularVelocityMin", float, propertyParseFloat),
+             prop_VALUE(@"maxangularvelocity", "m_angularVelocityMax", float, propertyParseFloat),
+             prop_VALUE(@"minradialaccel", "m_radialAccelMin", float, propertyParseFloat),
+             prop_VALUE(@"maxradialaccel", "m_radialAccelMax", float, propertyParseFloat),
+             prop_VALUE(@"mintangentialaccel", "m_tangentialAccelMin", float, propertyParseFloat),
+             prop_VALUE(@"maxtangentialaccel", "m_tangentialAccelMax", float, propertyParseFloat),
+             prop_FIELD(@"gravityx", "m_gravity", NSPoint, x, propertyParseReal(CGFloat)),
+             prop_FIELD(@"gravityy", "m_gravity", NSPoint, y, propertyParseReal(CGFloat)),
+             prop_VALUE(@"startcolor", "m_startColor", float[4], propertyParseColor),
+             prop_VALUE(@"endcolor", "m_endColor", float[4], propertyParseColor),
+             prop_VALUE(@"startscale", "m_startScale", float, propertyParseFloat),
+             prop_VALUE(@"endscale", "m_endScale", float, propertyParseFloat),
+             prop_VALUE(@"blend", "m_blendDst", GLenum, emitterParseBlend),
+             prop_VALUE(@"merge", "m_merge", BOOL, propertyParseBool),
+             prop_VALUE(@"capacity", "m_capacity", unsigned int, emitterParseCapacity),
              nil]
             arrayByAddingObjectsFromArray:[super properties]];
 }
@@ -104,145 +164,15 @@
             arrayByAddingObjectsFromArray:[super scriptMethods]];
 }
 
-- (void)setAtlas:(NSString*)value
-{
-    m_atlas = [theProject assetWithName:value type:[Atlas class]];
-}
-
-- (void)setFrame:(NSString*)value
-{
-    m_frame = [m_atlas frameNamed:value];
-}
-
-- (void)setActive:(NSString*)value
-{
-    m_active = [value boolValue];
-}
-
-- (void)setLifetime:(NSString*)value
+- (void)didWireProperties
 {
-    if ([value isCaseInsensitiveLike:@"infinite"]) {
-        m_lifetime = NAN;
-    } else if ([value isCaseInsensitiveLike:@"one shot"]) {
-        m_lifetime = 0;
-    } else {
-        m_lifetime = [value floatValue];
-    }
-}
-
-- (void)setRate:(NSString*)value
-{
-    m_rate = [value floatValue];
-}
-
-- (void)setMinLife:(NSString*)value
-{
-    m_particleLifeMin = [value floatValue];
-}
-
-- (void)setMaxLife:(NSString*)value
-{
-    m_particleLifeMax = [value floatValue];
-}
-
-- (void)setX:(NSString*)value
-{
-    m_pos.x = [value floatValue];
-}
-
-- (void)setY:(NSString*)value
-{
-    m_pos.y = [value floatValue];
-}
-
-- (void)setAngle:(NSString*)value
-{
-    m_angle = fmodf([value floatValue], 360.0f);
-}
-
-- (void)setSpread:(NSString*)value
-{
-    m_spread = [value floatValue];
+    [self buildRamp];
 }
 
-- (void)setMinSpeed:(NSString*)value
+- (void)buildRamp
 {
-    m_speedMin = [value floatValue];
-}
-
-- (void)setMaxSpeed:(NSString*)value
-{
-    m_speedMax = [value floatValue];
-}
-
-- (void)setMinAngularVelocity:(NSString*)value
-{
-    m_angularVelocityMin = [value floatValue];
-}
-
-- (void)setMaxAngularVelocity:(NSString*)value
-{
-    m_angularVelocityMax = [value floatValue];
-}
-
-- (void)setMinRadialAccel:(NSString*)value
-{
-    m_radialAccelMin = [value floatValue];
-}
-
-- (void)setMaxRadialAccel:(NSString*)value
-{
-    m_radialAccelMax = [value floatValue];
-}
-
-- (void)setMinTangentialAccel:(NSString*)value
-{
-    m_tangentialAccelMin = [value floatValue];
-}
-
-- (void)setMaxTangentialAccel:(NSString*)value
-{
-    m_tangentialAccelMax = [value floatValue];
-}
-
-- (void)setGravityX:(NSString*)value
-{
-    m_gravity.x = [value floatValue];
-}
-
-- (void)setGravityY:(NSString*)value
-{
-    m_gravity.y = [value floatValue];
-}
-
-- (void)setStartColor:(NSString*)value
-{
-    if (m_startColor != nil) {
-        [m_startColor release];
-    }
-    
-    // parse the color
-    m_startColor = [[value colorValue] retain];
-}
-
-- (void)setEndColor:(NSString*)value
-{
-    if (m_endColor != nil) {
-        [m_endColor release];
-    }
-    
-    // parse the color
-    m_endColor = [[value colorValue] retain];
-}
-
-- (void)setStartScale:(NSString*)value
-{
-    m_startScale = [value floatValue];
-}
-
-- (void)setEndScale:(NSString*)value
-{
-    m_endScale = [value floatValue];
+    // the colors are only read here, never per particle
+    particlesBuildRamp(&m_ramp, m_startColor, m_endColor, m_startScale, m_endScale);
 }
 
 - (BOOL)isActive
@@ -252,52 +182,54 @@
 
 - (unsigned int)particleCount
 {
-    return m_count;
+    return (m_particles != NULL) ? m_particles->count : 0;
 }
 
 - (BOOL)isRunning
 {
-    return m_active || m_count > 0;
+    return m_active || [self particleCount] > 0;
 }
 
 - (void)emit:(int)n
 {
-    int i;
+    float dt = [theClock deltaTime];
+    int i, k;
+    
+    // get storage from the pool
+    if (m_particles == NULL && n > 0) {
+        if ((m_particles = particlesAlloc(m_capacity)) == NULL) {
+            return;
+        }
+    }
     
     // emit each particle
-    for(i = 0;i < n && m_count < sizeof(m_particles) / sizeof(m_particles[0]);i++) {
-        Particle* p = &m_particles[m_count++];
-        
+    for(i = 0;i < n && (k = particlesAdd(m_particles)) >= 0;i++) {
 #       define randr(m,n) ((m) + (((n) - (m)) * [[theEngine random] uniform]))
         {
             float rot = randr(0.0f, 360.0f);
             float angle = [m_actor angle] + randr(-m_spread, m_spread);
-            float tangentialAccel = randr(m_tangentialAccelMin, m_tangentialAccelMax);
-            float radialAccel = randr(m_radialAccelMin, m_radialAccelMax);
+            float speed = randr(m_speedMin, m_speedMax);
+            float angularVel = randr(m_angularVelocityMin, m_angularVelocityMax);
+            float lifetime = randr(m_particleLifeMin, m_particleLifeMax);
             
             // use the position of the actor, offset
             NSPoint position = [m_actor transformPoint:m_pos];
             
             // initialize the particle
-            p->age = 0.0f;
-            p->lifetime = randr(m_particleLifeMin, m_particleLifeMax);
-            p->x = position.x;
-            p->y = position.y;
-            p->speed = randr(m_speedMin, m_speedMax);
-            p->dirx = cosf(angle * 3.141592f / 180.0f);
-            p->diry = sinf(angle * 3.141592f / 180.0f);
-            p->rotx = cosf(rot * 3.141592f / 180.0f);
-            p->roty = sinf(rot * 3.141592f / 180.0f);
-            p->angularVel = randr(m_angularVelocityMin, m_angularVelocityMax);
-            p->tangentialAccelX = cosf(tangentialAccel * 3.141592f / 180.0f);
-            p->tangentialAccelY = sinf(tangentialAccel * 3.141592f / 180.0f);
-            p->radialAccelX = cosf(radialAccel * 3.141592f / 180.0f);
-            p->radialAccelY = sinf(radialAccel * 3.141592f / 180.0f); 
-            p->scale = m_startScale;
-            p->r = [m_startColor redComponent];
-            p->g = [m_startColor greenComponent];
-            p->b = [m_startColor blueComponent];
-            p->a = [m_startColor alphaComponent];
+            m_particles->x[k] = position.x;
+            m_particles->y[k] = position.y;
+            m_particles->vx[k] = speed * cosf(angle * 3.141592f / 180.0f);
+            m_particles->vy[k] = speed * sinf(angle * 3.141592f / 180.0f);
+            m_particles->rotx[k] = cosf(rot * 3.141592f / 180.0f);
+            m_particles->roty[k] = sinf(rot * 3.141592f / 180.0f);
+            
+            // the timestep is fixed, so the per-tick rotation is too
+            m_particles->drotx[k] = cosf(angularVel * dt * 3.141592f / 180.0f);
+            m_particles->droty[k] = sinf(angularVel * dt * 3.141592f / 180.0f);
+            
+            // the shortest lived particles expire on the next tick
+            m_particles->age[k] = 0.0f;
+            m_particles->invLife[k] = 1.0f / MAX(lifetime, EMITTER_MIN_PARTICLE_LIFE);
         }
 #       undef randr
     }
@@ -311,6 +243,7 @@
     if (m_active == NO) {
         m_active = YES;
         m_age = 0.0f;
+        m_emitTime = 0.0f;
         m_total = 0;
     }
 }
@@ -324,45 +257,16 @@
 {
     float dt = [theClock deltaTime];
     
-    // iterate in reverse order for O(1) removal
-    for(int i = m_count - 1;i >= 0;i--) {
-        Particle* p = &m_particles[i];
+    // move, rotate and age all particles, removing dead ones
+    if (m_particles != NULL) {
+        particlesAdvance(m_particles, dt);
         
-        if ((p->age += dt) > p->lifetime) {
-            *p = m_particles[--m_count];
-        } else {
-            float k = p->age / p->lifetime;
-            
-            // translate the particle
-            p->x += p->speed * p->dirx * dt;
-            p->y += p->speed * p->diry * dt;
-            
-            // calculate the angular change this frame
-            float drotx = cosf(p->angularVel * dt * 3.141592f / 180.0f);
-            float droty = sinf(p->angularVel * dt * 3.141592f / 180.0f);
-            
-            // multiple rotation matrices
-            float rotx = (p->rotx * drotx) - (p->roty * droty);
-            float roty = (p->rotx * droty) + (p->roty * drotx);
-            
-            // update the rotation matrix
-            p->rotx = rotx;
-            p->roty = roty;
-            
-#           define interp(m,n) ((m) + k * ((n) - (m)))
-            {
-                // interpolate the color of the particle
-                p->r = interp([m_startColor redComponent], [m_endColor redComponent]);
-                p->g = interp([m_startColor greenComponent], [m_endColor greenComponent]);
-                p->b = interp([m_startColor blueComponent], [m_endColor blueComponent]);
-                p->a = interp([m_startColor alphaComponent], [m_endColor alphaComponent]);
-                
-                // interpolate the scale of the particle
-                p->scale = interp(m_startScale, m_endScale);
-            }
-#           undef interp
+        // give the storage back once there's nothing left to simulate
+        if (m_particles->count == 0 && m_active == NO) {
+            particlesFree(m_particles);
+            m_particles = NULL;
         }
-	}
+    }
     
     // don't emit particles if not active
     if (m_active == YES) {
@@ -374,11 +278,14 @@
         // age the emitter
         m_age += dt;
         
+        // emission slows down as the global budget fills up
+        m_emitTime += dt * particlesRateScale();
+        
         // one-shot systems emit all particles instantly
         if (isnan(m_lifetime) || m_lifetime > 0.0f) {
-            n = (int)(m_age * m_rate) - m_total;
+            n = (int)(m_emitTime * m_rate) - m_total;
         } else {
-            n = (int)(m_rate);
+            n = (int)(m_rate * particlesRateScale());
         }
         
         // emit more particles
@@ -386,43 +293,117 @@
     }
 }
 
-- (void)render
+- (BOOL)bounds:(NSRect*)rect
 {
-    static float M[16] = {
-        1.0f, 0.0f, 0.0f, 0.0f,
-        0.0f, 1.0f, 0.0f, 0.0f, 
-        0.0f, 0.0f, 1.0f, 0.0f, 
-        0.0f, 0.0f, 0.0f, 1.0f, 
-    };
+    float x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+    float r = 0.0f;
+    NSSize size;
     
-    glPushMatrix();
-    {
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-        {
-            for(int i = 0;i < m_count;i++) {
-                Particle* p = &m_particles[i];
-                
-                // use the shared matrix
-                M[ 0] =  p->rotx * p->scale;
-                M[ 1] =  p->roty * p->scale;
-                M[ 4] = -p->roty * p->scale;
-                M[ 5] =  p->rotx * p->scale;
-                M[12] =  p->x;
-                M[13] =  p->y;
-                
-                // quickly set the transform
-                glLoadMatrixf(M);
-                
-                // set the blend color
-                glColor4f(p->r, p->g, p->b, p->a);
-                    
-                // render the texture
-                [m_atlas render:m_frame];
-            }
+    if ([self particleCount] == 0) {
+        return NO;
+    }
+    
+    // particles are in world space already
+    for(unsigned int i = 0;i < m_particles->count;i++) {
+        x0 = MIN(x0, m_particles->x[i]), x1 = MAX(x1, m_particles->x[i]);
+        y0 = MIN(y0, m_particles->y[i]), y1 = MAX(y1, m_particles->y[i]);
+    }
+    
+    // pad by the largest a rotated particle can be
+    if (m_frame != -1UL) {
+        size = [[m_atlas texture] sizeOfFrame:m_frame];
+        r = hypotf(size.width, size.height) / 2 * MAX(fabsf(m_startScale), fabsf(m_endScale));
+    }
+    
+    *rect = NSMakeRect(x0 - r, y0 - r, (x1 - x0) + r * 2, (y1 - y0) + r * 2);
+    
+    return YES;
+}
+
+- (void)renderParticles
+{
+    Texture* texture = [m_atlas texture];
+    const Quad* quad;
+    GLuint tex;
+    
+    // lookup the frame once for every particle
+    if ([self particleCount] == 0 || (quad = [texture quadForFrame:m_frame]) == NULL) {
+        return;
+    }
+    
+    tex = [texture handle];
+    
+    // all particles share texture and blend mode, so they are one draw
+    batchSetBlend(m_blendSrc, m_blendDst);
+    
+    for(unsigned int i = 0;i < m_particles->count;i++) {
+        unsigned int k = particlesRampIndex(m_particles, i);
+        
+        // color and scale come from the ramp
+        const float* rgba = m_ramp.rgba[k];
+        float scale = m_ramp.scale[k];
+        
+        // particles are already in world space
+        Transform m = {
+             m_particles->rotx[i] * scale, m_particles->roty[i] * scale,
+            -m_particles->roty[i] * scale, m_particles->rotx[i] * scale,
+             m_particles->x[i], m_particles->y[i],
+        };
+        
+        // set the blend color
+        batchSetColorv(rgba);
+        
+        // queue the particle
+        batchTransformedQuad(tex, quad, &m);
+    }
+}
+
+- (void)render
+{
+    if (m_merge == NO) {
+        [self renderParticles];
+        
+        // restore the default blend mode
+        batchSetBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    } else if ([self particleCount] > 0) {
+        if (mergedEmitters == nil) {
+            mergedEmitters = [[NSMutableArray alloc] init];
         }
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        
+        // render later with the rest of the layer's emitters
+        [mergedEmitters addObject:self];
+    }
+}
+
++ (void)renderMerged
+{
+    if ([mergedEmitters count] == 0) {
+        return;
     }
-    glPopMatrix();
+    
+    // group emitters so that texture and blend only change between groups
+    [mergedEmitters sortUsingSelector:@selector(mergeOrderWith:)];
+    [mergedEmitters makeObjectsPerformSelector:@selector(renderParticles)];
+    [mergedEmitters removeAllObjects];
+    
+    // restore the default blend mode
+    batchSetBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+- (NSComparisonResult)mergeOrderWith:(Emitter*)emitter
+{
+    uintptr_t a = (uintptr_t)m_atlas;
+    uintptr_t b = (uintptr_t)emitter->m_atlas;
+    
+    if (a != b) {
+        return a < b ? NSOrderedAscending : NSOrderedDescending;
+    }
+    
+    if (m_blendDst != emitter->m_blendDst) {
+        return m_blendDst < emitter->m_blendDst ? NSOrderedAscending : NSOrderedDescending;
+    }
+    
+    return NSOrderedSame;
 }
 
 /*
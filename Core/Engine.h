@@ -38,10 +38,18 @@
     // current and pending scene
     Scene* m_scene;
     Scene* m_pendingScene;
+    
+    // true when running without a display
+    BOOL m_headless;
+    BOOL m_quit;
+    
+    // most texture bytes uploaded to OpenGL per frame
+    NSUInteger m_uploadBudget;
 }
 
 // allocator methods
 + (BOOL)launchWithProject:(NSString*)projectFileName;
++ (BOOL)runHeadlessWithProject:(NSString*)projectFileName ticks:(unsigned int)ticks;
 
 // initialization methods
 - (id)initWithProject:(NSBundle*)bundle;
@@ -71,10 +79,16 @@
 // set the pending scene to switch to
 - (BOOL)loadScene:(NSString*)name;
 
-// called once per frame
+// setup the fixed simulation timestep from the project settings
+- (void)setupClock;
+
+// setup the global particle budget from the project settings
+- (void)setupParticles;
+
+// called once per frame, runs zero or more simulation ticks and renders
 - (void)stepFrame:(id)userinfo;
 
-// phases of a frame step
+// phases of a frame step (advance and update run once per tick)
 - (void)start;
 - (void)advance;
 - (void)render;
@@ -83,6 +97,12 @@
 // start the game engine
 - (void)launchWithApp:(NSApplication*)app;
 
+// simulate without a display or application as fast as possible (0 = forever)
+- (void)runHeadless:(unsigned int)ticks;
+
+// true if there is no display to render to
+- (BOOL)isHeadless;
+
 // NSApplication delegate methods
 - (void)applicationDidFinishLaunching:(NSNotification*)notification;
 - (BOOL)applicationShouldTerminate:(id)sender;
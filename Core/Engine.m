@@ -8,6 +8,9 @@
 #import "Engine.h"
 #import "Font.h"
 #import "Intro.h"
+#import "Particles.h"
+#import "Prefab.h"
+#import "Profiler.h"
 #import "Texture.h"
 
 @implementation Engine
@@ -38,6 +41,33 @@
     return TRUE;
 }
 
++ (BOOL)runHeadlessWithProject:(NSString*)projectFileName ticks:(unsigned int)ticks
+{
+    NSAutoreleasePool* pool;
+    Project* project;
+    Engine* engine;
+    
+    // create a release pool for the simulation
+    pool = [[NSAutoreleasePool alloc] init];
+    
+    // load the project bundle with all the resources
+    if ((project = [Project projectWithPath:projectFileName]) == nil) {
+        return [pool release], FALSE;
+    }
+    
+    // create the engine
+    if ((engine = [[Engine alloc] initWithProject:project]) == nil) {
+        return [pool release], FALSE;
+    }
+    
+    // run the simulation until done
+    [engine runHeadless:ticks];
+    [engine release];
+    [pool release];
+    
+    return TRUE;
+}
+
 - (id)initWithProject:(Project*)project
 {
     // there can only be one!
@@ -66,6 +96,20 @@
     m_network = [[Network alloc] init];
     m_world = [[World alloc] init];
     
+    // setup the fixed simulation timestep
+    [self setupClock];
+    
+    // limit the number of live particles
+    [self setupParticles];
+    
+    // limit how much texture data is streamed to OpenGL each frame
+    m_uploadBudget = [[m_project settingForKey:@"Texture Upload Budget"
+                                   withDefault:[NSNumber numberWithUnsignedInt:2 * 1024 * 1024]] unsignedIntegerValue];
+    
+    // optionally record timing scopes from the very first frame
+    [Profiler setEnabled:[[m_project settingForKey:@"Profile" 
+                                       withDefault:[NSNumber numberWithBool:NO]] boolValue]];
+    
     // register subsystem methods
     [m_script registerObject:self withNamespace:@"engine" locked:YES];
     [m_script registerObject:m_project withNamespace:@"project" locked:YES];
@@ -82,6 +126,10 @@
     m_pendingScene = nil;
     m_scene = nil;
     
+    // assume there will be a display until told otherwise
+    m_headless = NO;
+    m_quit = NO;
+    
     // set the global engine object
     theEngine = self;
     
@@ -109,6 +157,10 @@
     [m_clock release];
     [m_network release];
     [m_project release];
+    
+    // another engine can be created now
+    theEngine = nil;
+    
     [super dealloc];
 }
 
@@ -116,9 +168,41 @@
 {
     return [NSArray arrayWithObjects:
             script_Method(@"quit", @selector(l_quit:)),
+            script_Method(@"profile", @selector(l_profile:)),
+            script_Method(@"set_profiling", @selector(l_setProfiling:)),
+            script_Method(@"dump_profile", @selector(l_dumpProfile:)),
+            script_Method(@"particle_stats", @selector(l_particleStats:)),
+            script_Method(@"pool_stats", @selector(l_poolStats:)),
             nil];
 }
 
+- (void)setupClock
+{
+    NSNumber* rate = [m_project settingForKey:@"Simulation Rate" 
+                                  withDefault:[NSNumber numberWithFloat:60.0f]];
+    NSNumber* ticks = [m_project settingForKey:@"Max Simulation Ticks"
+                                   withDefault:[NSNumber numberWithUnsignedInt:5]];
+    
+    // make sure the rate is sane
+    if ([rate floatValue] <= 0.0f) {
+        NSLog(@"Invalid simulation rate %@, using 60 Hz\n", rate);
+        rate = [NSNumber numberWithFloat:60.0f];
+    }
+    
+    // simulation always steps in fixed increments
+    [m_clock setTimestep:1.0f / [rate floatValue] maxTicks:[ticks unsignedIntValue]];
+}
+
+- (void)setupParticles
+{
+    NSNumber* budget = [m_project settingForKey:@"Particle Budget"
+                                    withDefault:[NSNumber numberWithUnsignedInt:20000]];
+    NSString* overflow = [m_project settingForKey:@"Particle Overflow"
+                                      withDefault:@"drop new"];
+    
+    particlesSetBudget([budget unsignedIntValue], particlesOverflowNamed(overflow));
+}
+
 - (Display*)createDisplay;
 {
     NSNumber* w = [m_project settingForKey:@"Display Width" 
@@ -142,6 +226,20 @@
     [m_display setInputDelegate:m_input];
     [m_display setDelegate:self];
     
+    // draw frames on their own thread unless disabled
+    [m_display createRendererThreaded:[[m_project settingForKey:@"Render Thread"
+                                                    withDefault:[NSNumber numberWithBool:YES]] boolValue]];
+    
+    // optional render counters overlay, drawn with a font asset
+    [m_display setStatsFont:[m_project settingForKey:@"Stats Overlay"]];
+    
+    // instanced sprites with shaders, or the fixed-function pipeline
+    if ([[m_project settingForKey:@"Sprite Pipeline" withDefault:@"fixed"] isEqualToString:@"shader"]) {
+        if ([m_display enableShaders] == NO) {
+            NSLog(@"Shader sprite pipeline unsupported, using fixed-function\n");
+        }
+    }
+    
     // setup the camera projection to the default for the display
     [m_camera pushDefaultProjection:[[m_display contentView] frame].size];
     
@@ -261,6 +359,7 @@
 
 - (void)loadDefaultAssets
 {
+    NSString* pages = [m_project settingForKey:@"Texture Pages"];
     NSArray* assets = [NSArray arrayWithObjects:
                        [[Texture alloc] initWithName:@"logo" path:@"logo.png"],
                        [[Texture alloc] initWithPath:@"missing.png"],
@@ -268,6 +367,11 @@
                        [[Skin alloc] initWithPath:@"skin.xml"],
                        nil];
     
+    // images packed by the atlas packer are loaded from shared pages
+    if (pages != nil && [Texture loadPageTable:pages] == FALSE) {
+        NSLog(@"Failed to load texture pages %@\n", pages);
+    }
+    
     // load all the default assets
     [m_project loadDefaultAssetGroup:assets];
 }
@@ -330,21 +434,124 @@
     [pool release];
 }
 
+- (void)runHeadless:(unsigned int)ticks
+{
+    NSDate* startTime;
+    NSTimeInterval elapsed;
+    unsigned int n;
+    
+    NSNumber* w = [m_project settingForKey:@"Display Width" 
+                               withDefault:[NSNumber numberWithFloat:640.0f]];
+    NSNumber* h = [m_project settingForKey:@"Display Height"
+                               withDefault:[NSNumber numberWithFloat:480.0f]];
+    
+    // never render anything
+    m_headless = YES;
+    
+    // textures the default assets queued will never be drawn, and later ones aren't queued
+    [Texture discardUploads];
+    
+    // the camera still needs a projection for scripts to query
+    [m_camera pushDefaultProjection:NSMakeSize([w floatValue], [h floatValue])];
+    
+    // skip the splash screen and go right to the game
+    if ([self loadScene:[m_project settingForKey:@"Initial Scene"]] == FALSE) {
+        return;
+    }
+    
+    // every frame is exactly one tick, there's no real time to catch up with
+    [m_clock lockFPS:YES];
+    
+    // time the whole run
+    startTime = [NSDate date];
+    
+    // simulate until the tick count is reached or a script quits
+    for(n = 0;(ticks == 0 || n < ticks) && m_quit == NO;n++) {
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        
+        // apply any profiling changes
+        [Profiler beginFrame];
+        
+        profile_BEGIN("frame", NULL);
+        {
+            [m_clock advance];
+            
+            // run the simulation phases
+            while ([m_clock tick]) {
+                [self advance];
+                [self update];
+                
+                // a press is only seen by the first tick after it
+                [m_input hideHits:YES];
+            }
+            
+            // reset the hit counters for buttons and mouse delta
+            [m_input flush:NO];
+        }
+        profile_END();
+        
+        [pool release];
+    }
+    
+    // make sure the current scene cleans up
+    [m_scene leave];
+    
+    // report throughput
+    elapsed = -[startTime timeIntervalSinceNow];
+    NSLog(@"Simulated %u ticks in %.3f seconds (%.1f ticks/sec)\n", n, elapsed, n / elapsed);
+}
+
+- (BOOL)isHeadless
+{
+    return m_headless;
+}
+
 - (void)stepFrame:(id)userinfo
 {
-    // prepare frame dependencies
-    [m_audio makeCurrent];
+    // apply any profiling changes
+    [Profiler beginFrame];
     
-    // phases of the frame
-    [self advance];
-    [self render];
-    [self update];
+    profile_BEGIN("frame", NULL);
+    {
+        // prepare frame dependencies
+        [m_audio makeCurrent];
+        
+        // update the game clock and framerate, accumulate time to simulate
+        [m_clock advance];
+        
+        // run as many fixed simulation ticks as have accumulated
+        while ([m_clock tick]) {
+            [self advance];
+            [self update];
+            
+            // catch-up ticks don't see the same presses again
+            [m_input hideHits:YES];
+        }
+        
+        // the gui still sees presses from this frame
+        [m_input hideHits:NO];
+        
+        // draw the state between the last two ticks
+        [self render];
+        
+        // input is only consumed once the simulation has seen it
+        if ([m_clock ticks] > 0) {
+            [m_input flush:NO];
+        }
+        
+        // check audio for completed sounds
+        [m_audio update];
+    }
+    profile_END();
 }
 
 - (void)start
 {
-    // start stepping frames
-    [NSTimer scheduledTimerWithTimeInterval:5.0 / 1000.0
+    NSNumber* fps = [m_project settingForKey:@"Frame Rate"
+                                 withDefault:[NSNumber numberWithFloat:60.0f]];
+    
+    // start stepping frames at the display rate
+    [NSTimer scheduledTimerWithTimeInterval:1.0 / MAX([fps floatValue], 1.0f)
                                      target:self 
                                    selector:@selector(stepFrame:)
                                    userInfo:nil
@@ -359,20 +566,29 @@
 
 - (void)advance
 {
-    // update the game clock and framerate
-    [m_clock advance];
-    
-    // update physics (before actors are advanced)
-    [m_world step:[m_clock deltaTime]];
-    
-    // advance all actors in the scene
-    [m_scene advance];
+    profile_BEGIN("advance", NULL);
+    {
+        // remember where everything was for render interpolation
+        [m_scene saveTransforms];
+        
+        // update physics (before actors are advanced)
+        [m_world step:[m_clock deltaTime]];
+        
+        // advance all actors in the scene
+        [m_scene advance];
+    }
+    profile_END();
 }
 
 - (void)render
 {
+    profile_BEGIN("render", NULL);
+    
     [m_display prepare];
     {
+        // stream newly loaded textures in a little at a time
+        [Texture processUploads:m_uploadBudget];
+        
         [m_camera loadProjectionMatrix];
         [m_scene render];
         
@@ -380,19 +596,34 @@
         [m_gui startRendering:[[m_display contentView] frame].size];
         {
             [m_scene gui];
+            
+            // render counters on top of everything
+            if ([m_display statsFont] != nil) {
+                [m_gui drawStats:[m_display stats] withFont:[m_display statsFont]];
+            }
         }
         [m_gui stopRendering];
     }
     [m_display present];
+    
+    profile_END();
 }
 
 - (void)update
 {
+    profile_BEGIN("update", NULL);
+    
     if (m_pendingScene == nil) {
         [m_scene update];
     } else {
+        // the last frame drawn may still use the old scene's textures
+        [m_display finishRendering];
+        
         // free the current scene
 		[m_scene release];
+        
+        // the old scene's particle storage isn't needed anymore
+        particlesTrim();
 		
 		// enter the new scene
 		m_scene = m_pendingScene;
@@ -405,11 +636,7 @@
 		[m_scene start];
     }
     
-    // reset the hit counters for buttons and mouse delta
-    [m_input flush:NO];
-    
-    // check audio for completed sounds
-    [m_audio update];
+    profile_END();
 }
 
 - (void)applicationDidFinishLaunching:(NSNotification*)notification
@@ -433,9 +660,89 @@
 
 - (int)l_quit:(lua_State*)L
 {
+    if (m_headless) {
+        return m_quit = YES, 0;
+    }
+    
     return [m_display close], 0;
 }
 
+- (int)l_profile:(lua_State*)L
+{
+    if ([Script push:[Profiler lastFrame] to:L] == FALSE) {
+        lua_pushnil(L);
+    }
+    
+    return 1;
+}
+
+- (int)l_setProfiling:(lua_State*)L
+{
+    return [Profiler setEnabled:lua_toboolean(L, 1)], 0;
+}
+
+- (int)l_dumpProfile:(lua_State*)L
+{
+    NSString* path;
+    
+    // get the file to write the trace to
+    if ((path = [NSString stringWithUTF8String:lua_tostring(L, 1)]) == nil) {
+        return lua_pushboolean(L, 0), 1;
+    }
+    
+    return lua_pushboolean(L, [Profiler writeChromeTrace:path]), 1;
+}
+
+- (int)l_particleStats:(lua_State*)L
+{
+    ParticleStats stats;
+    
+    particlesGetStats(&stats);
+    
+    // live particles against the budget, and the memory backing them
+    NSDictionary* table = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [NSNumber numberWithUnsignedInt:stats.live], @"live",
+                           [NSNumber numberWithUnsignedInt:stats.peak], @"peak",
+                           [NSNumber numberWithUnsignedInt:stats.budget], @"budget",
+                           [NSNumber numberWithUnsignedInt:stats.dropped], @"dropped",
+                           [NSNumber numberWithUnsignedInt:stats.buffers], @"buffers",
+                           [NSNumber numberWithUnsignedLong:stats.bytesInUse], @"bytes_in_use",
+                           [NSNumber numberWithUnsignedLong:stats.bytesPooled], @"bytes_pooled",
+                           nil];
+    
+    return [Script push:table to:L] ? 1 : (lua_pushnil(L), 1);
+}
+
+- (int)l_poolStats:(lua_State*)L
+{
+    NSString* name;
+    Prefab* prefab;
+    PrefabPoolStats stats;
+    
+    // get the name of the prefab
+    if ((name = [NSString stringWithUTF8String:lua_tostring(L, 1)]) == nil) {
+        return lua_pushnil(L), 1;
+    }
+    
+    if ((prefab = [m_project assetWithName:name type:[Prefab class]]) == nil) {
+        return lua_pushnil(L), 1;
+    }
+    
+    stats = [prefab poolStats];
+    
+    // reuse counts and how full the pool has been
+    NSDictionary* table = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [NSNumber numberWithUnsignedInt:[prefab poolSize]], @"size",
+                           [NSNumber numberWithUnsignedInt:[prefab pooledCount]], @"pooled",
+                           [NSNumber numberWithUnsignedInt:stats.hits], @"hits",
+                           [NSNumber numberWithUnsignedInt:stats.misses], @"misses",
+                           [NSNumber numberWithUnsignedInt:stats.dropped], @"dropped",
+                           [NSNumber numberWithUnsignedInt:stats.highWater], @"high_water",
+                           nil];
+    
+    return [Script push:table to:L] ? 1 : (lua_pushnil(L), 1);
+}
+
 - (int)l_loadScene:(lua_State*)L
 {
     NSString* fileName;
@@ -5,6 +5,7 @@
 //
 
 #import "Asset.h"
+#import "Texture.h"
 
 typedef struct {
     unsigned long frame;
@@ -13,29 +14,59 @@ typedef struct {
     // size of the glyph
     float width;
     float height;
+    
+    // offset from the pen position and how far the pen moves after it
+    float x;
+    float y;
+    float advance;
+    
+    // false if the font doesn't have the character, the quad is looked up from the page frame
+    BOOL defined;
 } Glyph;
 
+// glyphs beyond latin-1 are kept in a hash table
+typedef struct GlyphEntry GlyphEntry;
+
 @interface Font : Asset <AssetInterface>
 {
     // the font description file
     NSXMLDocument* m_doc;
     
-    // all the characters in the font
-    NSMutableDictionary* m_glyphs;
+    // latin-1 characters are looked up directly
+    Glyph m_latin[256];
+    
+    // open-addressed table for everything else
+    GlyphEntry* m_extended;
+    unsigned int m_extendedSize;
+    unsigned int m_extendedCount;
+    
+    // distance between lines of text
+    float m_lineHeight;
     
     // the texture pages
     NSMutableArray* m_pages;
+    
+    // laid out strings, keyed by string, each with the bounds it was laid out in
+    NSMutableDictionary* m_meshes;
 }
 
 // lookup a glyph in the font
 - (const Glyph*)glyphForCharacter:(unichar)c;
 
-// get the size of a string
+// distance between the baselines of two lines
+- (float)lineHeight;
+
+// get the size of a string, wrapping lines wider than the bounds
 - (NSSize)sizeOfString:(NSString*)string;
 - (NSSize)sizeOfString:(NSString*)string withBounds:(NSSize)bounds;
 
-// render a whole list of characters
+// render a whole list of characters, the first line starts at the origin
 - (void)render:(NSString*)string;
 - (void)render:(NSString*)string withBounds:(NSSize)bounds;
 
+// lay out a string without caching it, for text that changes every frame
+- (NSData*)layout:(NSString*)string withBounds:(NSSize)bounds;
+- (NSSize)sizeOfLayout:(NSData*)layout;
+- (void)renderLayout:(NSData*)layout;
+
 @end
@@ -4,10 +4,41 @@
 // All rights reserved.
 //
 
+#import "Batch.h"
 #import "Engine.h"
 #import "Font.h"
 #import "Texture.h"
 
+// most laid out strings kept before the cache is cleared
+#define FONT_MAX_MESHES 128
+
+// most bounds a single string is kept laid out in
+#define FONT_MAX_LAYOUTS 4
+
+struct GlyphEntry {
+    unichar c;
+    Glyph glyph;
+};
+
+// a glyph positioned in a laid out string
+typedef struct {
+    Quad quad;
+    long page;
+} TextGlyph;
+
+// a laid out string, ready to be batched
+typedef struct {
+    NSSize size;
+    NSSize bounds;
+    unsigned int count;
+    TextGlyph glyphs[];
+} TextMesh;
+
+static unsigned int fontHash(unichar c, unsigned int size)
+{
+    return (c * 2654435761u) & (size - 1);
+}
+
 @implementation Font
 
 - (id)init
@@ -18,26 +49,82 @@
     
     // initialize members
     m_pages = [[NSMutableArray alloc] init];
-    m_glyphs = [[NSMutableDictionary alloc] init];
+    m_meshes = [[NSMutableDictionary alloc] init];
+    m_extended = NULL;
+    m_extendedSize = 0;
+    m_extendedCount = 0;
+    m_lineHeight = 0.0f;
     m_doc = nil;
     
+    memset(m_latin, 0, sizeof(m_latin));
+    
     return self;
 }
 
 - (void)dealloc
 {
-    [m_doc release];
-    [m_glyphs release];
+    [m_meshes release];
     [m_pages release];
+    
+    // the asset unloads the glyphs
+    m_meshes = nil;
+    m_pages = nil;
+    
     [super dealloc];
 }
 
+- (void)addGlyph:(const Glyph*)glyph forCharacter:(unichar)c
+{
+    GlyphEntry* entry;
+    
+    if (c < 256) {
+        m_latin[c] = *glyph;
+        return;
+    }
+    
+    // keep the table at most half full
+    if ((m_extendedCount + 1) * 2 > m_extendedSize) {
+        GlyphEntry* old = m_extended;
+        unsigned int oldSize = m_extendedSize;
+        
+        m_extendedSize = m_extendedSize ? m_extendedSize * 2 : 64;
+        m_extended = calloc(m_extendedSize, sizeof(GlyphEntry));
+        m_extendedCount = 0;
+        
+        // rehash
+        for(unsigned int i = 0;i < oldSize;i++) {
+            if (old[i].c != 0) {
+                [self addGlyph:&old[i].glyph forCharacter:old[i].c];
+            }
+        }
+        
+        free(old);
+    }
+    
+    // linear probe for the character or an empty slot
+    for(unsigned int i = fontHash(c, m_extendedSize);;i = (i + 1) & (m_extendedSize - 1)) {
+        entry = &m_extended[i];
+        
+        if (entry->c == 0 || entry->c == c) {
+            break;
+        }
+    }
+    
+    if (entry->c == 0) {
+        m_extendedCount++;
+    }
+    
+    entry->c = c;
+    entry->glyph = *glyph;
+}
+
 - (BOOL)loadFromDisk
 {
     NSXMLElement* root;
+    NSString* lineHeight;
     
     // try and parse the prefab document
-    if ((m_doc = [theProject xmlDocumentWithContentsOfPath:[self path]]) == nil) {
+    if ((m_doc = [[theProject xmlDocumentWithContentsOfPath:[self path]] retain]) == nil) {
         return FALSE;
     }
     
@@ -51,8 +138,6 @@
         for(NSXMLElement* page in [pages elementsForName:@"page"]) {
             NSString* index;
             NSString* fileName;
-            NSData* data;
-            NSImage* image;
             Texture* texture;
             int pageIndex;
             
@@ -74,22 +159,15 @@
                 continue;
             }
             
-            // attempt to load the image file
-            if ((data = [theProject dataWithContentsOfFile:fileName]) == nil) {
-                continue;
-            }
-            
-            // attempt to open the image file
-            if ((image = [[NSImage alloc] initWithData:data]) == nil) {
+            // load the image, or the region of the shared page it was packed into
+            if ((texture = [Texture textureWithContentsOfFile:fileName]) == nil) {
                 NSLog(@"Invalid texture page %@ for font %@\n", fileName, [self name]);
                 continue;
             }
             
-            // create the texture
-            if ((texture = [Texture textureFromImage:[image autorelease]]) == nil) {
-                NSLog(@"Invalid texture page %@ for font %@\n", fileName, [self name]);
-                continue;
-            }
+            // stream it to OpenGL, keeping the pixels if the font asks to
+            [texture setKeepsData:[self keepsData]];
+            [texture queueUpload];
             
             // make sure the array is large enough
             while([m_pages count] < pageIndex) {
@@ -101,9 +179,16 @@
         }
     }
     
+    // distance between lines, the tallest glyph if not set
+    if ((lineHeight = [[root attributeForName:@"line-height"] stringValue]) != nil) {
+        m_lineHeight = [lineHeight floatValue];
+    }
+    
     // parse all the glyphs and create the texture frames
     for(NSXMLElement* glyphs in [root elementsForName:@"glyphs"]) {
         for(NSXMLElement* glyph in [glyphs elementsForName:@"glyph"]) {
+            Texture* texture;
+            NSString* advance;
             NSString* page;
             NSString* name;
             NSString* x;
@@ -157,19 +242,41 @@
                 continue;
             }
             
+            // the name is the character
+            if ([name length] != 1) {
+                NSLog(@"Invalid name attribute for glyph %@ in font %@\n", name, [self name]);
+                continue;
+            }
+            
             // find the size of the glyph
             g.width = [w intValue];
             g.height = [h intValue];
             
+            // optional metrics, by default glyphs are placed side by side
+            g.x = [[[glyph attributeForName:@"xoffset"] stringValue] floatValue];
+            g.y = [[[glyph attributeForName:@"yoffset"] stringValue] floatValue];
+            g.advance = g.width;
+            
+            if ((advance = [[glyph attributeForName:@"advance"] stringValue]) != nil) {
+                g.advance = [advance floatValue];
+            }
+            
             // create the glyph's frame
-            g.frame = [[m_pages objectAtIndex:g.page] addFrame:NSMakeRect([x intValue], 
-                                                                          [y intValue], 
-                                                                          g.width, 
-                                                                          g.height)];
+            texture = [m_pages objectAtIndex:g.page];
+            g.frame = [texture addFrame:NSMakeRect([x intValue], 
+                                                   [y intValue], 
+                                                   g.width, 
+                                                   g.height)];
+            
+            g.defined = YES;
+            
+            // without a line height, use the tallest glyph
+            if (lineHeight == nil) {
+                m_lineHeight = MAX(m_lineHeight, g.height);
+            }
             
             // write the glyph to the table
-            [m_glyphs setObject:[NSData dataWithBytes:&g length:sizeof(g)] 
-                         forKey:name];
+            [self addGlyph:&g forCharacter:[name characterAtIndex:0]];
         }
     }
     
@@ -179,65 +286,247 @@
 - (BOOL)unloadFromMemory
 {
     [m_pages removeAllObjects];
-    [m_glyphs removeAllObjects];
+    [m_meshes removeAllObjects];
     [m_doc release];
     
+    m_doc = nil;
+    
+    // clear the glyph tables
+    memset(m_latin, 0, sizeof(m_latin));
+    free(m_extended);
+    
+    m_extended = NULL;
+    m_extendedSize = 0;
+    m_extendedCount = 0;
+    
     return TRUE;
 }
 
 - (const Glyph*)glyphForCharacter:(unichar)c
 {
-    NSString* character = [NSString stringWithCharacters:&c length:1];
-    NSData* glyph = [m_glyphs objectForKey:character];
+    if (c < 256) {
+        return m_latin[c].defined ? &m_latin[c] : NULL;
+    }
     
-    // lookup the character glyph in the map
-    if (glyph == nil) {
+    if (m_extendedSize == 0) {
         return NULL;
     }
     
-    return (const Glyph*)[glyph bytes];
+    // linear probe until the character or an empty slot is found
+    for(unsigned int i = fontHash(c, m_extendedSize);;i = (i + 1) & (m_extendedSize - 1)) {
+        if (m_extended[i].c == c) {
+            return &m_extended[i].glyph;
+        }
+        
+        if (m_extended[i].c == 0) {
+            return NULL;
+        }
+    }
 }
 
-- (NSSize)sizeOfString:(NSString*)string
+- (float)lineHeight
 {
-    return NSMakeSize(0, 0);
+    return m_lineHeight;
 }
 
-- (NSSize)sizeOfString:(NSString*)string withBounds:(NSSize)bounds
+- (NSData*)layout:(NSString*)string withBounds:(NSSize)bounds
 {
-    return NSMakeSize(0, 0);
+    NSUInteger n = [string length];
+    NSMutableData* data;
+    TextMesh* mesh;
+    unichar* chars;
+    NSUInteger i = 0;
+    unsigned int lines = 0;
+    float width = 0.0f;
+    
+    // header, filled in once the string is laid out
+    data = [NSMutableData dataWithLength:sizeof(TextMesh)];
+    
+    chars = malloc(sizeof(unichar) * (n + 1));
+    [string getCharacters:chars range:NSMakeRange(0, n)];
+    
+    while (i <= n) {
+        NSUInteger end, next, brk = NSNotFound;
+        float x = 0.0f, lineWidth, brkWidth = 0.0f;
+        float y = -(lines * m_lineHeight);
+        
+        // a trailing newline ends the last line, it doesn't start another
+        if (i == n && n > 0 && chars[n - 1] == '\n') {
+            break;
+        }
+        
+        // stop at lines that won't fit in the bounds
+        if (bounds.height > 0.0f && (lines + 1) * m_lineHeight > bounds.height) {
+            break;
+        }
+        
+        // find the end of the line
+        for(end = i;end < n && chars[end] != '\n';end++) {
+            const Glyph* g = [self glyphForCharacter:chars[end]];
+            float advance = g ? g->advance : 0.0f;
+            
+            // remember the last place to wrap
+            if (chars[end] == ' ') {
+                brk = end;
+                brkWidth = x;
+            }
+            
+            // too wide, wrap at the last space or break the word
+            if (bounds.width > 0.0f && x + advance > bounds.width && end > i) {
+                break;
+            }
+            
+            x += advance;
+        }
+        
+        if (end < n && chars[end] != '\n') {
+            if (brk != NSNotFound) {
+                end = brk;
+                next = brk + 1;
+                lineWidth = brkWidth;
+            } else {
+                next = end;
+                lineWidth = x;
+            }
+        } else {
+            next = end + 1;
+            lineWidth = x;
+        }
+        
+        // place the glyphs on the line
+        for(x = 0.0f;i < end;i++) {
+            const Glyph* g = [self glyphForCharacter:chars[i]];
+            const Quad* quad;
+            TextGlyph tg;
+            id page;
+            
+            if (g == NULL) {
+                continue;
+            }
+            
+            page = [m_pages objectAtIndex:g->page];
+            
+            // frames are owned by the page, so they're looked up rather than kept
+            if ([page isKindOfClass:[Texture class]] == NO || (quad = [page quadForFrame:g->frame]) == NULL) {
+                continue;
+            }
+            
+            tg.quad = *quad;
+            tg.page = g->page;
+            
+            for(int k = 0;k < 4;k++) {
+                tg.quad.v[k].x += x + g->x;
+                tg.quad.v[k].y += y + g->y;
+            }
+            
+            [data appendBytes:&tg length:sizeof(tg)];
+            
+            // advance the pen
+            x += g->advance;
+        }
+        
+        width = MAX(width, lineWidth);
+        lines++;
+        
+        i = next;
+    }
+    
+    free(chars);
+    
+    // fill in the header
+    mesh = (TextMesh*)[data mutableBytes];
+    mesh->size = NSMakeSize(width, lines * m_lineHeight);
+    mesh->bounds = bounds;
+    mesh->count = (unsigned int)(([data length] - sizeof(TextMesh)) / sizeof(TextGlyph));
+    
+    return data;
 }
 
-- (void)render:(NSString*)string
+- (const TextMesh*)meshForString:(NSString*)string withBounds:(NSSize)bounds
 {
-    for(int i = 0;i < [string length];i++) {
-        NSData* data;
-        NSString* character;
-        const Glyph* glyph;
-        
-        // lookup the glyph for this character
-        character = [string substringWithRange:NSMakeRange(i, 1)];
-        data = [m_glyphs objectForKey:character];
+    NSMutableArray* layouts = [m_meshes objectForKey:string];
+    NSData* data;
+    
+    // a hit doesn't build a key, the bounds are checked against each layout
+    for(data in layouts) {
+        const TextMesh* mesh = (const TextMesh*)[data bytes];
         
-        // skip if not found
-        if (data == nil) {
-            continue;
+        if (NSEqualSizes(mesh->bounds, bounds)) {
+            return mesh;
+        }
+    }
+    
+    data = [self layout:string withBounds:bounds];
+    
+    if (layouts == nil) {
+        // strings that change every frame shouldn't grow the cache forever
+        if ([m_meshes count] >= FONT_MAX_MESHES) {
+            [m_meshes removeAllObjects];
         }
         
-        // fetch the glyph structure
-        glyph = (const Glyph*)[data bytes];
+        layouts = [NSMutableArray array];
         
-        // render it to the display
-        [(Texture*)[m_pages objectAtIndex:glyph->page] render:(int)glyph->frame];
+        [m_meshes setObject:layouts forKey:string];
+    } else if ([layouts count] >= FONT_MAX_LAYOUTS) {
+        [layouts removeObjectAtIndex:0];
+    }
+    
+    [layouts addObject:data];
+    
+    return (const TextMesh*)[data bytes];
+}
+
+- (NSSize)sizeOfString:(NSString*)string
+{
+    return [self sizeOfString:string withBounds:NSZeroSize];
+}
+
+- (NSSize)sizeOfString:(NSString*)string withBounds:(NSSize)bounds
+{
+    return [self meshForString:string withBounds:bounds]->size;
+}
+
+- (void)renderMesh:(const TextMesh*)mesh
+{
+    NSUInteger pages = [m_pages count];
+    
+    if (mesh->count == 0) {
+        return;
+    }
+    
+    // resolve the page textures once
+    GLuint handles[pages];
+    
+    for(NSUInteger p = 0;p < pages;p++) {
+        id page = [m_pages objectAtIndex:p];
         
-        // translate for the next character
-        glTranslatef(glyph->width, 0.0f, 0.0f);
+        handles[p] = [page isKindOfClass:[Texture class]] ? [page handle] : 0;
+    }
+    
+    // queue every glyph, relative to the top of the transform stack
+    for(unsigned int i = 0;i < mesh->count;i++) {
+        batchQuad(handles[mesh->glyphs[i].page], &mesh->glyphs[i].quad);
     }
 }
 
+- (void)render:(NSString*)string
+{
+    [self render:string withBounds:NSZeroSize];
+}
+
 - (void)render:(NSString*)string withBounds:(NSSize)bounds
 {
-    
+    [self renderMesh:[self meshForString:string withBounds:bounds]];
+}
+
+- (NSSize)sizeOfLayout:(NSData*)layout
+{
+    return ((const TextMesh*)[layout bytes])->size;
+}
+
+- (void)renderLayout:(NSData*)layout
+{
+    [self renderMesh:(const TextMesh*)[layout bytes]];
 }
 
 @end
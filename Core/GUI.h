@@ -13,8 +13,8 @@
     // true while primitive rendering is allowed
     BOOL m_rendering;
     
-    // various color settings
-    NSColor* m_color;
+    // current color for primitives and text
+    float m_rgba[4];
     
     // display boundaries
     NSSize m_size;
@@ -33,7 +33,12 @@
 
 // primitive rendering
 - (void)drawLine:(NSPoint)from to:(NSPoint)to;
+- (void)drawRect:(NSRect)rect filled:(BOOL)filled;
 - (void)drawString:(NSString*)string at:(NSPoint)point withFont:(Font*)font;
+- (void)drawString:(NSString*)string at:(NSPoint)point withFont:(Font*)font bounds:(NSSize)bounds;
+
+// render counters from the display, in the top-left corner
+- (void)drawStats:(NSDictionary*)stats withFont:(Font*)font;
 
 // blit textures to arbitrary areas
 - (UIElement*)blitUIElement:(UIElementIndex)frame from:(NSPoint)from to:(NSPoint)to;
@@ -4,9 +4,13 @@
 // All rights reserved.
 //
 
+#import "Batch.h"
 #import "Engine.h"
 #import "GUI.h"
 
+// primitives are in display coordinates
+static const Transform guiIdentity = { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+
 @implementation GUI
 
 - (id)init
@@ -16,19 +20,16 @@
     }
     
     // initialize members
-    m_color = [[NSColor colorWithDeviceRed:1 green:1 blue:1 alpha:1] retain];
+    m_rgba[0] = 1.0f;
+    m_rgba[1] = 1.0f;
+    m_rgba[2] = 1.0f;
+    m_rgba[3] = 1.0f;
     m_skin = nil;
     m_rendering = NO;
     
     return self;
 }
 
-- (void)dealloc
-{
-    [m_color release];
-    [super dealloc];
-}
-
 - (NSArray*)scriptMethods
 {
     return [NSArray arrayWithObjects:
@@ -49,14 +50,16 @@
         return;
     }
     
-    // setup the projection matrix, force normal display coordinates
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0.0f, size.width - 1.0f, 0.0f, size.height - 1.0f, 0.0f, 1.0f);
+    // finish drawing the scene with its projection
+    batchFlush();
+    batchLoadIdentity();
+    
+    // widgets overlap, so they draw in the order they're submitted
+    batchSetOrdered(YES);
+    batchSetBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
-    // reset the matrix
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    // setup the projection matrix, force normal display coordinates
+    batchSetProjection(0.0f, size.width - 1.0f, 0.0f, size.height - 1.0f, NULL);
     
     // now rendering
     m_rendering = YES;
@@ -67,6 +70,10 @@
 
 - (void)stopRendering
 {
+    batchFlush();
+    batchSetOrdered(NO);
+    
+    // done
     m_rendering = NO;
 }
 
@@ -83,82 +90,89 @@
 
 - (void)setColorRed:(float)r green:(float)g blue:(float)b alpha:(float)a
 {
-    if (m_color != nil) {
-        [m_color release];
-    }
+    m_rgba[0] = r;
+    m_rgba[1] = g;
+    m_rgba[2] = b;
+    m_rgba[3] = a;
+}
+
+- (void)fillQuad:(const Quad*)quad
+{
+    batchSetColorv(m_rgba);
     
-    // create the new color
-    m_color = [[NSColor colorWithDeviceRed:r green:g blue:b alpha:a] retain];
+    // solid quads are in the same stream as the skin and text
+    batchTransformedQuad(0, quad, &guiIdentity);
+}
+
+- (void)fillRect:(NSRect)rect
+{
+    float x1 = rect.origin.x;
+    float y1 = rect.origin.y;
+    float x2 = rect.origin.x + rect.size.width;
+    float y2 = rect.origin.y + rect.size.height;
+    
+    Quad quad = {{
+        { x1, y1, 0.0f, 0.0f },
+        { x2, y1, 0.0f, 0.0f },
+        { x2, y2, 0.0f, 0.0f },
+        { x1, y2, 0.0f, 0.0f },
+    }};
+    
+    [self fillQuad:&quad];
 }
 
 - (void)drawLine:(NSPoint)from to:(NSPoint)to
 {
     if (m_rendering) {
-        float vb[4] = { from.x, from.y, to.x, to.y };
-        
-        // turn off textures
-        glDisable(GL_TEXTURE_2D);
+        float dx = to.x - from.x;
+        float dy = to.y - from.y;
+        float len = sqrtf(dx * dx + dy * dy);
         
-        // set the current color
-        glColor4f([m_color redComponent],
-                  [m_color greenComponent],
-                  [m_color blueComponent],
-                  [m_color alphaComponent]);
+        if (len == 0.0f) {
+            return;
+        }
         
-        // from the origin
-        glLoadIdentity();
+        // half a pixel either side of the line
+        float nx = -dy / len * 0.5f;
+        float ny = dx / len * 0.5f;
         
-        // set the vertex and texcoord pointers
-        glVertexPointer(2, GL_FLOAT, sizeof(GLfloat) * 2, &vb[0]);
-        glTexCoordPointer(2, GL_FLOAT, sizeof(GLfloat) * 2, NULL);
+        Quad quad = {{
+            { from.x + nx, from.y + ny, 0.0f, 0.0f },
+            { to.x + nx, to.y + ny, 0.0f, 0.0f },
+            { to.x - nx, to.y - ny, 0.0f, 0.0f },
+            { from.x - nx, from.y - ny, 0.0f, 0.0f },
+        }};
         
-        // draw a simple triangle fan
-        glDrawArrays(GL_LINES, 0, 2);
+        [self fillQuad:&quad];
     }
 }
 
 - (void)drawRect:(NSRect)rect filled:(BOOL)filled
 {
     if (m_rendering) {
-        float vb[10] = { 
-            rect.origin.x, 
-            rect.origin.y, 
-            rect.origin.x + rect.size.width,
-            rect.origin.y,
-            rect.origin.x + rect.size.width,
-            rect.origin.y + rect.size.height,
-            rect.origin.x,
-            rect.origin.y + rect.size.height,
-            rect.origin.x, 
-            rect.origin.y, 
-            };
-        
-        // turn off textures
-        glDisable(GL_TEXTURE_2D);
-        
-        // set the current color
-        glColor4f([m_color redComponent],
-                  [m_color greenComponent],
-                  [m_color blueComponent],
-                  [m_color alphaComponent]);
+        float x = rect.origin.x;
+        float y = rect.origin.y;
+        float w = rect.size.width;
+        float h = rect.size.height;
         
-        // from the origin
-        glLoadIdentity();
-        
-        // set the vertex and texcoord pointers
-        glVertexPointer(2, GL_FLOAT, sizeof(GLfloat) * 2, &vb[0]);
-        glTexCoordPointer(2, GL_FLOAT, sizeof(GLfloat) * 2, NULL);
-        
-        // draw a simple triangle fan
         if (filled) {
-            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+            [self fillRect:rect];
         } else {
-            glDrawArrays(GL_LINE_STRIP, 0, 5);
+            // one pixel wide edges
+            [self fillRect:NSMakeRect(x, y, w, 1.0f)];
+            [self fillRect:NSMakeRect(x, y + h - 1.0f, w, 1.0f)];
+            [self fillRect:NSMakeRect(x, y + 1.0f, 1.0f, h - 2.0f)];
+            [self fillRect:NSMakeRect(x + w - 1.0f, y + 1.0f, 1.0f, h - 2.0f)];
         }
     }
 }
 
 - (void)drawString:(NSString*)string at:(NSPoint)point withFont:(Font*)font
+{
+    [self drawString:string at:point withFont:font bounds:NSZeroSize];
+}
+
+- (void)drawString:(NSString*)string at:(NSPoint)point withFont:(Font*)font bounds:(NSSize)bounds
 {
     if (font == nil) {
        // TODO: use the default font 
@@ -166,21 +180,78 @@
     
     // 
     if (m_rendering && string != nil && font != nil) {
-        glEnable(GL_TEXTURE_2D);
-        
-        // set the current color
-        glColor4f([m_color redComponent],
-                  [m_color greenComponent],
-                  [m_color blueComponent],
-                  [m_color alphaComponent]);
+        batchSetColorv(m_rgba);
         
         // translate to the given point
-        glLoadIdentity();
-        glTranslatef(point.x, point.y, 0.0f);
+        batchPushMatrix();
+        {
+            batchLoadIdentity();
+            batchTranslate(point.x, point.y);
+            
+            // draw it, wrapped to the bounds
+            [font render:string withBounds:bounds];
+        }
+        batchPopMatrix();
+    }
+}
+
+- (void)drawStats:(NSDictionary*)stats withFont:(Font*)font
+{
+    NSMutableString* text = [NSMutableString string];
+    NSData* layout;
+    float rgba[4];
+    NSSize size;
+    float top;
+    
+    if (m_rendering == NO || font == nil) {
+        return;
+    }
+    
+    [text appendFormat:@"draws %@  binds %@  blends %@  verts %@\nskipped %@  culled %@  overdraw %.2fx  textures %.1f MB",
+     [stats objectForKey:@"draw_calls"],
+     [stats objectForKey:@"texture_binds"],
+     [stats objectForKey:@"blend_changes"],
+     [stats objectForKey:@"vertices"],
+     [stats objectForKey:@"state_skipped"],
+     [stats objectForKey:@"culled_actors"],
+     [[stats objectForKey:@"overdraw"] floatValue],
+     [[stats objectForKey:@"texture_bytes"] unsignedLongValue] / (1024.0f * 1024.0f)];
+    
+    for(NSDictionary* layer in [stats objectForKey:@"layers"]) {
+        [text appendFormat:@"\n%@: draws %@  verts %@  overdraw %.2fx  culled %@",
+         [layer objectForKey:@"name"],
+         [layer objectForKey:@"draw_calls"],
+         [layer objectForKey:@"vertices"],
+         [[layer objectForKey:@"overdraw"] floatValue],
+         [layer objectForKey:@"culled_actors"]];
+    }
+    
+    // the counters change every frame, so this would only churn the font's cache
+    layout = [font layout:text withBounds:NSZeroSize];
+    size = [font sizeOfLayout:layout];
+    top = m_size.height - 4.0f;
+    
+    // the overlay doesn't change the script's color
+    memcpy(rgba, m_rgba, sizeof(rgba));
+    
+    // dark backing so it's readable over anything
+    [self setColorRed:0.0f green:0.0f blue:0.0f alpha:0.6f];
+    [self fillRect:NSMakeRect(4.0f, top - size.height - 8.0f, size.width + 8.0f, size.height + 8.0f)];
+    
+    // the first line sits on the origin, the rest go down from it
+    [self setColorRed:1.0f green:1.0f blue:1.0f alpha:1.0f];
+    
+    batchSetColorv(m_rgba);
+    batchPushMatrix();
+    {
+        batchLoadIdentity();
+        batchTranslate(8.0f, top - 4.0f - [font lineHeight]);
         
-        // draw it
-        [font render:string];
+        [font renderLayout:layout];
     }
+    batchPopMatrix();
+    
+    memcpy(m_rgba, rgba, sizeof(rgba));
 }
 
 - (UIElement*)blitUIElement:(UIElementIndex)frame from:(NSPoint)from to:(NSPoint)to
@@ -201,32 +272,26 @@
     float scaleX = rect.size.width / elt->size.width;
     float scaleY = rect.size.height / elt->size.height;
     
-    glPushMatrix();
+    batchPushMatrix();
     {
-        static float M[16] = {
-            1.0f, 0.0f, 0.0f, 0.0f,
-            0.0f, 1.0f, 0.0f, 0.0f, 
-            0.0f, 0.0f, 1.0f, 0.0f, 
-            0.0f, 0.0f, 0.0f, 1.0f, 
+        Transform m = {
+            scaleX, 0.0f,
+            0.0f, scaleY,
+            rect.origin.x + (elt->size.width * scaleX * 0.5f),
+            rect.origin.y + (elt->size.height * scaleY * 0.5f),
         };
         
         // use skin colors (no blending)
-        glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        
-        // use the shared matrix
-        M[ 0] = scaleX;
-        M[ 5] = scaleY;
-        M[12] = rect.origin.x + (elt->size.width * scaleX * 0.5f);
-        M[13] = rect.origin.y + (elt->size.height * scaleY * 0.5f);
+        batchSetColor(1.0f, 1.0f, 1.0f, 1.0f);
+        batchSetBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         
         // load the matrix
-        glLoadMatrixf(M);
+        batchLoadTransform(&m);
         
         // render the texture
         [m_skin render:elt->frame];
     }
-    glPopMatrix();
+    batchPopMatrix();
     
     return elt;
 }
@@ -428,9 +493,14 @@
     NSString* string = [NSString stringWithUTF8String:lua_tostring(L, 1)];
     NSString* fontName = [NSString stringWithUTF8String:lua_tostring(L, 4)];
     
+    // optional wrapping width and height
+    float w = lua_tonumber(L, 5);
+    float h = lua_tonumber(L, 6);
+    
     [self drawString:string
                   at:[self uiPos:NSMakePoint(x, y)]
-            withFont:[theProject assetWithName:fontName type:[Font class]]];
+            withFont:[theProject assetWithName:fontName type:[Font class]]
+              bounds:NSMakeSize(w, h)];
     
     return 0;
 }
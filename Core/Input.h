@@ -130,6 +130,9 @@ typedef enum {
 {
     Keyboard m_keyboard;
     Mouse m_mouse;
+    
+    // hits already seen by a simulation tick this frame
+    BOOL m_hideHits;
 }
 
 // initialization methods
@@ -140,6 +143,9 @@ typedef enum {
 - (void)flushKeyboard:(BOOL)reset;
 - (void)flush:(BOOL)reset;
 
+// report no hits until shown again or flushed
+- (void)hideHits:(BOOL)hide;
+
 // validation predicates
 - (BOOL)validKey:(Key)key;
 - (BOOL)validButton:(Button)button;
@@ -179,6 +179,14 @@
 {
     [self flushKeyboard:reset];
     [self flushMouse:reset];
+    
+    // new hits can be seen again
+    m_hideHits = NO;
+}
+
+- (void)hideHits:(BOOL)hide
+{
+    m_hideHits = hide;
 }
 
 - (BOOL)validKey:(Key)key
@@ -251,7 +259,7 @@
 {
     unsigned int hits = 0;
     
-    if ([self validKey:key]) {
+    if ([self validKey:key] && m_hideHits == NO) {
         hits = m_keyboard.key[key].hits;
     }
     
@@ -262,7 +270,7 @@
 {
     unsigned int hits = 0;
     
-    if ([self validButton:button]) {
+    if ([self validButton:button] && m_hideHits == NO) {
         hits = m_mouse.button[button].hits;
     }
     
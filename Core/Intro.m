@@ -4,6 +4,7 @@
 // All rights reserved.
 //
 
+#import "Batch.h"
 #import "Engine.h"
 #import "Intro.h"
 
@@ -95,10 +96,10 @@
     y = frame.height / 2 - size.height * scale / 2;
     
     // position in the center of the screen and set opacity
-    glLoadIdentity();
-    glColor4f(1.0f, 1.0f, 1.0f, fade);
-    glTranslatef(x, y, 0.0f);
-    glScalef(scale, scale, 1.0f);
+    batchLoadIdentity();
+    batchSetColor(1.0f, 1.0f, 1.0f, fade);
+    batchTranslate(x, y);
+    batchScale(scale, scale);
     
     // display the logo on the screen
     [m_logo render];
@@ -5,6 +5,8 @@
 //
 
 #import "Actor.h"
+#import "Batch.h"
+#import "ComponentStore.h"
 #import "Script.h"
 #import "Texture.h"
 
@@ -12,6 +14,9 @@
 {
     NSString* m_name;
     
+    // name used for profiling scopes
+    const char* m_profileName;
+    
     // namespace for actors
     Script* m_script;
     
@@ -22,33 +27,69 @@
     NSMutableArray* m_actors;
     NSMutableArray* m_newActors;
     
+    // components of the current actors, packed by class
+    ComponentStore* m_components;
+    
     // layer ordering
     float m_z;
+    
+    // static layers render into a cached texture, only when dirty
+    BOOL m_static;
+    BOOL m_dirty;
+    
+    // cached rendering, the world space area it covers and units per pixel
+    BatchTarget* m_cache;
+    NSRect m_cacheRect;
+    float m_cacheScale;
+    
+    // size of the display the cache was created for
+    NSSize m_cacheSize;
+    
+    // render stats, the batch layer drawn in and actors culled
+    unsigned int m_batchLayer;
+    unsigned int m_culledActors;
 }
 
 // initialization methods
 - (id)initWithName:(NSString*)name zOrdering:(float)z;
 
+// world space area being rendered, the camera view or a static layer's cache
++ (NSRect)renderView;
+
 // accessors
 - (NSString*)name;
 - (NSArray*)actors;
+- (ComponentStore*)components;
 - (Script*)script;
 - (Texture*)backdrop;
 - (float)z;
 
+// batch layer of the last render and how many actors it culled
+- (unsigned int)batchLayer;
+- (unsigned int)culledActors;
+
 // set the backdrop for this layer
 - (void)setBackdrop:(Texture*)texture;
 
+// static layers are cached, and rendered again only when invalidated
+- (void)setStatic:(BOOL)flag;
+- (BOOL)isStatic;
+- (void)invalidate;
+
 // spawn a new actor
 - (Actor*)spawnActorWithPrefab:(Prefab*)prefab;
 
 // determine sort ordering
 - (NSComparisonResult)orderWith:(Layer*)layer;
 
+// snapshot actor transforms before a simulation tick
+- (void)saveTransforms;
+
 // frame stages
 - (void)advance;
 - (void)render;
 - (void)update;
+- (void)leave;
 - (void)gui;
 
 @end
@@ -4,11 +4,24 @@
 // All rights reserved.
 //
 
+#import "Emitter.h"
 #import "Engine.h"
 #import "Layer.h"
+#import "Profiler.h"
+
+// extra area around the camera cached by static layers (per side)
+#define LAYER_CACHE_MARGIN 0.25f
+
+// area being rendered by the current layer
+static NSRect layerRenderView;
 
 @implementation Layer
 
++ (NSRect)renderView
+{
+    return layerRenderView;
+}
+
 - (id)initWithName:(NSString*)name zOrdering:(float)z
 {
     if ((self = [super init]) == nil) {
@@ -18,10 +31,18 @@
     // initialize members
     m_actors = [[NSMutableArray alloc] init];
     m_newActors = [[NSMutableArray alloc] init];
+    m_components = [[ComponentStore alloc] init];
     m_script = [[theScene script] newThread];
     m_name = [name retain];
+    m_profileName = profileIntern(name);
     m_backdrop = nil;
     m_z = z;
+    m_static = NO;
+    m_dirty = YES;
+    m_cache = NULL;
+    m_cacheRect = NSZeroRect;
+    m_cacheScale = 0.0f;
+    m_cacheSize = NSZeroSize;
     
     // add functionality to the layer script - NOT IN A NAMESPACE!
     [m_script registerObject:self withNamespace:nil];
@@ -34,7 +55,11 @@
     [m_name release];
     [m_actors release];
     [m_newActors release];
+    [m_components release];
     [m_script release];
+    
+    batchReleaseTarget(m_cache);
+    
     [super dealloc];
 }
 
@@ -45,6 +70,7 @@
             script_Method(@"spawn", @selector(l_spawn:)),
             script_Method(@"actors", @selector(l_actors:)),
             script_Method(@"find_actors", @selector(l_findActors:)),
+            script_Method(@"invalidate", @selector(l_invalidate:)),
             nil];
 }
 
@@ -58,6 +84,11 @@
     return [[m_actors retain] autorelease];
 }
 
+- (ComponentStore*)components
+{
+    return [[m_components retain] autorelease];
+}
+
 - (Script*)script
 {
     return [[m_script retain] autorelease];
@@ -73,18 +104,58 @@
     return m_z;
 }
 
+- (unsigned int)batchLayer
+{
+    return m_batchLayer;
+}
+
+- (unsigned int)culledActors
+{
+    return m_culledActors;
+}
+
 - (void)setBackdrop:(Texture*)texture
 {
     m_backdrop = texture;
+    m_dirty = YES;
+}
+
+- (void)setStatic:(BOOL)flag
+{
+    m_static = flag;
+    m_dirty = YES;
+}
+
+- (BOOL)isStatic
+{
+    return m_static;
+}
+
+- (void)invalidate
+{
+    m_dirty = YES;
 }
 
 - (Actor*)spawnActorWithPrefab:(Prefab*)prefab
 {
     Actor* actor;
+    BOOL reused = YES;
     
-    // create the actor
-    if ((actor = [[[Actor alloc] initWithPrefab:prefab] autorelease]) == nil) {
-        return nil;
+    // reuse a dead actor if the prefab is pooled, otherwise create one
+    if ((actor = [prefab reuseActor]) == nil) {
+        if ((actor = [[[Actor alloc] initWithPrefab:prefab] autorelease]) == nil) {
+            return nil;
+        }
+        
+        reused = NO;
+    }
+    
+    // register this layer (special) before a reused actor's script runs again
+    [[actor script] registerObject:self withNamespace:@"layer"];
+    
+    // put it back the way the prefab made it
+    if (reused) {
+        [actor reset];
     }
     
     // add it to the list of actors to come in at the end of the scene
@@ -104,24 +175,179 @@
     return NSOrderedSame;
 }
 
+- (void)saveTransforms
+{
+    [m_actors makeObjectsPerformSelector:@selector(saveTransform)];
+}
+
 - (void)advance
 {
-    [m_actors makeObjectsPerformSelector:@selector(advance)];
+    profile_BEGIN("Layer advance", m_profileName);
+    {
+        [m_components advance];
+    }
+    profile_END();
 }
 
-- (void)render
+- (void)renderActors:(NSRect)view
 {
-    // render the backdrop if there is one
+    layerRenderView = view;
+    
+    // everything in this layer sorts above the previous layers
+    batchNextLayer();
+    
+    m_batchLayer = batchLayerIndex();
+    m_culledActors = 0;
+    
+    // render the backdrop if there is one, beneath everything else
     if (m_backdrop != nil) {
+        batchSetDepth(INT16_MIN);
         [m_backdrop render];
+        batchSetDepth(0);
+    }
+    
+    // cull all the actors against the view first
+    for(Actor* actor in m_actors) {
+        if ([actor cull:view]) {
+            m_culledActors++;
+        }
+    }
+    
+    // then render the ones left a component class at a time
+    [m_components render];
+    
+    // emitters that opted in render together after the actors
+    [Emitter renderMerged];
+}
+
+- (BOOL)isCacheValid:(NSRect)view scale:(float)scale
+{
+    if (m_dirty || m_cache == NULL) {
+        return NO;
+    }
+    
+    // zoomed in or out
+    if (fabsf(scale - m_cacheScale) > m_cacheScale * 0.001f) {
+        return NO;
+    }
+    
+    // the window was resized
+    if (NSEqualSizes([[theDisplay contentView] frame].size, m_cacheSize) == NO) {
+        return NO;
+    }
+    
+    // any actor changed
+    for(Actor* actor in m_actors) {
+        if ([actor isDirty]) {
+            return NO;
+        }
+    }
+    
+    // still inside the cached area
+    return NSContainsRect(m_cacheRect, view);
+}
+
+- (void)renderCache:(NSRect)view scale:(float)scale
+{
+    NSSize size = [[theDisplay contentView] frame].size;
+    
+    // the display plus a margin on every side
+    GLsizei w = size.width * (1.0f + LAYER_CACHE_MARGIN * 2.0f);
+    GLsizei h = size.height * (1.0f + LAYER_CACHE_MARGIN * 2.0f);
+    
+    // the window was resized since the target was created
+    if (m_cache != NULL && NSEqualSizes(size, m_cacheSize) == NO) {
+        batchReleaseTarget(m_cache);
+        m_cache = NULL;
+    }
+    
+    // create the target the first time
+    if (m_cache == NULL) {
+        m_cache = batchCreateTarget(w, h);
+        m_cacheSize = size;
+    }
+    
+    // cache the area around the center of the view
+    m_cacheRect.size = NSMakeSize(w * scale, h * scale);
+    m_cacheRect.origin.x = NSMidX(view) - m_cacheRect.size.width * 0.5f;
+    m_cacheRect.origin.y = NSMidY(view) - m_cacheRect.size.height * 0.5f;
+    m_cacheScale = scale;
+    
+    batchSetTarget(m_cache);
+    {
+        batchSetProjection(NSMinX(m_cacheRect), NSMaxX(m_cacheRect), NSMinY(m_cacheRect), NSMaxY(m_cacheRect), NULL);
+        
+        // everything in the cached area, not just what's visible
+        [self renderActors:m_cacheRect];
     }
+    batchSetTarget(NULL);
+    
+    // back to the camera
+    [theCamera loadProjectionMatrix];
+    
+    // everything is up to date
+    for(Actor* actor in m_actors) {
+        [actor setDirty:NO];
+    }
+    
+    m_dirty = NO;
+}
+
+- (void)renderStatic:(NSRect)view
+{
+    static const Transform identity = { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+    
+    // world units per pixel, the rotated view's bounds would change it with the angle
+    float scale = ([theCamera right] - [theCamera left]) / ([theCamera z] * [[theDisplay contentView] frame].size.width);
+    
+    if ([self isCacheValid:view scale:scale] == NO) {
+        [self renderCache:view scale:scale];
+    }
+    
+    float x1 = NSMinX(m_cacheRect);
+    float y1 = NSMinY(m_cacheRect);
+    float x2 = NSMaxX(m_cacheRect);
+    float y2 = NSMaxY(m_cacheRect);
+    
+    // render targets aren't flipped like loaded textures
+    Quad quad = {{
+        { x1, y1, 0.0f, 0.0f },
+        { x2, y1, 1.0f, 0.0f },
+        { x2, y2, 1.0f, 1.0f },
+        { x1, y2, 0.0f, 1.0f },
+    }};
+    
+    batchNextLayer();
+    
+    m_batchLayer = batchLayerIndex();
     
-    // render all the actors
-    [m_actors makeObjectsPerformSelector:@selector(render)];
+    // targets keep alpha coverage separately, so the cache holds premultiplied color
+    batchSetColor(1.0f, 1.0f, 1.0f, 1.0f);
+    batchSetBlend(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    batchTransformedQuad(batchTargetTexture(m_cache), &quad, &identity);
+    batchSetBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+- (void)render
+{
+    NSRect view = [theCamera visibleRect];
+    
+    profile_BEGIN("Layer render", m_profileName);
+    
+    // static layers draw a single cached quad
+    if (m_static) {
+        [self renderStatic:view];
+    } else {
+        [self renderActors:view];
+    }
+    
+    profile_END();
 }
 
 - (void)update
 {
+    profile_BEGIN("Layer update", m_profileName);
+    
     NSArray* newFrameActors = [NSArray arrayWithArray:m_newActors];
     
     // get rid of all the new actors (so we can spawn new ones)
@@ -137,6 +363,12 @@
         
         // tell it to remove itself from the scene
         [actor leave];
+        [m_components removeActor:actor];
+        
+        // keep it for the next spawn if the prefab is pooled
+        [[actor prefab] recycleActor:actor];
+        
+        m_dirty = YES;
 		
 		// swap with the last actor for O(1) removal
         if (i < [m_actors count] - 1) {
@@ -148,18 +380,40 @@
 	}
     
 	// update the actors still alive
-	[m_actors makeObjectsPerformSelector:@selector(update)];
+	[m_components update];
 	
 	// add all new actors to the scene
 	[m_actors addObjectsFromArray:newFrameActors];
+    
+    for(Actor* actor in newFrameActors) {
+        [m_components addActor:actor];
+    }
+    
+    if ([newFrameActors count] > 0) {
+        m_dirty = YES;
+    }
 	
 	// start all new actors and flush the buffer
 	[newFrameActors makeObjectsPerformSelector:@selector(start)];
+    
+    profile_END();
+}
+
+- (void)leave
+{
+    for(Actor* actor in m_actors) {
+        [actor leave];
+        [m_components removeActor:actor];
+        [[actor prefab] recycleActor:actor];
+    }
+    
+    [m_actors removeAllObjects];
+    [m_newActors removeAllObjects];
 }
 
 - (void)gui
 {
-    [m_actors makeObjectsPerformSelector:@selector(gui)];
+    [m_components gui];
 }
 
 /*
@@ -181,6 +435,11 @@
     return 0;
 }
 
+- (int)l_invalidate:(lua_State*)L
+{
+    return [self invalidate], 0;
+}
+
 - (int)l_spawn:(lua_State*)L
 {
     NSString* name;
@@ -207,8 +466,7 @@
     // set the name of the actor to that of the prefab
     [actor setName:name];
     
-    // register this layer (special) and save the environment on the stack
-    [[actor script] registerObject:self withNamespace:@"layer"];
+    // save the environment on the stack
     [[actor script] pushEnvTo:L];
     
     return 1;
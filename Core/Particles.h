@@ -0,0 +1,102 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+// number of steps in a precomputed color and scale ramp
+#define PARTICLE_RAMP_SIZE 256
+
+// most particles a single emitter can hold
+#define PARTICLE_MAX_CAPACITY (1U << 23)
+
+// color and scale of a particle over its lifetime
+typedef struct {
+    float rgba[PARTICLE_RAMP_SIZE][4];
+    float scale[PARTICLE_RAMP_SIZE];
+} ParticleRamp;
+
+// what to do when the global particle budget is used up
+typedef enum {
+    PARTICLES_DROP_NEW,
+    PARTICLES_DROP_OLDEST,
+    PARTICLES_SCALE_RATE,
+} ParticleOverflow;
+
+// particle memory and budget usage
+typedef struct {
+    unsigned int live;
+    unsigned int peak;
+    unsigned int budget;
+    unsigned int dropped;
+    unsigned int buffers;
+    size_t bytesInUse;
+    size_t bytesPooled;
+} ParticleStats;
+
+// particle state as structure-of-arrays, each array is 16-byte aligned
+typedef struct Particles {
+    unsigned int capacity;
+    unsigned int limit;
+    unsigned int count;
+    
+    // position and velocity
+    float* x;
+    float* y;
+    float* vx;
+    float* vy;
+    
+    // orientation and the rotation applied to it every tick
+    float* rotx;
+    float* roty;
+    float* drotx;
+    float* droty;
+    
+    // age and 1/lifetime, so age * invLife is the ramp position
+    float* age;
+    float* invLife;
+    
+    // next free buffer while in the pool
+    struct Particles* next;
+} Particles;
+
+// limit the live particles across all emitters
+void particlesSetBudget(unsigned int budget, ParticleOverflow overflow);
+
+// parse "drop new", "drop oldest" or "scale rate"
+ParticleOverflow particlesOverflowNamed(NSString* name);
+
+// emission rate multiplier, less than 1 only when scaling the rate near the budget
+float particlesRateScale(void);
+
+// get storage for a number of particles from the shared pool
+Particles* particlesAlloc(unsigned int capacity);
+
+// return storage to the pool, killing any live particles
+void particlesFree(Particles* p);
+
+// release all pooled storage that isn't in use
+void particlesTrim(void);
+
+// append a particle, returns its index or -1 if dropped by the capacity or budget
+int particlesAdd(Particles* p);
+
+// current memory and budget usage
+void particlesGetStats(ParticleStats* stats);
+
+// integrate all particles one tick, then remove the expired ones
+void particlesAdvance(Particles* p, float dt);
+
+// same as particlesAdvance, but without SIMD (reference implementation)
+void particlesAdvanceScalar(Particles* p, float dt);
+
+// ramp index for a particle
+unsigned int particlesRampIndex(const Particles* p, unsigned int i);
+
+// linearly interpolate a color and scale ramp
+void particlesBuildRamp(ParticleRamp* ramp, const float* rgba0, const float* rgba1, float scale0, float scale1);
+
+// log particles/second for the original AoS update and the scalar and SIMD kernels
+void particlesBenchmark(unsigned int count, unsigned int ticks);
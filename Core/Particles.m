@@ -0,0 +1,474 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import <AppKit/AppKit.h>
+#import <mach/mach_time.h>
+#import <float.h>
+#import <limits.h>
+#import <stdlib.h>
+#import "Particles.h"
+
+#if defined(__SSE__)
+#   import <xmmintrin.h>
+#   define PARTICLES_SSE 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#   import <arm_neon.h>
+#   define PARTICLES_NEON 1
+#endif
+
+// number of float arrays in the particle storage
+#define PARTICLE_STREAMS 10
+
+// pooled buffers, bucketed by power of two capacity up to the max
+#define PARTICLE_BUCKETS 24
+
+#if (1U << (PARTICLE_BUCKETS - 1)) != PARTICLE_MAX_CAPACITY
+#   error "the largest particle bucket must hold the max capacity"
+#endif
+
+static Particles* particlesPool[PARTICLE_BUCKETS] = { NULL };
+
+// global budget
+static unsigned int particlesBudget = 20000;
+static ParticleOverflow particlesPolicy = PARTICLES_DROP_NEW;
+
+// usage tracking
+static ParticleStats particlesUsage = { 0 };
+
+static size_t particlesBytes(unsigned int capacity)
+{
+    return sizeof(float) * capacity * PARTICLE_STREAMS;
+}
+
+static unsigned int particlesBucket(unsigned int capacity)
+{
+    unsigned int bucket = 2;
+    
+    // smallest bucket is a single vector
+    while ((1U << bucket) < capacity && bucket < PARTICLE_BUCKETS - 1) {
+        bucket++;
+    }
+    
+    return bucket;
+}
+
+void particlesSetBudget(unsigned int budget, ParticleOverflow overflow)
+{
+    particlesBudget = budget;
+    particlesPolicy = overflow;
+}
+
+ParticleOverflow particlesOverflowNamed(NSString* name)
+{
+    if ([name isCaseInsensitiveLike:@"drop oldest"]) {
+        return PARTICLES_DROP_OLDEST;
+    } else if ([name isCaseInsensitiveLike:@"scale rate"]) {
+        return PARTICLES_SCALE_RATE;
+    }
+    
+    return PARTICLES_DROP_NEW;
+}
+
+float particlesRateScale(void)
+{
+    float half = particlesBudget * 0.5f;
+    
+    if (particlesPolicy != PARTICLES_SCALE_RATE || particlesUsage.live <= half) {
+        return 1.0f;
+    }
+    
+    // fall off linearly from half the budget to nothing
+    return (particlesUsage.live < particlesBudget) ? (particlesBudget - particlesUsage.live) / half : 0.0f;
+}
+
+Particles* particlesAlloc(unsigned int capacity)
+{
+    unsigned int bucket = particlesBucket(capacity);
+    unsigned int limit = capacity;
+    Particles* p;
+    float* block;
+    
+    // reuse pooled storage if possible
+    if ((p = particlesPool[bucket]) != NULL) {
+        particlesPool[bucket] = p->next;
+        particlesUsage.bytesPooled -= particlesBytes(p->capacity);
+    } else {
+        capacity = 1U << bucket;
+        
+        if ((p = calloc(1, sizeof(Particles))) == NULL) {
+            return NULL;
+        }
+        
+        // every stream stays 16-byte aligned and whole vectors fit
+        if (posix_memalign((void**)&block, 16, particlesBytes(capacity)) != 0) {
+            free(p);
+            return NULL;
+        }
+        
+        // lanes past the count are integrated too, so keep them finite
+        memset(block, 0, particlesBytes(capacity));
+        
+        p->capacity = capacity;
+        p->x = block + capacity * 0;
+        p->y = block + capacity * 1;
+        p->vx = block + capacity * 2;
+        p->vy = block + capacity * 3;
+        p->rotx = block + capacity * 4;
+        p->roty = block + capacity * 5;
+        p->drotx = block + capacity * 6;
+        p->droty = block + capacity * 7;
+        p->age = block + capacity * 8;
+        p->invLife = block + capacity * 9;
+        
+        particlesUsage.buffers++;
+    }
+    
+    // pooled buffers top out at the largest bucket
+    p->limit = MIN(limit, p->capacity);
+    p->count = 0;
+    p->next = NULL;
+    
+    particlesUsage.bytesInUse += particlesBytes(p->capacity);
+    
+    return p;
+}
+
+void particlesFree(Particles* p)
+{
+    unsigned int bucket;
+    
+    if (p == NULL) {
+        return;
+    }
+    
+    bucket = particlesBucket(p->capacity);
+    
+    // any live particles are gone
+    particlesUsage.live -= p->count;
+    particlesUsage.bytesInUse -= particlesBytes(p->capacity);
+    particlesUsage.bytesPooled += particlesBytes(p->capacity);
+    
+    // return it to the pool
+    p->next = particlesPool[bucket];
+    particlesPool[bucket] = p;
+}
+
+void particlesTrim(void)
+{
+    for(int i = 0;i < PARTICLE_BUCKETS;i++) {
+        while (particlesPool[i] != NULL) {
+            Particles* p = particlesPool[i];
+            
+            particlesPool[i] = p->next;
+            particlesUsage.bytesPooled -= particlesBytes(p->capacity);
+            particlesUsage.buffers--;
+            
+            free(p->x);
+            free(p);
+        }
+    }
+}
+
+static int particlesOldest(const Particles* p)
+{
+    int oldest = -1;
+    
+    // the particle closest to the end of its life
+    for(unsigned int i = 0;i < p->count;i++) {
+        if (oldest < 0 || p->age[i] * p->invLife[i] > p->age[oldest] * p->invLife[oldest]) {
+            oldest = i;
+        }
+    }
+    
+    return oldest;
+}
+
+int particlesAdd(Particles* p)
+{
+    int i;
+    
+    // room in the buffer and the budget
+    if (p->count < p->limit && particlesUsage.live < particlesBudget) {
+        if (++particlesUsage.live > particlesUsage.peak) {
+            particlesUsage.peak = particlesUsage.live;
+        }
+        
+        return (int)p->count++;
+    }
+    
+    // replace the oldest particle of the same emitter
+    if (particlesPolicy == PARTICLES_DROP_OLDEST && (i = particlesOldest(p)) >= 0) {
+        return i;
+    }
+    
+    particlesUsage.dropped++;
+    
+    return -1;
+}
+
+void particlesGetStats(ParticleStats* stats)
+{
+    *stats = particlesUsage;
+    stats->budget = particlesBudget;
+}
+
+static void particlesMove(Particles* p, unsigned int from, unsigned int to)
+{
+    p->x[to] = p->x[from];
+    p->y[to] = p->y[from];
+    p->vx[to] = p->vx[from];
+    p->vy[to] = p->vy[from];
+    p->rotx[to] = p->rotx[from];
+    p->roty[to] = p->roty[from];
+    p->drotx[to] = p->drotx[from];
+    p->droty[to] = p->droty[from];
+    p->age[to] = p->age[from];
+    p->invLife[to] = p->invLife[from];
+}
+
+static void particlesCull(Particles* p)
+{
+    // iterate in reverse order for O(1) removal
+    for(int i = p->count - 1;i >= 0;i--) {
+        if (p->age[i] * p->invLife[i] > 1.0f) {
+            particlesMove(p, --p->count, i);
+            particlesUsage.live--;
+        }
+    }
+}
+
+void particlesAdvanceScalar(Particles* p, float dt)
+{
+    for(unsigned int i = 0;i < p->count;i++) {
+        float rotx = (p->rotx[i] * p->drotx[i]) - (p->roty[i] * p->droty[i]);
+        float roty = (p->rotx[i] * p->droty[i]) + (p->roty[i] * p->drotx[i]);
+        
+        p->x[i] += p->vx[i] * dt;
+        p->y[i] += p->vy[i] * dt;
+        p->rotx[i] = rotx;
+        p->roty[i] = roty;
+        p->age[i] += dt;
+    }
+    
+    particlesCull(p);
+}
+
+void particlesAdvance(Particles* p, float dt)
+{
+#if defined(PARTICLES_SSE)
+    __m128 t = _mm_set1_ps(dt);
+    
+    // the count is padded out to a whole vector, capacity always allows it
+    for(unsigned int i = 0;i < p->count;i += 4) {
+        __m128 rotx = _mm_load_ps(&p->rotx[i]);
+        __m128 roty = _mm_load_ps(&p->roty[i]);
+        __m128 drotx = _mm_load_ps(&p->drotx[i]);
+        __m128 droty = _mm_load_ps(&p->droty[i]);
+        
+        // translate the particles
+        _mm_store_ps(&p->x[i], _mm_add_ps(_mm_load_ps(&p->x[i]), _mm_mul_ps(_mm_load_ps(&p->vx[i]), t)));
+        _mm_store_ps(&p->y[i], _mm_add_ps(_mm_load_ps(&p->y[i]), _mm_mul_ps(_mm_load_ps(&p->vy[i]), t)));
+        
+        // multiply rotation matrices
+        _mm_store_ps(&p->rotx[i], _mm_sub_ps(_mm_mul_ps(rotx, drotx), _mm_mul_ps(roty, droty)));
+        _mm_store_ps(&p->roty[i], _mm_add_ps(_mm_mul_ps(rotx, droty), _mm_mul_ps(roty, drotx)));
+        
+        // age the particles
+        _mm_store_ps(&p->age[i], _mm_add_ps(_mm_load_ps(&p->age[i]), t));
+    }
+    
+    particlesCull(p);
+#elif defined(PARTICLES_NEON)
+    float32x4_t t = vdupq_n_f32(dt);
+    
+    // the count is padded out to a whole vector, capacity always allows it
+    for(unsigned int i = 0;i < p->count;i += 4) {
+        float32x4_t rotx = vld1q_f32(&p->rotx[i]);
+        float32x4_t roty = vld1q_f32(&p->roty[i]);
+        float32x4_t drotx = vld1q_f32(&p->drotx[i]);
+        float32x4_t droty = vld1q_f32(&p->droty[i]);
+        
+        // translate the particles
+        vst1q_f32(&p->x[i], vmlaq_f32(vld1q_f32(&p->x[i]), vld1q_f32(&p->vx[i]), t));
+        vst1q_f32(&p->y[i], vmlaq_f32(vld1q_f32(&p->y[i]), vld1q_f32(&p->vy[i]), t));
+        
+        // multiply rotation matrices
+        vst1q_f32(&p->rotx[i], vmlsq_f32(vmulq_f32(rotx, drotx), roty, droty));
+        vst1q_f32(&p->roty[i], vmlaq_f32(vmulq_f32(rotx, droty), roty, drotx));
+        
+        // age the particles
+        vst1q_f32(&p->age[i], vaddq_f32(vld1q_f32(&p->age[i]), t));
+    }
+    
+    particlesCull(p);
+#else
+    particlesAdvanceScalar(p, dt);
+#endif
+}
+
+unsigned int particlesRampIndex(const Particles* p, unsigned int i)
+{
+    float k = p->age[i] * p->invLife[i];
+    
+    // culling guarantees k <= 1, but newborn particles can be exactly 0
+    return (k < 1.0f) ? (unsigned int)(k * (PARTICLE_RAMP_SIZE - 1)) : PARTICLE_RAMP_SIZE - 1;
+}
+
+void particlesBuildRamp(ParticleRamp* ramp, const float* rgba0, const float* rgba1, float scale0, float scale1)
+{
+    for(int i = 0;i < PARTICLE_RAMP_SIZE;i++) {
+        float k = (float)i / (PARTICLE_RAMP_SIZE - 1);
+
+#       define interp(m,n) ((m) + k * ((n) - (m)))
+        {
+            ramp->rgba[i][0] = interp(rgba0[0], rgba1[0]);
+            ramp->rgba[i][1] = interp(rgba0[1], rgba1[1]);
+            ramp->rgba[i][2] = interp(rgba0[2], rgba1[2]);
+            ramp->rgba[i][3] = interp(rgba0[3], rgba1[3]);
+            ramp->scale[i] = interp(scale0, scale1);
+        }
+#       undef interp
+    }
+}
+
+/*
+ * BENCHMARK
+ */
+
+// the original array-of-structures layout, kept only for comparison
+typedef struct {
+    float x, y;
+    float dirx, diry;
+    float rotx, roty;
+    float age, lifetime;
+    float scale, speed, angularVel;
+    float r, g, b, a;
+} LegacyParticle;
+
+static double particlesSeconds(uint64_t start, uint64_t end)
+{
+    static mach_timebase_info_data_t timebase;
+    
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    
+    return (double)((end - start) * timebase.numer / timebase.denom) / 1e9;
+}
+
+static void particlesReport(const char* name, unsigned int count, unsigned int ticks, double seconds)
+{
+    NSLog(@"%-8s %10.2f M particles/sec (%.3f ms/tick)",
+          name,
+          ((double)count * ticks / seconds) / 1e6,
+          seconds * 1000.0 / ticks);
+}
+
+static double particlesBenchLegacy(unsigned int count, unsigned int ticks, float dt)
+{
+    LegacyParticle* particles = calloc(count, sizeof(LegacyParticle));
+    NSColor* startColor = [NSColor colorWithDeviceRed:1.0f green:1.0f blue:1.0f alpha:1.0f];
+    NSColor* endColor = [NSColor colorWithDeviceRed:1.0f green:0.0f blue:0.0f alpha:0.0f];
+    uint64_t start, end;
+    
+    for(unsigned int i = 0;i < count;i++) {
+        particles[i].lifetime = FLT_MAX;
+        particles[i].speed = (float)(i % 100);
+        particles[i].dirx = 1.0f;
+        particles[i].rotx = 1.0f;
+        particles[i].angularVel = (float)(i % 360);
+    }
+    
+    start = mach_absolute_time();
+    
+    for(unsigned int n = 0;n < ticks;n++) {
+        for(int i = count - 1;i >= 0;i--) {
+            LegacyParticle* p = &particles[i];
+            
+            if ((p->age += dt) > p->lifetime) {
+                *p = particles[--count];
+            } else {
+                float k = p->age / p->lifetime;
+                float drotx = cosf(p->angularVel * dt * 3.141592f / 180.0f);
+                float droty = sinf(p->angularVel * dt * 3.141592f / 180.0f);
+                float rotx = (p->rotx * drotx) - (p->roty * droty);
+                float roty = (p->rotx * droty) + (p->roty * drotx);
+                
+                p->x += p->speed * p->dirx * dt;
+                p->y += p->speed * p->diry * dt;
+                p->rotx = rotx;
+                p->roty = roty;
+
+#               define interp(m,n) ((m) + k * ((n) - (m)))
+                {
+                    p->r = interp([startColor redComponent], [endColor redComponent]);
+                    p->g = interp([startColor greenComponent], [endColor greenComponent]);
+                    p->b = interp([startColor blueComponent], [endColor blueComponent]);
+                    p->a = interp([startColor alphaComponent], [endColor alphaComponent]);
+                    p->scale = interp(1.0f, 2.0f);
+                }
+#               undef interp
+            }
+        }
+    }
+    
+    end = mach_absolute_time();
+    
+    free(particles);
+    
+    return particlesSeconds(start, end);
+}
+
+static double particlesBenchSoA(unsigned int count, unsigned int ticks, float dt, void (*advance)(Particles*, float))
+{
+    Particles* p = particlesAlloc(count);
+    uint64_t start, end;
+    
+    for(unsigned int i = 0;i < count;i++) {
+        int k = particlesAdd(p);
+        float angle = (float)(i % 360) * dt * 3.141592f / 180.0f;
+        
+        // particles never expire, so every tick integrates the full count
+        p->vx[k] = (float)(i % 100);
+        p->rotx[k] = 1.0f;
+        p->drotx[k] = cosf(angle);
+        p->droty[k] = sinf(angle);
+        p->invLife[k] = 0.0f;
+    }
+    
+    start = mach_absolute_time();
+    
+    for(unsigned int n = 0;n < ticks;n++) {
+        advance(p, dt);
+    }
+    
+    end = mach_absolute_time();
+    
+    particlesFree(p);
+    
+    return particlesSeconds(start, end);
+}
+
+void particlesBenchmark(unsigned int count, unsigned int ticks)
+{
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    unsigned int budget = particlesBudget;
+    float dt = 1.0f / 60.0f;
+    
+    // the benchmark isn't subject to the game's budget
+    particlesBudget = UINT_MAX;
+    
+    NSLog(@"Particle benchmark: %u particles, %u ticks", count, ticks);
+    
+    particlesReport("aos", count, ticks, particlesBenchLegacy(count, ticks, dt));
+    particlesReport("scalar", count, ticks, particlesBenchSoA(count, ticks, dt, particlesAdvanceScalar));
+    particlesReport("simd", count, ticks, particlesBenchSoA(count, ticks, dt, particlesAdvance));
+    
+    particlesBudget = budget;
+    particlesTrim();
+    
+    [pool release];
+}
@@ -6,6 +6,16 @@
 
 #import "Asset.h"
 
+@class Actor;
+
+// how well a prefab's actor pool is doing
+typedef struct {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int dropped;
+    unsigned int highWater;
+} PrefabPoolStats;
+
 @interface Prefab : Asset <AssetInterface>
 {
     NSXMLDocument* m_doc;
@@ -13,10 +23,26 @@
     // a list of components and tags
     NSMutableDictionary* m_components;
     NSMutableSet* m_tags;
+    
+    // dead actors kept for reuse, up to the pool size (0 if not pooled)
+    NSMutableArray* m_pool;
+    unsigned int m_poolSize;
+    PrefabPoolStats m_poolStats;
 }
 
 // accessors
 - (NSDictionary*)components;
 - (NSSet*)tags;
 
+// most dead actors kept for reuse, set with the pool attribute
+- (unsigned int)poolSize;
+- (unsigned int)pooledCount;
+- (PrefabPoolStats)poolStats;
+
+// a dead actor from the pool that needs resetting, nil if there isn't one
+- (Actor*)reuseActor;
+
+// keep a dead actor for reuse, NO if not pooled or the pool is full
+- (BOOL)recycleActor:(Actor*)actor;
+
 @end
@@ -4,6 +4,7 @@
 // All rights reserved.
 //
 
+#import "Actor.h"
 #import "Component.h"
 #import "Engine.h"
 #import "Prefab.h"
@@ -19,8 +20,12 @@
     // initialize members
     m_components = [[NSMutableDictionary alloc] init];
     m_tags = [[NSMutableSet alloc] init];
+    m_pool = [[NSMutableArray alloc] init];
+    m_poolSize = 0;
     m_doc = nil;
     
+    memset(&m_poolStats, 0, sizeof(m_poolStats));
+    
     return self;
 }
 
@@ -29,6 +34,7 @@
     [m_doc release];
     [m_components release];
     [m_tags release];
+    [m_pool release];
     [super dealloc];
 }
 
@@ -42,6 +48,65 @@
     return [[m_tags retain] autorelease];
 }
 
+- (unsigned int)poolSize
+{
+    return m_poolSize;
+}
+
+- (unsigned int)pooledCount
+{
+    return (unsigned int)[m_pool count];
+}
+
+- (PrefabPoolStats)poolStats
+{
+    return m_poolStats;
+}
+
+- (Actor*)reuseActor
+{
+    Actor* actor;
+    
+    if (m_poolSize == 0) {
+        return nil;
+    }
+    
+    if ([m_pool count] == 0) {
+        m_poolStats.misses++;
+        return nil;
+    }
+    
+    m_poolStats.hits++;
+    
+    // take it out of the pool
+    actor = [[[m_pool lastObject] retain] autorelease];
+    [actor setPooled:NO];
+    [m_pool removeLastObject];
+    
+    return actor;
+}
+
+- (BOOL)recycleActor:(Actor*)actor
+{
+    if (m_poolSize == 0) {
+        return NO;
+    }
+    
+    if ([m_pool count] >= m_poolSize) {
+        m_poolStats.dropped++;
+        return NO;
+    }
+    
+    [m_pool addObject:actor];
+    
+    m_poolStats.highWater = MAX(m_poolStats.highWater, (unsigned int)[m_pool count]);
+    
+    // last, since letting go of the prefab may free it
+    [actor setPooled:YES];
+    
+    return YES;
+}
+
 - (BOOL)loadFromDisk
 {
     NSXMLElement* root;
@@ -56,18 +121,21 @@
         return FALSE;
     }
     
+    // opt in to keeping dead actors for reuse
+    m_poolSize = MAX([[[root attributeForName:@"pool"] stringValue] intValue], 0);
+    
     // verify all the components
     for(NSXMLElement* components in [root elementsForName:@"components"]) {
         for(NSXMLElement* elt in [components elementsForName:@"component"]) {
             NSString* type;
             Class cls;
-            NSMutableArray* instanceProps;
+            PropertyValues* instanceProps;
             NSMutableDictionary* prefabProps;
             NSMutableArray* set;
             
             // create a new dictionary to hold all the instance properties
             prefabProps = [NSMutableDictionary dictionary];
-            instanceProps = [NSMutableArray array];
+            instanceProps = [[[PropertyValues alloc] init] autorelease];
             
             // lookup the type of the component
             if ((type = [[elt attributeForName:@"type"] stringValue]) == nil) {
@@ -98,12 +166,12 @@
                 }
             }
             
-            // loop over all the properties for this component class
+            // parse the values for this component class once, instances copy them
             for(Property* prop in [cls properties]) {
                 NSString* value;
                 
                 if ((value = [prefabProps objectForKey:prop.value]) != nil) {
-                    [instanceProps addObject:prop_WIRE(value, prop.sel)];
+                    [instanceProps addProperty:prop value:value];
                 }
             }
             
@@ -136,6 +204,7 @@
 {
     [m_doc release];
     [m_components removeAllObjects];
+    [m_pool removeAllObjects];
     
     return TRUE;
 }
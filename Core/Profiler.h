@@ -0,0 +1,60 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <objc/runtime.h>
+
+// a single completed timing scope
+typedef struct {
+    const char* name;
+    const char* detail;
+    
+    // host ticks when the scope began and ended
+    uint64_t start;
+    uint64_t end;
+    
+    // nesting level within the thread
+    unsigned int depth;
+    
+    // counters are a value at a point in time instead of a scope
+    BOOL counter;
+    double value;
+} ProfileSample;
+
+// true while scopes are being recorded
+extern BOOL profileEnabled;
+
+// record the start and end of a timing scope on the current thread
+void profileBegin(const char* name, const char* detail);
+void profileEnd(void);
+
+// record the value of a counter on the current thread
+void profileCounter(const char* name, double value);
+
+// returns a C string for a name that lives as long as the application
+const char* profileIntern(NSString* string);
+
+@interface Profiler : NSObject
+
+// enabling takes effect at the start of the next frame
++ (void)setEnabled:(BOOL)flag;
++ (BOOL)isEnabled;
+
+// called at the very start of every frame on the main thread
++ (void)beginFrame;
+
+// aggregated scopes of the last completed frame on this thread
++ (NSArray*)lastFrame;
+
+// write every recorded scope on all threads as a Chrome trace, safe while they're still recording
++ (BOOL)writeChromeTrace:(NSString*)path;
+
+@end
+
+// helper macros for timing scopes, cost nothing but a test when disabled
+#define profile_BEGIN(name,detail) do { if (profileEnabled) profileBegin(name, detail); } while(0)
+#define profile_END() do { if (profileEnabled) profileEnd(); } while(0)
+#define profile_COUNTER(name,value) do { if (profileEnabled) profileCounter(name, value); } while(0)
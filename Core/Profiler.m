@@ -0,0 +1,399 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import "Profiler.h"
+
+// number of completed samples kept per thread (power of 2)
+#define PROFILE_RING_SIZE (1 << 15)
+
+// deepest nesting of scopes tracked per thread
+#define PROFILE_STACK_SIZE 64
+
+typedef struct ProfileThread {
+    struct ProfileThread* next;
+    
+    // unique id for the trace output
+    unsigned int tid;
+    
+    // total number of samples ever written, only the owner thread writes
+    volatile uint32_t head;
+    
+    // open scopes
+    unsigned int depth;
+    ProfileSample stack[PROFILE_STACK_SIZE];
+    
+    // completed scopes
+    ProfileSample ring[PROFILE_RING_SIZE];
+} ProfileThread;
+
+// global recording state
+BOOL profileEnabled = NO;
+
+// requested recording state, applied at the start of a frame
+static BOOL profilePending = NO;
+
+// lock-free list of all the threads that have recorded something
+static ProfileThread* volatile profileThreads = NULL;
+static volatile int32_t profileThreadCount = 0;
+
+// per-thread buffer lookup
+static pthread_key_t profileKey;
+static pthread_once_t profileKeyOnce = PTHREAD_ONCE_INIT;
+
+// interned scope names
+static NSMutableDictionary* profileNames = nil;
+
+static void profileCreateKey(void)
+{
+    pthread_key_create(&profileKey, NULL);
+}
+
+static ProfileThread* profileThread(void)
+{
+    ProfileThread* thread;
+    
+    pthread_once(&profileKeyOnce, profileCreateKey);
+    
+    // find the buffer for this thread
+    if ((thread = pthread_getspecific(profileKey)) != NULL) {
+        return thread;
+    }
+    
+    // first scope recorded on this thread, buffers are never freed
+    if ((thread = calloc(1, sizeof(ProfileThread))) == NULL) {
+        return NULL;
+    }
+    
+    thread->tid = OSAtomicIncrement32Barrier(&profileThreadCount);
+    
+    // push it onto the global list
+    do {
+        thread->next = profileThreads;
+    } while(OSAtomicCompareAndSwapPtrBarrier(thread->next, thread, (void* volatile*)&profileThreads) == false);
+    
+    pthread_setspecific(profileKey, thread);
+    
+    return thread;
+}
+
+static double profileTicksToMicroseconds(uint64_t ticks)
+{
+    static mach_timebase_info_data_t timebase;
+    
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    
+    return (double)ticks * timebase.numer / timebase.denom / 1000.0;
+}
+
+void profileBegin(const char* name, const char* detail)
+{
+    ProfileThread* thread = profileThread();
+    ProfileSample* sample;
+    
+    // scopes nested too deeply are counted but not recorded
+    if (thread == NULL || thread->depth++ >= PROFILE_STACK_SIZE) {
+        return;
+    }
+    
+    sample = &thread->stack[thread->depth - 1];
+    
+    // open the scope
+    sample->name = name;
+    sample->detail = detail;
+    sample->depth = thread->depth - 1;
+    sample->counter = NO;
+    sample->start = mach_absolute_time();
+}
+
+void profileEnd(void)
+{
+    ProfileThread* thread = profileThread();
+    ProfileSample* sample;
+    
+    // unbalanced end, ignore it
+    if (thread == NULL || thread->depth == 0) {
+        return;
+    }
+    
+    // was it too deep to be recorded?
+    if (thread->depth-- > PROFILE_STACK_SIZE) {
+        return;
+    }
+    
+    sample = &thread->ring[thread->head & (PROFILE_RING_SIZE - 1)];
+    
+    // close the scope and copy it into the ring
+    *sample = thread->stack[thread->depth];
+    sample->end = mach_absolute_time();
+    
+    // publish the sample before readers can see it
+    OSMemoryBarrier();
+    thread->head++;
+}
+
+void profileCounter(const char* name, double value)
+{
+    ProfileThread* thread = profileThread();
+    ProfileSample* sample;
+    
+    if (thread == NULL) {
+        return;
+    }
+    
+    sample = &thread->ring[thread->head & (PROFILE_RING_SIZE - 1)];
+    
+    // a zero length sample inside the open scope
+    sample->name = name;
+    sample->detail = NULL;
+    sample->depth = thread->depth;
+    sample->counter = YES;
+    sample->value = value;
+    sample->start = sample->end = mach_absolute_time();
+    
+    OSMemoryBarrier();
+    thread->head++;
+}
+
+const char* profileIntern(NSString* string)
+{
+    NSValue* value;
+    
+    if (string == nil) {
+        return NULL;
+    }
+    
+    @synchronized([Profiler class]) {
+        if (profileNames == nil) {
+            profileNames = [[NSMutableDictionary alloc] init];
+        }
+        
+        // copy the string the first time it's seen
+        if ((value = [profileNames objectForKey:string]) == nil) {
+            value = [NSValue valueWithPointer:strdup([string UTF8String])];
+            
+            // keep it forever
+            [profileNames setObject:value forKey:string];
+        }
+    }
+    
+    return [value pointerValue];
+}
+
+// copy a sample out of another thread's ring, NO if the owner reused its slot meanwhile
+static BOOL profileCopySample(const ProfileThread* thread, uint32_t i, ProfileSample* sample)
+{
+    *sample = thread->ring[i & (PROFILE_RING_SIZE - 1)];
+    
+    // the copy has to be finished before the head is looked at again
+    OSMemoryBarrier();
+    
+    // the owner starts writing over slot i once its head reaches i + PROFILE_RING_SIZE
+    return thread->head - i < PROFILE_RING_SIZE;
+}
+
+static NSString* profileEscape(const char* s)
+{
+    NSString* string = [NSString stringWithUTF8String:s ? s : ""];
+    
+    // only quotes and backslashes show up in names and file paths
+    string = [string stringByReplacingOccurrencesOfString:@"\\" withString:@"\\\\"];
+    string = [string stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
+    
+    return string;
+}
+
+@implementation Profiler
+
++ (void)setEnabled:(BOOL)flag
+{
+    profilePending = flag;
+}
+
++ (BOOL)isEnabled
+{
+    return profilePending;
+}
+
++ (void)beginFrame
+{
+    ProfileThread* thread;
+    
+    if (profilePending == profileEnabled) {
+        return;
+    }
+    
+    // any scopes left open when recording stopped are gone
+    if ((thread = profileThread()) != NULL) {
+        thread->depth = 0;
+    }
+    
+    profileEnabled = profilePending;
+}
+
++ (NSArray*)lastFrame
+{
+    ProfileThread* thread = profileThread();
+    NSMutableArray* scopes = [NSMutableArray array];
+    NSMutableDictionary* totals = [NSMutableDictionary dictionary];
+    const ProfileSample* frame = NULL;
+    uint32_t head;
+    uint32_t first;
+    uint32_t i;
+    
+    if (thread == NULL) {
+        return scopes;
+    }
+    
+    // only the samples still in the ring are valid
+    head = thread->head;
+    first = head > PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : 0;
+    
+    // find the most recently completed root scope
+    for(i = head;i > first && frame == NULL;i--) {
+        const ProfileSample* sample = &thread->ring[(i - 1) & (PROFILE_RING_SIZE - 1)];
+        
+        if (sample->depth == 0 && sample->counter == NO) {
+            frame = sample;
+        }
+    }
+    
+    if (frame == NULL) {
+        return scopes;
+    }
+    
+    // walk back to the first sample inside the root scope
+    while(i > first && thread->ring[(i - 1) & (PROFILE_RING_SIZE - 1)].start >= frame->start) {
+        i--;
+    }
+    
+    // aggregate every scope by name and detail in the order they finished
+    for(;i < head;i++) {
+        const ProfileSample* sample = &thread->ring[i & (PROFILE_RING_SIZE - 1)];
+        NSString* key;
+        NSMutableDictionary* entry;
+        double ms;
+        
+        // stop at the end of the root scope
+        if (sample->start > frame->end) {
+            break;
+        }
+        
+        // counters only keep their last value
+        if (sample->counter) {
+            key = [NSString stringWithFormat:@"%s|counter", sample->name];
+            
+            if ((entry = [totals objectForKey:key]) == nil) {
+                entry = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                         [NSString stringWithUTF8String:sample->name], @"name",
+                         [NSNumber numberWithUnsignedInt:sample->depth], @"depth",
+                         nil];
+                
+                [totals setObject:entry forKey:key];
+                [scopes addObject:entry];
+            }
+            
+            [entry setObject:[NSNumber numberWithDouble:sample->value] forKey:@"value"];
+            continue;
+        }
+        
+        key = [NSString stringWithFormat:@"%s|%s|%u", sample->name, sample->detail ? sample->detail : "", sample->depth];
+        ms = profileTicksToMicroseconds(sample->end - sample->start) / 1000.0;
+        
+        if ((entry = [totals objectForKey:key]) == nil) {
+            entry = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                     [NSString stringWithUTF8String:sample->name], @"name",
+                     [NSString stringWithUTF8String:sample->detail ? sample->detail : ""], @"detail",
+                     [NSNumber numberWithUnsignedInt:sample->depth], @"depth",
+                     [NSNumber numberWithUnsignedInt:1], @"calls",
+                     [NSNumber numberWithDouble:ms], @"ms",
+                     nil];
+            
+            [totals setObject:entry forKey:key];
+            [scopes addObject:entry];
+        } else {
+            unsigned int calls = [[entry objectForKey:@"calls"] unsignedIntValue];
+            double total = [[entry objectForKey:@"ms"] doubleValue];
+            
+            [entry setObject:[NSNumber numberWithUnsignedInt:calls + 1] forKey:@"calls"];
+            [entry setObject:[NSNumber numberWithDouble:total + ms] forKey:@"ms"];
+        }
+    }
+    
+    return scopes;
+}
+
++ (BOOL)writeChromeTrace:(NSString*)path
+{
+    NSMutableString* json = [NSMutableString stringWithString:@"{\"traceEvents\":[\n"];
+    BOOL first = YES;
+    
+    for(ProfileThread* thread = profileThreads;thread != NULL;thread = thread->next) {
+        uint32_t head = thread->head;
+        uint32_t i = head > PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : 0;
+        
+        // the samples before the head are published, see them before reading any
+        OSMemoryBarrier();
+        
+        // write a complete event for every sample, other threads may still be recording
+        for(;i < head;i++) {
+            ProfileSample copy;
+            const ProfileSample* sample = &copy;
+            NSString* name;
+            
+            // written over while it was being read, it was about to fall out of the ring anyway
+            if (profileCopySample(thread, i, &copy) == NO) {
+                continue;
+            }
+            
+            name = profileEscape(sample->name);
+            
+            // counters are graphed by the trace viewer
+            if (sample->counter) {
+                [json appendFormat:@"%@{\"name\":\"%@\",\"ph\":\"C\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%g}}",
+                 first ? @"" : @",\n",
+                 name,
+                 thread->tid,
+                 profileTicksToMicroseconds(sample->start),
+                 sample->value];
+                
+                first = NO;
+                continue;
+            }
+            
+            // show what the scope was for
+            if (sample->detail != NULL) {
+                name = [NSString stringWithFormat:@"%@ %@", name, profileEscape(sample->detail)];
+            }
+            
+            [json appendFormat:@"%@{\"name\":\"%@\",\"cat\":\"%@\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+             first ? @"" : @",\n",
+             name,
+             profileEscape(sample->name),
+             thread->tid,
+             profileTicksToMicroseconds(sample->start),
+             profileTicksToMicroseconds(sample->end - sample->start)];
+            
+            first = NO;
+        }
+    }
+    
+    [json appendString:@"\n]}\n"];
+    
+    // save it
+    if ([json writeToFile:path atomically:YES encoding:NSUTF8StringEncoding error:nil] == NO) {
+        NSLog(@"Failed to write profile to %@\n", path);
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+@end
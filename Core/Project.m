@@ -6,6 +6,7 @@
 
 #import "Asset.h"
 #import "Project.h"
+#import "Texture.h"
 
 @implementation Project
 
@@ -69,6 +70,7 @@
             script_Method(@"load_assets", @selector(l_loadAssets:)),
             script_Method(@"unload_assets", @selector(l_unloadAssets:)),
             script_Method(@"is_load_complete", @selector(l_isLoadComplete:)),
+            script_Method(@"is_upload_complete", @selector(l_isUploadComplete:)),
             nil];
 }
 
@@ -229,6 +231,7 @@
         NSString* name;
         NSString* type;
         NSString* file;
+        Asset* asset;
         
         // get the name of the asset
         if ((name = [[elt attributeForName:@"name"] stringValue]) == nil) {
@@ -266,8 +269,14 @@
             continue;
         }
         
+        // create the asset
+        asset = [[[cls alloc] initWithName:name path:file] autorelease];
+        
+        // optionally keep the CPU copy of data after it's uploaded
+        [asset setKeepsData:[[[elt attributeForName:@"keep"] stringValue] boolValue]];
+        
         // add the asset to the list
-        [assets addObject:[[[cls alloc] initWithName:name path:file] autorelease]];
+        [assets addObject:asset];
     }
     
     // make sure something was actually loaded
@@ -450,4 +459,9 @@
     return lua_pushboolean(L, [m_lock condition] == 0), 1;
 }
 
+- (int)l_isUploadComplete:(lua_State*)L
+{
+    return lua_pushboolean(L, [m_lock condition] == 0 && [Texture pendingUploads] == 0), 1;
+}
+
 @end
@@ -0,0 +1,39 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import "Batch.h"
+
+@interface Renderer : NSObject
+{
+    NSOpenGLContext* m_context;
+    
+    // the frame waiting to be drawn (or being drawn)
+    BatchList* m_pending;
+    
+    // condition 1 while there's a pending frame (none to stop), 2 once the thread exits
+    NSConditionLock* m_lock;
+    
+    // false if frames are drawn when submitted
+    BOOL m_threaded;
+}
+
+// initialization methods
+- (id)initWithContext:(NSOpenGLContext*)context threaded:(BOOL)threaded;
+
+// hand off the recorded frame, waits for the previous frame to be drawn
+- (void)submit;
+
+// wait until every submitted frame has been drawn
+- (void)finish;
+
+// draw the last frame and wait for the render thread to exit
+- (void)stop;
+
+// true if drawing happens on the render thread
+- (BOOL)isThreaded;
+
+@end
@@ -0,0 +1,130 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import <OpenGL/OpenGL.h>
+#import "Renderer.h"
+
+@implementation Renderer
+
+- (id)initWithContext:(NSOpenGLContext*)context threaded:(BOOL)threaded
+{
+    if ((self = [super init]) == nil) {
+        return nil;
+    }
+    
+    // initialize members
+    m_context = [context retain];
+    m_pending = NULL;
+    m_lock = [[NSConditionLock alloc] initWithCondition:0];
+    m_threaded = threaded;
+    
+    // create the render thread
+    if (m_threaded) {
+        [NSThread detachNewThreadSelector:@selector(renderLoop)
+                                 toTarget:self
+                               withObject:nil];
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [m_context release];
+    [m_lock release];
+    [super dealloc];
+}
+
+- (BOOL)isThreaded
+{
+    return m_threaded;
+}
+
+- (void)drawFrame:(BatchList*)list
+{
+    CGLContextObj cgl = [m_context CGLContextObj];
+    
+    // the view may touch the context from the main thread
+    CGLLockContext(cgl);
+    {
+        [m_context makeCurrentContext];
+        
+        // replay the frame
+        batchDraw(list);
+        
+        // finish pending commands and present the backbuffer
+        glFlush();
+        [m_context flushBuffer];
+    }
+    CGLUnlockContext(cgl);
+}
+
+- (void)submit
+{
+    if (m_threaded == NO) {
+        [self drawFrame:batchSwap()];
+        return;
+    }
+    
+    // wait for the previous frame, then hand this one over
+    [m_lock lockWhenCondition:0];
+    {
+        m_pending = batchSwap();
+    }
+    [m_lock unlockWithCondition:1];
+}
+
+- (void)finish
+{
+    if (m_threaded) {
+        [m_lock lockWhenCondition:0];
+        [m_lock unlockWithCondition:0];
+    }
+}
+
+- (void)stop
+{
+    if (m_threaded == NO) {
+        return;
+    }
+    
+    // handing over no frame tells the thread to exit
+    [m_lock lockWhenCondition:0];
+    {
+        m_pending = NULL;
+    }
+    [m_lock unlockWithCondition:1];
+    
+    // join it
+    [m_lock lockWhenCondition:2];
+    [m_lock unlockWithCondition:2];
+    
+    m_threaded = NO;
+}
+
+- (void)renderLoop
+{
+    BOOL running = YES;
+    
+    while (running) {
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        {
+            [m_lock lockWhenCondition:1];
+            
+            if ((running = (m_pending != NULL))) {
+                [self drawFrame:m_pending];
+                
+                // done with it, it will be recorded into again
+                m_pending = NULL;
+            }
+            
+            [m_lock unlockWithCondition:running ? 0 : 2];
+        }
+        [pool release];
+    }
+}
+
+@end
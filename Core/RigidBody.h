@@ -13,5 +13,11 @@
      *       already present in the Actor to the World space. It also
      *       adds script functions to the actor.
      */
+    
+    // prefab settings, applied to the actor and its body when wired
+    float m_mass;
+    float m_inertia;
+    BOOL m_trigger;
+    BOOL m_kinematic;
 }
 @end
@@ -9,13 +9,28 @@
 
 @implementation RigidBody
 
+- (id)init
+{
+    if ((self = [super init]) == nil) {
+        return nil;
+    }
+    
+    // initialize members, the same as a new actor's
+    m_mass = 1.0f;
+    m_inertia = 1.0f;
+    m_trigger = NO;
+    m_kinematic = YES;
+    
+    return self;
+}
+
 + (NSArray*)properties
 {
     return [[NSArray arrayWithObjects:
-             prop_WIRE(@"mass", @selector(setMass:)),
-             prop_WIRE(@"interia", @selector(setInteria:)),
-             prop_WIRE(@"trigger", @selector(setTrigger:)),
-             prop_WIRE(@"kinematic", @selector(setKinematic:)),
+             prop_VALUE(@"mass", "m_mass", float, propertyParseFloat),
+             prop_VALUE(@"inertia", "m_inertia", float, propertyParseFloat),
+             prop_VALUE(@"trigger", "m_trigger", BOOL, propertyParseBool),
+             prop_VALUE(@"kinematic", "m_kinematic", BOOL, propertyParseBool),
              nil]
             arrayByAddingObjectsFromArray:[super properties]];
 }
@@ -35,24 +50,13 @@
             arrayByAddingObjectsFromArray:[super scriptMethods]];
 }
 
-- (void)setTrigger:(NSString*)value
-{
-    [m_actor setIsTrigger:[value boolValue]];
-}
-
-- (void)setKinematic:(NSString*)value
-{
-    [m_actor setIsKinematic:[value boolValue]];
-}
-
-- (void)setMass:(NSString*)value
+- (void)didWireProperties
 {
-    cpBodySetMass([m_actor body], [value floatValue]);
-}
-
-- (void)setInertia:(NSString*)value
-{
-    cpBodySetMoment([m_actor body], [value floatValue]);
+    [m_actor setIsTrigger:m_trigger];
+    [m_actor setIsKinematic:m_kinematic];
+    
+    cpBodySetMass([m_actor body], m_mass);
+    cpBodySetMoment([m_actor body], m_inertia);
 }
 
 - (void)enable
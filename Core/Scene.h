@@ -22,6 +22,10 @@
 
 // accessors
 - (Script*)script;
+- (NSArray*)layers;
+
+// snapshot actor transforms before a simulation tick
+- (void)saveTransforms;
 
 // frame stages
 - (void)start;
@@ -46,6 +46,16 @@
     return [[m_script retain] autorelease];
 }
 
+- (NSArray*)layers
+{
+    return [[m_layers retain] autorelease];
+}
+
+- (void)saveTransforms
+{
+    [m_layers makeObjectsPerformSelector:@selector(saveTransforms)];
+}
+
 - (void)start
 {
     // called for the initial state
@@ -122,6 +132,9 @@
         return lua_pushnil(L), 1;
     }
     
+    // optionally cache the layer's rendering
+    [layer setStatic:lua_toboolean(L, 3)];
+    
     // add the layer and resort all the layers
     [m_layers addObject:[layer autorelease]];
     [m_layers sortUsingSelector:@selector(orderWith:)];
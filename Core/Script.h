@@ -29,6 +29,9 @@
 {
 	lua_State* m_lua;
 	int m_ref;
+    
+    // script file loaded (used for profiling)
+    const char* m_file;
 }
 
 // allocator methods
@@ -56,11 +59,11 @@
 - (BOOL)loadScript:(NSString*)fileName withNamespace:(NSString*)name;
 - (BOOL)loadScript:(NSString*)fileName;
 
-// let an object register its namespace table
+// let an object register its namespace table, its methods are bound once per class
 - (void)registerObject:(id <ScriptInterface>)object withNamespace:(NSString*)name;
 - (void)registerObject:(id <ScriptInterface>)object withNamespace:(NSString*)name locked:(BOOL)locked;
 
-// register methods and constants with a namespace table
+// register methods and constants with a namespace table, shared by class and namespace
 - (void)registerMethods:(NSArray*)methods
               constants:(NSArray*)constants
               forObject:(id)object 
@@ -79,6 +82,9 @@
 // bind a value to the environment
 - (BOOL)bind:(id)value to:(NSString*)name;
 
+// true if the script defines a function
+- (BOOL)hasFunction:(const char*)func;
+
 // call a lua function in the script
 - (BOOL)call:(const char*)func;
 - (BOOL)call:(const char*)func withArgs:(int)n;
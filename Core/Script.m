@@ -4,6 +4,7 @@
 // All rights reserved.
 //
 
+#import "Profiler.h"
 #import "Script.h"
 
 #define CHECK_LUA_STACK
@@ -58,6 +59,170 @@ static const char* l_chunkReader(lua_State* L, void* userdata, size_t* size)
     return (const char*)buf;
 }
 
+// registry keys of the shared class bindings, a namespace's object and an environment's old __index
+static char scriptBindingsKey;
+static char scriptObjectKey;
+static char scriptIndexKey;
+
+static int l_readOnly(lua_State* L)
+{
+    lua_pushliteral(L, "Attempting to update a read-only table");
+    lua_error(L);
+    
+    return 0;
+}
+
+static int l_bindMethod(lua_State* L)
+{
+    id object;
+    SEL sel;
+    
+    // find the method in the class
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    
+    if (lua_isnil(L, -1)) {
+        return 1;
+    }
+    
+    sel = (SEL)lua_touserdata(L, -1);
+    
+    // the table holds its own object since the closure is shared
+    lua_pushlightuserdata(L, &scriptObjectKey);
+    lua_rawget(L, 1);
+    
+    object = (id)lua_touserdata(L, -1);
+    
+    // bind it the first time it's used and keep it in the table
+    lua_pushobjcfunction(L, object, sel);
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, 1);
+    
+    return 1;
+}
+
+static int l_lockedIndex(lua_State* L)
+{
+    id object;
+    SEL sel;
+    
+    // the proxy's environment caches its bound methods and constants, until then it's the method table
+    lua_getfenv(L, 1);
+    
+    if (lua_rawequal(L, 3, lua_upvalueindex(1)) == 0) {
+        lua_pushvalue(L, 2);
+        lua_rawget(L, 3);
+        
+        if (lua_isnil(L, -1) == 0) {
+            return 1;
+        }
+        
+        lua_pop(L, 1);
+    }
+    
+    // find the method in the class
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    
+    if (lua_isnil(L, -1)) {
+        return 1;
+    }
+    
+    sel = (SEL)lua_touserdata(L, -1);
+    object = *(id*)lua_touserdata(L, 1);
+    
+    // only proxies that have their methods used get a cache
+    if (lua_rawequal(L, 3, lua_upvalueindex(1))) {
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setfenv(L, 1);
+        lua_replace(L, 3);
+    }
+    
+    // bind it the first time it's used and keep it in the cache
+    lua_pushobjcfunction(L, object, sel);
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, 3);
+    
+    return 1;
+}
+
+static BOOL scriptBindEnvironment(lua_State* L, int env)
+{
+    id object;
+    
+    if (lua_getmetatable(L, env) == 0) {
+        return NO;
+    }
+    
+    // is there an object waiting to be bound?
+    lua_pushlightuserdata(L, &scriptObjectKey);
+    lua_rawget(L, -2);
+    
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 2);
+        return NO;
+    }
+    
+    object = (id)lua_touserdata(L, -1);
+    
+    // the class methods are the upvalue of the __index that's waiting
+    lua_pushliteral(L, "__index");
+    lua_rawget(L, -3);
+    lua_getupvalue(L, -1, 1);
+    lua_replace(L, -3);
+    lua_pop(L, 1);
+    
+    // bind every method the script hasn't defined itself
+    for(lua_pushnil(L);lua_next(L, -2);lua_pop(L, 1)) {
+        lua_pushvalue(L, -2);
+        lua_rawget(L, env);
+        
+        if (lua_isnil(L, -1)) {
+            lua_pushvalue(L, -3);
+            lua_pushobjcfunction(L, object, (SEL)lua_touserdata(L, -3));
+            lua_rawset(L, env);
+        }
+        
+        lua_pop(L, 1);
+    }
+    
+    lua_pop(L, 1);
+    
+    // put the old __index back, so lookups only walk tables again
+    lua_pushliteral(L, "__index");
+    lua_pushlightuserdata(L, &scriptIndexKey);
+    lua_rawget(L, -3);
+    lua_rawset(L, -3);
+    
+    lua_pushlightuserdata(L, &scriptObjectKey);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+    lua_pushlightuserdata(L, &scriptIndexKey);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+    
+    // remove the metatable
+    lua_pop(L, 1);
+    
+    return YES;
+}
+
+static int l_bindEnvironment(lua_State* L)
+{
+    if (scriptBindEnvironment(L, 1) == NO) {
+        return lua_pushnil(L), 1;
+    }
+    
+    // finish the lookup that missed
+    lua_settop(L, 2);
+    lua_gettable(L, 1);
+    
+    return 1;
+}
+
 @implementation Script
 
 - (id)initWithState:(lua_State*)L registryReference:(int)ref
@@ -69,6 +234,7 @@ static const char* l_chunkReader(lua_State* L, void* userdata, size_t* size)
 	// default members
 	m_ref = ref;
 	m_lua = L;
+    m_file = NULL;
 	
 	return self;
 }
@@ -257,6 +423,9 @@ static const char* l_chunkReader(lua_State* L, void* userdata, size_t* size)
         return FALSE;
     }
     
+    // remember where calls into this script go
+    m_file = profileIntern([fileName lastPathComponent]);
+    
     // create a new environment for the script
     lua_newtable(m_lua);
     lua_newtable(m_lua);
@@ -290,6 +459,9 @@ static const char* l_chunkReader(lua_State* L, void* userdata, size_t* size)
         return FALSE;
     }
     
+    // remember where calls into this script go
+    m_file = profileIntern([fileName lastPathComponent]);
+    
     // execute the function
 	if (lua_pcall(m_lua, 0, 0, 0) != 0) {
         return [self logError];
@@ -298,14 +470,6 @@ static const char* l_chunkReader(lua_State* L, void* userdata, size_t* size)
     return TRUE;
 }
 
-- (void)registerMethods:(NSArray*)methods forObject:(id)object
-{
-    for(ScriptMethod* method in methods) {
-        lua_pushobjcfunction(m_lua, object, method.sel);
-        lua_setfield(m_lua, -2, [method.name UTF8String]);
-    }
-}
-
 - (void)registerConstants:(NSArray*)constants
 {
     for(ScriptConstant* constant in constants) {
@@ -318,54 +482,187 @@ static const char* l_chunkReader(lua_State* L, void* userdata, size_t* size)
     }
 }
 
-- (void)registerObject:(id)object withNamespace:(NSString*)name
+- (void)pushBindingForKey:(NSString*)key object:(id)object methods:(NSArray*)methods
 {
-    NSArray* methods = nil;
-    NSArray* constants = nil;
+    const char* name = [key UTF8String];
+    
+    // the bindings live in the registry for as long as lua does
+    lua_pushlightuserdata(m_lua, &scriptBindingsKey);
+    lua_rawget(m_lua, LUA_REGISTRYINDEX);
+    
+    if (lua_isnil(m_lua, -1)) {
+        lua_pop(m_lua, 1);
+        lua_newtable(m_lua);
+        lua_pushlightuserdata(m_lua, &scriptBindingsKey);
+        lua_pushvalue(m_lua, -2);
+        lua_rawset(m_lua, LUA_REGISTRYINDEX);
+    }
+    
+    // reuse the binding if this class was registered before
+    lua_getfield(m_lua, -1, name);
+    
+    if (lua_isnil(m_lua, -1) == FALSE) {
+        lua_replace(m_lua, -2);
+        return;
+    }
+    
+    lua_pop(m_lua, 1);
     
-    // get the list of methods to register
-    if ([object respondsToSelector:@selector(scriptMethods)]) {
+    // only the first instance is asked for its methods
+    if (methods == nil && [object respondsToSelector:@selector(scriptMethods)]) {
         methods = [object scriptMethods];
     }
     
-    // get the list of constants to register
-    if ([object respondsToSelector:@selector(scriptConstants)]) {
-        constants = [object scriptConstants];
+    // { methods, metatable, environment __index, locked metatable }
+    lua_createtable(m_lua, 4, 0);
+    lua_newtable(m_lua);
+    
+    for(ScriptMethod* method in methods) {
+        lua_pushlightuserdata(m_lua, (void*)method.sel);
+        lua_setfield(m_lua, -2, [method.name UTF8String]);
     }
-
-    // register everything with the namespace
-    [self registerMethods:methods
-                constants:constants
-                forObject:object
-            withNamespace:name];
+    
+    // one closure binds the methods for every namespace table of the class
+    lua_newtable(m_lua);
+    lua_pushvalue(m_lua, -2);
+    lua_pushcclosure(m_lua, l_bindMethod, 1);
+    lua_setfield(m_lua, -2, "__index");
+    lua_rawseti(m_lua, -3, 2);
+    
+    // one binds them into every environment of the class
+    lua_pushvalue(m_lua, -1);
+    lua_pushcclosure(m_lua, l_bindEnvironment, 1);
+    lua_rawseti(m_lua, -3, 3);
+    
+    // and one looks them up for every locked proxy, which can't be written to
+    lua_newtable(m_lua);
+    lua_pushvalue(m_lua, -2);
+    lua_pushcclosure(m_lua, l_lockedIndex, 1);
+    lua_setfield(m_lua, -2, "__index");
+    lua_pushcfunction(m_lua, l_readOnly);
+    lua_setfield(m_lua, -2, "__newindex");
+    lua_rawseti(m_lua, -3, 4);
+    lua_rawseti(m_lua, -2, 1);
+    
+    // cache the binding
+    lua_pushvalue(m_lua, -1);
+    lua_setfield(m_lua, -3, name);
+    lua_replace(m_lua, -2);
 }
 
-- (void)registerObject:(id <ScriptInterface>)object 
-         withNamespace:(NSString*)name
-                locked:(BOOL)locked
+- (void)bindObject:(id)object
+            forKey:(NSString*)key
+           methods:(NSArray*)methods
+         constants:(NSArray*)constants
+     withNamespace:(NSString*)name
+            locked:(BOOL)locked
 {
-    [self registerObject:object withNamespace:name];
+    int env;
+    
+    [self pushEnv];
+    [self pushBindingForKey:key object:object methods:methods];
     
-    if (locked) {
-        [self pushEnv];
+    env = lua_gettop(m_lua) - 1;
+    
+    if (name == nil) {
+        // an object already waiting on this environment is bound first
+        scriptBindEnvironment(m_lua, env);
         
-        // create a proxy table
-        lua_newtable(m_lua);
+        if (lua_getmetatable(m_lua, env) == 0) {
+            lua_newtable(m_lua);
+            lua_pushvalue(m_lua, -1);
+            lua_setmetatable(m_lua, env);
+        }
+        
+        // methods are bound the first time a lookup misses, then the old __index is put back
+        lua_pushlightuserdata(m_lua, &scriptIndexKey);
+        lua_getfield(m_lua, -2, "__index");
+        lua_rawset(m_lua, -3);
+        lua_pushlightuserdata(m_lua, &scriptObjectKey);
+        lua_pushlightuserdata(m_lua, object);
+        lua_rawset(m_lua, -3);
+        lua_rawgeti(m_lua, -2, 3);
+        lua_setfield(m_lua, -2, "__index");
+        
+        // remove the metatable and binding
+        lua_pop(m_lua, 2);
+        
+        // register the constants
+        if (constants != nil) {
+            [self registerConstants:constants];
+        }
+    } else if (locked) {
+        id* proxy = (id*)lua_newuserdata(m_lua, sizeof(id));
+        
+        // a userdata proxy holds nothing scripts can replace
+        *proxy = object;
+        
+        // constants go in the cache up front, otherwise it's made when a method is used
+        if (constants != nil) {
+            lua_newtable(m_lua);
+            [self registerConstants:constants];
+        } else {
+            lua_rawgeti(m_lua, -2, 1);
+        }
+        
+        lua_setfenv(m_lua, -2);
+        
+        // share the locked metatable of the class
+        lua_rawgeti(m_lua, -2, 4);
+        lua_setmetatable(m_lua, -2);
+        
+        // assign the namespace and remove the binding
+        lua_setfield(m_lua, env, [name UTF8String]);
+        lua_pop(m_lua, 1);
+    } else {
         lua_newtable(m_lua);
         
-        // we're going to wrap this environment
-        lua_getfield(m_lua, -3, [name UTF8String]);
+        // methods are bound into this table when first used
+        lua_pushlightuserdata(m_lua, &scriptObjectKey);
+        lua_pushlightuserdata(m_lua, object);
+        lua_rawset(m_lua, -3);
         
-        // create a meta-table and assign it
-        lua_setfield(m_lua, -2, "__index");
-        lua_pushobjcfunction(m_lua, self, @selector(l_readOnly:));
-        lua_setfield(m_lua, -2, "__newindex");
+        // register the constants
+        if (constants != nil) {
+            [self registerConstants:constants];
+        }
+        
+        // share the metatable of the class
+        lua_rawgeti(m_lua, -2, 2);
         lua_setmetatable(m_lua, -2);
         
-        // now, write the read-only table back
-        lua_setfield(m_lua, -2, [name UTF8String]);
+        // assign the namespace and remove the binding
+        lua_setfield(m_lua, env, [name UTF8String]);
         lua_pop(m_lua, 1);
     }
+    
+    // remove the environment table
+    lua_pop(m_lua, 1);
+}
+
+- (void)registerObject:(id)object withNamespace:(NSString*)name
+{
+    [self registerObject:object withNamespace:name locked:NO];
+}
+
+- (void)registerObject:(id <ScriptInterface>)object 
+         withNamespace:(NSString*)name
+                locked:(BOOL)locked
+{
+    NSArray* constants = nil;
+    
+    // get the list of constants to register
+    if ([object respondsToSelector:@selector(scriptConstants)]) {
+        constants = [object scriptConstants];
+    }
+    
+    // methods are the same for every instance of a class
+    [self bindObject:object
+              forKey:NSStringFromClass([object class])
+             methods:nil
+           constants:constants
+       withNamespace:name
+              locked:locked];
 }
 
 - (void)registerMethods:(NSArray*)methods
@@ -373,30 +670,19 @@ static const char* l_chunkReader(lua_State* L, void* userdata, size_t* size)
               forObject:(id)object
           withNamespace:(NSString*)name
 {
-    [self pushEnv];
+    NSString* key = NSStringFromClass([object class]);
     
-    // create a new table for this object if named
+    // explicit method lists are shared by class and namespace
     if (name != nil) {
-        lua_newtable(m_lua);
+        key = [key stringByAppendingFormat:@".%@", name];
     }
     
-    // register the methods with the table
-    if (methods != nil) {
-        [self registerMethods:methods forObject:object];
-    }
-    
-    // register the constants
-    if (constants != nil) {
-        [self registerConstants:constants];
-    }
-    
-    // assign the namespace
-    if (name != nil) {
-        lua_setfield(m_lua, -2, [name UTF8String]);
-    }
-    
-    // remove the environment table
-    lua_pop(m_lua, 1);
+    [self bindObject:object
+              forKey:key
+             methods:methods
+           constants:constants
+       withNamespace:name
+              locked:NO];
 }
 
 + (BOOL)push:(id)value to:(lua_State*)L
@@ -521,6 +807,23 @@ static const char* l_chunkReader(lua_State* L, void* userdata, size_t* size)
     return TRUE;
 }
 
+- (BOOL)hasFunction:(const char*)func
+{
+    BOOL defined;
+    
+    // only functions the script defined itself, lookups that miss could bind methods
+    [self pushEnv];
+    lua_pushstring(m_lua, func);
+    lua_rawget(m_lua, -2);
+    
+    defined = lua_isfunction(m_lua, -1);
+    
+    // pop the function and the environment
+    lua_pop(m_lua, 2);
+    
+    return defined;
+}
+
 - (BOOL)call:(const char*)func
 {
     return [self call:func withArgs:0];
@@ -551,9 +854,13 @@ static const char* l_chunkReader(lua_State* L, void* userdata, size_t* size)
         }
         
         // call the function
-        if ((result = (lua_pcall(m_lua, n, 0, 0) == 0)) == FALSE) {
-            [self logError];
+        profile_BEGIN(func, m_file);
+        {
+            if ((result = (lua_pcall(m_lua, n, 0, 0) == 0)) == FALSE) {
+                [self logError];
+            }
         }
+        profile_END();
 	} else {
         // remove the function
         lua_pop(m_lua, 1);
@@ -590,16 +897,4 @@ static const char* l_chunkReader(lua_State* L, void* userdata, size_t* size)
     return FALSE;
 }
 
-/*
- * LUA INTERFACE
- */
-
-- (int)l_readOnly:(lua_State*)L
-{
-    lua_pushliteral(L, "Attempting to update a read-only table");
-    lua_error(L);
-    
-    return 0;
-}
-
 @end
@@ -27,11 +27,11 @@
 + (NSArray*)properties
 {
     return [[NSArray arrayWithObjects:
-             prop_WIRE(@"radius", @selector(setRadius:)),
-             prop_WIRE(@"x1", @selector(setX1:)), 
-             prop_WIRE(@"y1", @selector(setY1:)), 
-             prop_WIRE(@"x2", @selector(setX2:)), 
-             prop_WIRE(@"y2", @selector(setY2:)), 
+             prop_VALUE(@"radius", "m_radius", float, propertyParseFloat),
+             prop_FIELD(@"x1", "m_a", cpVect, x, propertyParseReal(cpFloat)),
+             prop_FIELD(@"y1", "m_a", cpVect, y, propertyParseReal(cpFloat)),
+             prop_FIELD(@"x2", "m_b", cpVect, x, propertyParseReal(cpFloat)),
+             prop_FIELD(@"y2", "m_b", cpVect, y, propertyParseReal(cpFloat)),
              nil]
             arrayByAddingObjectsFromArray:[super properties]];
 }
@@ -61,31 +61,6 @@
     return m_b.y;
 }
 
-- (void)setRadius:(NSString*)value
-{
-    m_radius = [value floatValue];
-}
-
-- (void)setX1:(NSString*)value
-{
-    m_a.x = [value floatValue];
-}
-
-- (void)setX2:(NSString*)value
-{
-    m_b.x = [value floatValue];
-}
-
-- (void)setY1:(NSString*)value
-{
-    m_a.y = [value floatValue];
-}
-
-- (void)setY2:(NSString*)value
-{
-    m_b.y = [value floatValue];
-}
-
 - (cpShape*)createShape
 {
     return cpSegmentShapeNew([m_actor body], m_a, m_b, m_radius);
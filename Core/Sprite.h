@@ -26,6 +26,9 @@
     float m_rgba[4];
     float m_scale;
     
+    // draw order within the layer
+    int m_depth;
+    
     // the center of the sprite - around which it will rotate
     NSPoint m_center;
 }
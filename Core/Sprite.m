@@ -5,10 +5,10 @@
 //
 
 #import "Atlas.h"
+#import "Batch.h"
 #import "Engine.h"
 #import "Sprite.h"
 #import "RigidBody.h"
-#import "Scanners.h"
 
 @implementation Sprite
 
@@ -19,6 +19,13 @@
     }
     
     // initialize members
+    [self reset];
+    
+    return self;
+}
+
+- (void)reset
+{
     m_atlas = nil;
     m_frame = -1UL;
     m_center = NSMakePoint(0.0f, 0.0f);
@@ -27,19 +34,20 @@
     m_rgba[2] = 1.0f;
     m_rgba[3] = 1.0f;
     m_scale = 1.0f;
+    m_depth = 0;
     m_anim = NULL;
-    
-    return self;
+    m_duration = 0.0f;
 }
 
 + (NSArray*)properties
 {
     return [[NSArray arrayWithObjects:
-             prop_WIRE(@"atlas", @selector(setAtlas:)),
-             prop_WIRE(@"frame", @selector(setFrame:)),
-             prop_WIRE(@"anim", @selector(playAnim:)),
-             prop_WIRE(@"color", @selector(setColor:)),
-             prop_WIRE(@"scale", @selector(setScale:)),
+             prop_ASSET(@"atlas", "m_atlas", Atlas),
+             prop_FRAME(@"frame", "m_frame"),
+             prop_ANIM(@"anim", "m_anim"),
+             prop_VALUE(@"color", "m_rgba", float[4], propertyParseColor),
+             prop_VALUE(@"scale", "m_scale", float, propertyParseFloat),
+             prop_VALUE(@"depth", "m_depth", int, propertyParseInt),
              nil]
             arrayByAddingObjectsFromArray:[super properties]];
 }
@@ -52,15 +60,12 @@
              script_Method(@"color", @selector(l_color:)),
              script_Method(@"set_color", @selector(l_setColorTint:)),
              script_Method(@"is_anim_playing", @selector(l_isAnimPlaying:)),
+             script_Method(@"is_culled", @selector(l_isCulled:)),
+             script_Method(@"set_depth", @selector(l_setDepth:)),
              nil]
             arrayByAddingObjectsFromArray:[super scriptMethods]];
 }
 
-- (void)setAtlas:(NSString*)value
-{
-    m_atlas = [theProject assetWithName:value type:[Atlas class]];
-}
-
 - (void)setFrame:(NSString*)value
 {
     m_frame = [m_atlas frameNamed:value];
@@ -77,25 +82,32 @@
     return m_anim != NULL;
 }
 
-- (void)setColor:(NSString*)value
-{
-    NSColor* color = [value colorValue];
-    
-    // assign the color values
-    m_rgba[0] = [color redComponent];
-    m_rgba[1] = [color greenComponent];
-    m_rgba[2] = [color blueComponent];
-    m_rgba[3] = [color alphaComponent];
-}
-
-- (void)setScale:(NSString*)value
+- (BOOL)isCulled
 {
-    m_scale = [value floatValue];
+    return [m_actor isVisible] == NO || [m_actor isCulled];
 }
 
-- (BOOL)isCulled
+- (BOOL)bounds:(NSRect*)rect
 {
-    return FALSE;
+    NSSize size;
+    
+    // nothing is rendered without a frame
+    if (m_frame == -1UL) {
+        return NO;
+    }
+    
+    size = [[m_atlas texture] sizeOfFrame:m_frame];
+    
+    // sprite frames are centered on the actor and scaled
+    size.width *= m_scale;
+    size.height *= m_scale;
+    
+    *rect = [m_actor transformRect:NSMakeRect(-size.width / 2, 
+                                              -size.height / 2, 
+                                              size.width, 
+                                              size.height)];
+    
+    return YES;
 }
 
 - (void)advance
@@ -122,17 +134,21 @@
 
 - (void)render
 {
-    glColor4fv(m_rgba);
+    batchSetColorv(m_rgba);
+    batchSetDepth(m_depth);
     
     // temporarily store state
-    glPushMatrix();
+    batchPushMatrix();
     {
-        glScalef(m_scale, m_scale, 1.0f);
+        batchScale(m_scale, m_scale);
     
         // render the curren frame
         [m_atlas render:m_frame];
     }
-    glPopMatrix();
+    batchPopMatrix();
+    
+    // everything else draws at the default depth
+    batchSetDepth(0);
 }
 
 /*
@@ -203,4 +219,16 @@
     return lua_pushboolean(L, [self isAnimPlaying]), 1;
 }
 
+- (int)l_isCulled:(lua_State*)L
+{
+    return lua_pushboolean(L, [self isCulled]), 1;
+}
+
+- (int)l_setDepth:(lua_State*)L
+{
+    m_depth = (int)lua_tointeger(L, 1);
+    
+    return 0;
+}
+
 @end
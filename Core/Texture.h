@@ -8,13 +8,34 @@
 #import <OpenGL/gl.h>
 #import "Asset.h"
 
+typedef struct {
+	GLfloat x, y;
+	GLfloat u, v;
+} Vert;
+
+typedef struct {
+	Vert v[4];
+} Quad;
+
 @interface Texture : Asset <AssetInterface>
 {
 	GLubyte* m_image;
 	
+	// memory-mapped cooked texture file
+	NSData* m_mapped;
+	
+	// pixels to upload (either the image or in the mapped file) and their format
+	const GLvoid* m_pixels;
+	GLenum m_internalFormat;
+	GLenum m_format;
+	GLenum m_type;
+	
 	// compiled frame quads
 	NSMutableArray* m_frames;
 	
+	// the frame quads for the sprite shader, built when first drawn
+	struct BatchFrames* m_frameTable;
+	
 	// original size of the texture
 	int m_orgWidth;
 	int m_orgHeight;
@@ -26,14 +47,67 @@
 	
 	// opengl data
 	GLuint m_tex;
+	
+	// true while waiting in the upload queue
+	BOOL m_queued;
+	
+	// file name of the page if this is a shared texture page
+	NSString* m_page;
+	
+	// page this texture is a region of, and where the region is in the page
+	Texture* m_parent;
+	NSPoint m_origin;
 }
 
 // allocator methods
 + (Texture*)textureFromImage:(NSImage*)image;
++ (Texture*)textureFromFile:(NSString*)fileName;
+
+// load the page table written by the atlas packer
++ (BOOL)loadPageTable:(NSString*)fileName;
+
+// an image file, or a region of the shared page it was packed into
++ (Texture*)textureWithContentsOfFile:(NSString*)fileName;
+
+// a region of another texture, sharing its OpenGL texture
+- (id)initWithPage:(Texture*)page region:(NSRect)rect;
+
+// upload queued textures until the byte budget is used (main thread, GL context current)
++ (void)processUploads:(NSUInteger)budget;
+
+// bytes of pixels uploaded to OpenGL and not yet deleted
++ (NSUInteger)residentBytes;
+
+// number of textures still waiting to be uploaded
++ (NSUInteger)pendingUploads;
+
+// empty the upload queue without uploading anything (headless runs)
++ (void)discardUploads;
+
+// add to the upload queue, instead of uploading the first time it's rendered
+- (void)queueUpload;
+
+// create the OpenGL texture now
+- (void)upload;
+
+// true once the OpenGL texture exists
+- (BOOL)isUploaded;
+
+// free the CPU copy of the pixels
+- (void)releasePixels;
+
+// the CPU copy of the pixels, NULL once uploaded unless the asset keeps data
+- (const GLvoid*)pixels;
 
 // so other systems can create their own textures
 - (BOOL)loadFromImage:(NSImage*)image;
 
+// load a cooked .gbtex file (see TextureFile.h) without decoding or copying
+- (BOOL)loadFromCookedData:(NSData*)data;
+
+// load the cooked version of an image file if there is one, otherwise the image
+- (BOOL)loadFromFile:(NSString*)fileName;
+
 // returns YES if this texture is valid and able to be used
 - (BOOL)isValid;
 
@@ -49,6 +123,16 @@
                             size:(NSSize)size 
                              pad:(int)pad; 
 
+// the OpenGL texture, created the first time it's needed
+- (GLuint)handle;
+
+// the vertex and texcoord quad for a frame (NULL if invalid)
+- (const Quad*)quadForFrame:(unsigned long)frame;
+
+// every frame's quad for the sprite shader (NULL when not instancing)
+- (struct BatchFrames*)frameTable;
+- (void)releaseFrameTable;
+
 // rendering functions
 - (void)render;
 - (void)render:(unsigned long)frame;
@@ -4,9 +4,12 @@
 // All rights reserved.
 //
 
+#import "Batch.h"
 #import "Display.h"
 #import "Engine.h"
+#import "Profiler.h"
 #import "Texture.h"
+#import "TextureFile.h"
 
 // simple macro to find the next power of two for textures
 #define NEXT_POW_2(n)   \
@@ -20,14 +23,17 @@
         n++;            \
     } while(0)
 
-typedef struct {
-	GLfloat x, y;
-	GLfloat u, v;
-} Vert;
+// packed image file -> page file and origin within the page
+static NSMutableDictionary* pageImages = nil;
 
-typedef struct {
-	Vert v[4];
-} Quad;
+// page file -> loaded page texture (not retained, removed on dealloc)
+static NSMutableDictionary* loadedPages = nil;
+
+// textures waiting to be uploaded to OpenGL
+static NSMutableArray* uploadQueue = nil;
+
+// pixels owned by OpenGL
+static NSUInteger residentBytes = 0;
 
 @implementation Texture
 
@@ -43,6 +49,115 @@ typedef struct {
     return texture;
 }
 
++ (Texture*)textureFromFile:(NSString*)fileName
+{
+    Texture* texture = [[[Texture alloc] init] autorelease];
+    
+    // attempt to create the texture
+    if ([texture loadFromFile:fileName] == FALSE) {
+        NSLog(@"Invalid texture %@\n", fileName);
+        return nil;
+    }
+    
+    return texture;
+}
+
++ (BOOL)loadPageTable:(NSString*)fileName
+{
+    NSXMLDocument* doc;
+    
+    // parse the page table
+    if ((doc = [theProject xmlDocumentWithContentsOfPath:fileName]) == nil) {
+        return FALSE;
+    }
+    
+    @synchronized(self) {
+        if (pageImages == nil) {
+            pageImages = [[NSMutableDictionary alloc] init];
+            loadedPages = [[NSMutableDictionary alloc] init];
+        }
+        
+        // every page lists the images that were packed into it
+        for(NSXMLElement* page in [[doc rootElement] elementsForName:@"page"]) {
+            NSString* pageFileName;
+            
+            // get the page image
+            if ((pageFileName = [[page attributeForName:@"texture"] stringValue]) == nil) {
+                NSLog(@"Missing texture attribute for page in %@\n", fileName);
+                continue;
+            }
+            
+            for(NSXMLElement* image in [page elementsForName:@"image"]) {
+                NSString* file;
+                NSString* x;
+                NSString* y;
+                NSString* w;
+                NSString* h;
+                
+                // get the original image file name
+                if ((file = [[image attributeForName:@"file"] stringValue]) == nil) {
+                    NSLog(@"Missing file attribute for image in %@\n", fileName);
+                    continue;
+                }
+                
+                // get the top-left and size of the image in the page
+                if ((x = [[image attributeForName:@"x"] stringValue]) == nil ||
+                    (y = [[image attributeForName:@"y"] stringValue]) == nil ||
+                    (w = [[image attributeForName:@"w"] stringValue]) == nil ||
+                    (h = [[image attributeForName:@"h"] stringValue]) == nil) {
+                    NSLog(@"Missing region for image %@ in %@\n", file, fileName);
+                    continue;
+                }
+                
+                // map the image to its page
+                [pageImages setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                       pageFileName, @"page",
+                                       [NSValue valueWithRect:NSMakeRect([x intValue], 
+                                                                         [y intValue], 
+                                                                         [w intValue], 
+                                                                         [h intValue])], @"region",
+                                       nil]
+                               forKey:file];
+            }
+        }
+    }
+    
+    return TRUE;
+}
+
++ (Texture*)textureWithContentsOfFile:(NSString*)fileName
+{
+    NSDictionary* image;
+    NSString* pageFileName;
+    Texture* page;
+    
+    @synchronized(self) {
+        if ((image = [pageImages objectForKey:fileName]) != nil) {
+            pageFileName = [image objectForKey:@"page"];
+            
+            // share the page if something already loaded it
+            if ((page = [[loadedPages objectForKey:pageFileName] pointerValue]) == nil) {
+                if ((page = [Texture textureFromFile:pageFileName]) == nil) {
+                    return nil;
+                }
+                
+                // remember the page until it's released
+                page->m_page = [pageFileName copy];
+                
+                // add it to the cache
+                [loadedPages setObject:[NSValue valueWithPointer:page] 
+                                forKey:pageFileName];
+            }
+            
+            // the image is a region of the page with its own frames
+            return [[[Texture alloc] initWithPage:page 
+                                           region:[[image objectForKey:@"region"] rectValue]] autorelease];
+        }
+    }
+    
+    return [Texture textureFromFile:fileName];
+}
+
 - (id)init
 {
     if ((self = [super init]) == nil) {
@@ -53,10 +168,61 @@ typedef struct {
     m_frames = [[NSMutableArray alloc] initWithCapacity:1];
     m_tex = 0;
     m_image = NULL;
+    m_mapped = nil;
+    m_pixels = NULL;
+    m_internalFormat = GL_RGBA;
+    m_format = GL_RGBA;
+    m_type = GL_UNSIGNED_BYTE;
+    m_page = nil;
+    m_queued = NO;
+    m_parent = nil;
+    m_origin = NSMakePoint(0.0f, 0.0f);
     
     return self;
 }
 
+- (id)initWithPage:(Texture*)page region:(NSRect)rect
+{
+    if ((self = [self init]) == nil) {
+        return nil;
+    }
+    
+    // share the page's pixels and OpenGL texture
+    m_parent = [page retain];
+    m_origin = rect.origin;
+    
+    // the region is the original image, but texture coordinates span the page
+    m_orgWidth = rect.size.width;
+    m_orgHeight = rect.size.height;
+    m_width = page->m_width;
+    m_height = page->m_height;
+    m_pitch = page->m_pitch;
+    
+    // frame 0 is the entire region, just like a texture loaded from an image
+    [self addFrame:NSMakeRect(0.0f, 0.0f, m_orgWidth, m_orgHeight)];
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    if (m_page != nil) {
+        @synchronized([Texture class]) {
+            [loadedPages removeObjectForKey:m_page];
+        }
+        
+        [m_page release];
+    }
+    
+    [m_parent release];
+    [m_frames release];
+    
+    // the asset unloads the image, texture and frame table
+    m_frames = nil;
+    
+    [super dealloc];
+}
+
 - (BOOL)loadFromImage:(NSImage*)image
 {
 	CGContextRef context;
@@ -78,6 +244,7 @@ typedef struct {
 	
 	// allocate enough memory to hold the destination image
 	m_image = (GLubyte*)calloc(1, m_height * m_pitch);
+	m_pixels = m_image;
 	
 	// get the current alpha settings for the image
 	colorSpace = CGColorSpaceCreateDeviceRGB();
@@ -117,12 +284,113 @@ typedef struct {
     return TRUE;
 }
 
-- (BOOL)loadFromDisk
+- (BOOL)loadFromCookedData:(NSData*)data
 {
+    const GBTexHeader* header = (const GBTexHeader*)[data bytes];
+    uint64_t size;
+    
+    // validate the header
+    if ([data length] < sizeof(GBTexHeader) || 
+        memcmp(header->magic, "GBTX", 4) != 0 || 
+        header->version != GBTEX_VERSION) {
+        NSLog(@"Invalid cooked texture header\n");
+        return FALSE;
+    }
+    
+    // pick the matching OpenGL format
+    switch (header->format) {
+        case GBTEX_RGBA8888:
+            m_internalFormat = GL_RGBA;
+            m_format = GL_RGBA;
+            m_type = GL_UNSIGNED_BYTE;
+            break;
+        case GBTEX_RGBA4444:
+            m_internalFormat = GL_RGBA4;
+            m_format = GL_RGBA;
+            m_type = GL_UNSIGNED_SHORT_4_4_4_4;
+            break;
+        case GBTEX_RGB565:
+            m_internalFormat = GL_RGB;
+            m_format = GL_RGB;
+            m_type = GL_UNSIGNED_SHORT_5_6_5;
+            break;
+        default:
+            NSLog(@"Unknown cooked texture format %u\n", header->format);
+            return FALSE;
+    }
+    
+    // the image has to fit in the texture
+    if (header->width == 0 || header->height == 0 ||
+        header->texWidth < header->width ||
+        header->texHeight < header->height) {
+        NSLog(@"Invalid cooked texture size %ux%u in %ux%u\n", header->width, header->height, header->texWidth, header->texHeight);
+        return FALSE;
+    }
+    
+    // make sure all the pixels are there
+    m_pitch = header->texWidth * gbtexPixelSize(header->format);
+    size = (uint64_t)header->texHeight * m_pitch;
+    
+    if ((uint64_t)header->offset + size > [data length]) {
+        NSLog(@"Truncated cooked texture\n");
+        return FALSE;
+    }
+    
+    m_orgWidth = header->width;
+    m_orgHeight = header->height;
+    m_width = header->texWidth;
+    m_height = header->texHeight;
+    
+    // upload straight out of the mapped file
+    m_mapped = [data retain];
+    m_pixels = (const GLubyte*)[data bytes] + header->offset;
+    
+    // add a single frame (0) that is the entire texture
+    [self addFrame:NSMakeRect(0.0f, 0.0f, m_orgWidth, m_orgHeight)];
+    
+    return TRUE;
+}
+
+- (BOOL)loadFromFile:(NSString*)fileName
+{
+    NSFileManager* files = [NSFileManager defaultManager];
+    NSString* cooked;
+    NSString* source;
+    NSString* path;
+    NSDate* cookedDate;
+    NSDate* sourceDate;
     NSData* data;
     NSImage* image;
     
-    if ((data = [theProject dataWithContentsOfFile:[self path]]) == nil) {
+    // prefer a cooked version of the image
+    cooked = [[fileName stringByDeletingPathExtension] stringByAppendingPathExtension:@GBTEX_EXTENSION];
+    
+    if ((path = [theProject pathForResource:cooked ofType:nil]) != nil) {
+        cookedDate = [[files attributesOfItemAtPath:path error:nil] fileModificationDate];
+        
+        // an image saved since it was cooked wins
+        if ((source = [theProject pathForResource:fileName ofType:nil]) != nil) {
+            sourceDate = [[files attributesOfItemAtPath:source error:nil] fileModificationDate];
+        } else {
+            sourceDate = nil;
+        }
+        
+        if (cookedDate != nil && sourceDate != nil && [cookedDate compare:sourceDate] == NSOrderedAscending) {
+            NSLog(@"Cooked texture %@ is older than %@, loading the image\n", cooked, fileName);
+        } else {
+            // pages of the file are only read when the texture is uploaded
+            data = [NSData dataWithContentsOfFile:path
+                                          options:NSDataReadingMappedAlways
+                                            error:nil];
+            
+            // a bad cooked file falls back to the image
+            if (data != nil && [self loadFromCookedData:data]) {
+                return TRUE;
+            }
+        }
+    }
+    
+    if ((data = [theProject dataWithContentsOfFile:fileName]) == nil) {
         return FALSE;
     }
     
@@ -133,16 +401,32 @@ typedef struct {
     return [self loadFromImage:[image autorelease]];
 }
 
+- (BOOL)loadFromDisk
+{
+    if ([self loadFromFile:[self path]] == FALSE) {
+        return FALSE;
+    }
+    
+    // stream it to OpenGL over the next few frames
+    [self queueUpload];
+    
+    return TRUE;
+}
+
 - (BOOL)unloadFromMemory
 {
     [m_frames removeAllObjects];
+    [self releaseFrameTable];
     
-	if (m_image) {
-		free(m_image);
-	}
+	[self releasePixels];
 	
 	if (m_tex > 0) {
 		glDeleteTextures(1, &m_tex);
+		m_tex = 0;
+		
+		@synchronized([Texture class]) {
+			residentBytes -= m_pitch * m_height;
+		}
 	}
     
     return TRUE;
@@ -150,6 +434,10 @@ typedef struct {
 
 - (BOOL)isValid
 {
+	if (m_parent != nil) {
+		return [m_parent isValid];
+	}
+	
 	return m_tex > 0;
 }
 
@@ -162,14 +450,19 @@ typedef struct {
 {
 	Quad quad;
 	
+	// regions of a page are offset into it and flipped by the page's height
+	float x = m_origin.x + rect.origin.x;
+	float y = m_origin.y + rect.origin.y;
+	float h = (m_parent != nil) ? m_parent->m_orgHeight : m_orgHeight;
+	
 	// in cocoa, coordinates are from the lower-left corner, we want top-left
-	float y0 = m_orgHeight - rect.origin.y;
-	float y1 = m_orgHeight - rect.origin.y - rect.size.height;
+	float y0 = h - y;
+	float y1 = h - y - rect.size.height;
 	
 	// calculate the uv coordinates from the extended context
-	float u0 = (0.5f + rect.origin.x) / m_width;
+	float u0 = (0.5f + x) / m_width;
 	float v0 = (0.5f + y0) / m_height;
-	float u1 = (0.5f + rect.origin.x + rect.size.width) / m_width;
+	float u1 = (0.5f + x + rect.size.width) / m_width;
 	float v1 = (0.5f + y1) / m_height;
 	
 	// texture coordinates
@@ -192,6 +485,11 @@ typedef struct {
 	// add the frame to the list for the sheet
 	[m_frames addObject:[NSData dataWithBytes:&quad length:sizeof(Quad)]];
 	
+	// written into the frame table if it has room, otherwise it's rebuilt larger
+	if (m_frameTable != NULL && batchAppendFrames(m_frameTable, &quad, (unsigned int)[m_frames count] - 1, 1) == NO) {
+		[self releaseFrameTable];
+	}
+	
 	// return the frame index
 	return [m_frames count] - 1;
 }
@@ -229,50 +527,208 @@ typedef struct {
     [self render:0];
 }
 
-- (void)render:(unsigned long)frame
++ (void)processUploads:(NSUInteger)budget
 {
-    const Quad* quad;
+    NSUInteger bytes = 0;
+    
+    profile_BEGIN("Texture uploads", NULL);
+    
+    // always make progress, even if a single texture is over budget
+    while (bytes < budget) {
+        Texture* texture;
+        
+        @synchronized(self) {
+            if ([uploadQueue count] == 0) {
+                break;
+            }
+            
+            // pop the next texture
+            texture = [[[uploadQueue objectAtIndex:0] retain] autorelease];
+            texture->m_queued = NO;
+            
+            [uploadQueue removeObjectAtIndex:0];
+        }
+        
+        // it may have already been rendered (and uploaded) or unloaded
+        if (texture->m_tex == 0 && texture->m_pixels != NULL) {
+            bytes += texture->m_pitch * texture->m_height;
+            
+            [texture upload];
+        }
+    }
+    
+    profile_END();
+}
+
++ (NSUInteger)pendingUploads
+{
+    @synchronized(self) {
+        return [uploadQueue count];
+    }
+}
+
++ (void)discardUploads
+{
+    @synchronized(self) {
+        for(Texture* texture in uploadQueue) {
+            texture->m_queued = NO;
+        }
+        
+        [uploadQueue removeAllObjects];
+    }
+}
+
++ (NSUInteger)residentBytes
+{
+    // the loader thread may unload textures while the main thread uploads
+    @synchronized([Texture class]) {
+        return residentBytes;
+    }
+}
+
+- (void)queueUpload
+{
+    if (m_parent != nil) {
+        [m_parent setKeepsData:[m_parent keepsData] || m_keepsData];
+        [m_parent queueUpload];
+        return;
+    }
+    
+    // a headless run never draws, so nothing would take textures off the queue
+    if ([theEngine isHeadless]) {
+        return;
+    }
+    
+    @synchronized([Texture class]) {
+        if (uploadQueue == nil) {
+            uploadQueue = [[NSMutableArray alloc] init];
+        }
+        
+        // only queue once
+        if (m_tex == 0 && m_queued == NO) {
+            m_queued = YES;
+            
+            [uploadQueue addObject:self];
+        }
+    }
+}
+
+- (BOOL)isUploaded
+{
+    return [self isValid];
+}
+
+- (const GLvoid*)pixels
+{
+    return (m_parent != nil) ? [m_parent pixels] : m_pixels;
+}
+
+- (void)releasePixels
+{
+	if (m_image) {
+		free(m_image);
+		m_image = NULL;
+	}
+	
+	// unmap the cooked file
+	[m_mapped release];
+	m_mapped = nil;
+	m_pixels = NULL;
+}
+
+- (void)upload
+{
+    glGenTextures(1, &m_tex);
+    glBindTexture(GL_TEXTURE_2D, m_tex);
+    
+    // pixel format options
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    
+    // texture parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    
+    // copy the pixel data into the texture
+    glTexImage2D(GL_TEXTURE_2D,       // texture
+                 0,                   // mip level
+                 m_internalFormat,    // internal format
+                 m_width,             // width
+                 m_height,            // height
+                 0,                   // border
+                 m_format,            // external format
+                 m_type,              // type
+                 m_pixels);           // image data
+    
+    @synchronized([Texture class]) {
+        residentBytes += m_pitch * m_height;
+    }
+    
+    // OpenGL has its own copy now
+    if (m_keepsData == NO) {
+        [self releasePixels];
+    }
+}
+
+- (GLuint)handle
+{
+    if (m_parent != nil) {
+        return [m_parent handle];
+    }
+    
+    // rendered before its turn in the upload queue
+    if (m_tex == 0 && m_pixels != NULL) {
+        [self upload];
+    }
     
+    return m_tex;
+}
+
+- (const Quad*)quadForFrame:(unsigned long)frame
+{
 	if (frame >= [m_frames count]) {
-		return;
+		return NULL;
 	}
     
-    if (m_tex == 0) {
-        glGenTextures(1, &m_tex);
-        glBindTexture(GL_TEXTURE_2D, m_tex);
-        
-        // pixel format options
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    return (const Quad*)[[m_frames objectAtIndex:frame] bytes];
+}
+
+- (void)releaseFrameTable
+{
+    batchReleaseFrames(m_frameTable);
+    
+    m_frameTable = NULL;
+}
+
+- (struct BatchFrames*)frameTable
+{
+    // only the sprite shader needs it
+    if (batchIsInstancing() == NO) {
+        return NULL;
+    }
+    
+    if (m_frameTable == NULL && [m_frames count] > 0) {
+        NSUInteger count = [m_frames count];
+        Quad* quads = malloc(sizeof(Quad) * count);
         
-        // texture parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        for(NSUInteger i = 0;i < count;i++) {
+            quads[i] = *(const Quad*)[[m_frames objectAtIndex:i] bytes];
+        }
         
-        // copy the pixel data into the texture
-        glTexImage2D(GL_TEXTURE_2D,       // texture
-                     0,                   // mip level
-                     GL_RGBA,             // internal format
-                     m_width,             // width
-                     m_height,            // height
-                     0,                   // border
-                     GL_RGBA,             // external format
-                     GL_UNSIGNED_BYTE,    // type
-                     m_image);            // image data
+        m_frameTable = batchCreateFrames(quads, (unsigned int)count);
+        free(quads);
     }
+    
+    return m_frameTable;
+}
+
+- (void)render:(unsigned long)frame
+{
+    const Quad* quad;
 	
     // fetch the vertex and texcoord buffer
-	quad = (const Quad*)[[m_frames objectAtIndex:frame] bytes];
-	
-	if (quad) {
-		// make this the current texture
-		glBindTexture(GL_TEXTURE_2D, m_tex);
-		
-		// set the vertex and texcoord pointers
-		glVertexPointer(2, GL_FLOAT, sizeof(GLfloat) * 4, &quad->v[0].x);
-		glTexCoordPointer(2, GL_FLOAT, sizeof(GLfloat) * 4, &quad->v[0].u);
-		
-		// draw a simple triangle fan
-		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	if ((quad = [self quadForFrame:frame]) != NULL) {
+		// queue the quad (or an instance of it), it's drawn when the batch is flushed
+		batchSprite([self handle], [self frameTable], (unsigned int)frame, quad);
 	}
 }
 
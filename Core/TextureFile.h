@@ -0,0 +1,41 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#include <stdint.h>
+
+// cooked textures are raw pixels, ready to hand to glTexImage2D
+#define GBTEX_EXTENSION "gbtex"
+#define GBTEX_VERSION 1
+
+// pixel formats
+enum {
+    GBTEX_RGBA8888,
+    GBTEX_RGBA4444,
+    GBTEX_RGB565,
+};
+
+typedef struct {
+    char magic[4];          // "GBTX"
+    uint32_t version;
+    uint32_t format;
+    
+    // size of the original image
+    uint32_t width;
+    uint32_t height;
+    
+    // power of 2 size of the pixel data, the image is in the bottom-left
+    uint32_t texWidth;
+    uint32_t texHeight;
+    
+    // byte offset from the start of the file to the first row of pixels
+    uint32_t offset;
+} GBTexHeader;
+
+// bytes per pixel for a format
+static inline uint32_t gbtexPixelSize(uint32_t format)
+{
+    return (format == GBTEX_RGBA8888) ? 4 : 2;
+}
@@ -0,0 +1,52 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import "chipmunk.h"
+#import "Atlas.h"
+#import "Batch.h"
+#import "Component.h"
+#import "Script.h"
+
+// width and height of a chunk in tiles, each chunk is one static mesh
+#define TILEMAP_CHUNK_SIZE 32
+
+@interface Tilemap : BaseComponent <ComponentInterface>
+{
+    // the texture atlas the tiles are frames of
+    Atlas* m_atlas;
+    
+    // size of the map in tiles and of a tile in world units
+    unsigned int m_width;
+    unsigned int m_height;
+    float m_tileWidth;
+    float m_tileHeight;
+    
+    // tiles, row-major from the top row
+    uint16_t* m_tiles;
+    
+    // meshes, built when the component starts
+    BatchMesh** m_chunks;
+    unsigned int m_chunkCols;
+    unsigned int m_chunkRows;
+    
+    // static body at the actor's transform when it starts, so the map is never moved or re-indexed
+    cpBody* m_body;
+    
+    // merged edges around the solid tiles
+    cpShape** m_shapes;
+    unsigned int m_shapeCount;
+}
+
+// load a .gbmap file
+- (void)setFile:(NSString*)value;
+
+// the tile at a column and row (0 if out of range)
+- (unsigned int)tileAtColumn:(int)col row:(int)row;
+
+// true if the tile is solid
+- (BOOL)isSolidAtColumn:(int)col row:(int)row;
+
+@end
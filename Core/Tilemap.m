@@ -0,0 +1,350 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#import "Engine.h"
+#import "Layer.h"
+#import "Tilemap.h"
+#import "TilemapFile.h"
+
+@implementation Tilemap
+
+- (id)init
+{
+    if ((self = [super init]) == nil) {
+        return nil;
+    }
+    
+    // initialize members
+    m_atlas = nil;
+    m_width = 0;
+    m_height = 0;
+    m_tileWidth = 0.0f;
+    m_tileHeight = 0.0f;
+    m_tiles = NULL;
+    m_chunks = NULL;
+    m_chunkCols = 0;
+    m_chunkRows = 0;
+    m_body = NULL;
+    m_shapes = NULL;
+    m_shapeCount = 0;
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [self freeChunks];
+    [self freeShapes];
+    
+    free(m_tiles);
+    
+    [super dealloc];
+}
+
++ (NSArray*)properties
+{
+    return [[NSArray arrayWithObjects:
+             prop_ASSET(@"atlas", "m_atlas", Atlas),
+             prop_WIRE(@"file", @selector(setFile:)),
+             nil]
+            arrayByAddingObjectsFromArray:[super properties]];
+}
+
+- (NSArray*)scriptMethods
+{
+    return [[NSArray arrayWithObjects:
+             script_Method(@"tile_at", @selector(l_tileAt:)),
+             script_Method(@"is_solid", @selector(l_isSolid:)),
+             nil]
+            arrayByAddingObjectsFromArray:[super scriptMethods]];
+}
+
+- (void)setFile:(NSString*)value
+{
+    NSData* data = [theProject dataWithContentsOfFile:value];
+    const GBMapHeader* header = [data bytes];
+    uint64_t size;
+    
+    if (data == nil || [data length] < sizeof(GBMapHeader)) {
+        NSLog(@"Failed to load tilemap %@\n", value);
+        return;
+    }
+    
+    if (memcmp(header->magic, "GBTM", 4) || header->version != GBMAP_VERSION) {
+        NSLog(@"Invalid tilemap file %@\n", value);
+        return;
+    }
+    
+    // 64-bit math so a huge width and height can't wrap past the check
+    size = (uint64_t)header->width * header->height * sizeof(uint16_t);
+    
+    if ((uint64_t)header->offset + size > [data length]) {
+        NSLog(@"Truncated tilemap file %@\n", value);
+        return;
+    }
+    
+    // copy the tiles out so the file can be released
+    free(m_tiles);
+    m_tiles = malloc((size_t)size);
+    memcpy(m_tiles, (const uint8_t*)[data bytes] + header->offset, (size_t)size);
+    
+    m_width = header->width;
+    m_height = header->height;
+    m_tileWidth = header->tileWidth;
+    m_tileHeight = header->tileHeight;
+}
+
+- (unsigned int)tileAtColumn:(int)col row:(int)row
+{
+    if (col < 0 || row < 0 || col >= (int)m_width || row >= (int)m_height) {
+        return 0;
+    }
+    
+    return m_tiles[row * m_width + col];
+}
+
+- (BOOL)isSolidAtColumn:(int)col row:(int)row
+{
+    return ([self tileAtColumn:col row:row] & GBMAP_SOLID) != 0;
+}
+
+- (NSRect)rectOfChunk:(unsigned int)cx row:(unsigned int)cy
+{
+    unsigned int col = cx * TILEMAP_CHUNK_SIZE;
+    unsigned int row = cy * TILEMAP_CHUNK_SIZE;
+    unsigned int cols = MIN(TILEMAP_CHUNK_SIZE, m_width - col);
+    unsigned int rows = MIN(TILEMAP_CHUNK_SIZE, m_height - row);
+    
+    // rows count down from the top of the map, which is at m_height
+    return NSMakeRect(col * m_tileWidth,
+                      (m_height - row - rows) * m_tileHeight,
+                      cols * m_tileWidth,
+                      rows * m_tileHeight);
+}
+
+- (void)buildChunks
+{
+    Texture* texture = [m_atlas texture];
+    Quad* quads;
+    
+    m_chunkCols = (m_width + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+    m_chunkRows = (m_height + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+    m_chunks = calloc(m_chunkCols * m_chunkRows, sizeof(BatchMesh*));
+    
+    // scratch space for the largest chunk
+    quads = malloc(TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE * sizeof(Quad));
+    
+    for(unsigned int cy = 0;cy < m_chunkRows;cy++) {
+        for(unsigned int cx = 0;cx < m_chunkCols;cx++) {
+            unsigned int count = 0;
+            
+            for(unsigned int row = cy * TILEMAP_CHUNK_SIZE;row < MIN((cy + 1) * TILEMAP_CHUNK_SIZE, m_height);row++) {
+                for(unsigned int col = cx * TILEMAP_CHUNK_SIZE;col < MIN((cx + 1) * TILEMAP_CHUNK_SIZE, m_width);col++) {
+                    unsigned int frame = m_tiles[row * m_width + col] & GBMAP_FRAME_MASK;
+                    const Quad* quad;
+                    GLfloat x, y;
+                    
+                    if (frame == 0 || (quad = [texture quadForFrame:frame]) == NULL) {
+                        continue;
+                    }
+                    
+                    quads[count] = *quad;
+                    
+                    // frames may be centered, so move the bottom-left corner onto the tile
+                    x = col * m_tileWidth - MIN(quad->v[0].x, quad->v[2].x);
+                    y = (m_height - 1 - row) * m_tileHeight - MIN(quad->v[0].y, quad->v[2].y);
+                    
+                    for(int i = 0;i < 4;i++) {
+                        quads[count].v[i].x += x;
+                        quads[count].v[i].y += y;
+                    }
+                    
+                    count++;
+                }
+            }
+            
+            // empty chunks don't get a mesh
+            if (count > 0) {
+                m_chunks[cy * m_chunkCols + cx] = batchCreateMesh(quads, count);
+            }
+        }
+    }
+    
+    free(quads);
+}
+
+- (void)freeChunks
+{
+    for(unsigned int i = 0;i < m_chunkCols * m_chunkRows;i++) {
+        if (m_chunks[i] != NULL) {
+            batchReleaseMesh(m_chunks[i]);
+        }
+    }
+    
+    free(m_chunks);
+    
+    m_chunks = NULL;
+    m_chunkCols = 0;
+    m_chunkRows = 0;
+}
+
+- (void)addSegmentFrom:(cpVect)a to:(cpVect)b
+{
+    m_shapes = realloc(m_shapes, (m_shapeCount + 1) * sizeof(cpShape*));
+    m_shapes[m_shapeCount++] = cpSegmentShapeNew(m_body, a, b, 0.0f);
+}
+
+- (void)buildShapes
+{
+    int w = m_width;
+    int h = m_height;
+    
+    // collisions still report the actor
+    m_body = cpBodyNewStatic();
+    m_body->data = m_actor;
+    
+    cpBodySetPos(m_body, cpBodyGetPos([m_actor body]));
+    cpBodySetAngle(m_body, cpBodyGetAngle([m_actor body]));
+    
+    // horizontal edges between each pair of rows, merged across columns
+    for(int row = 0;row <= h;row++) {
+        float y = (h - row) * m_tileHeight;
+        int start = -1;
+        
+        for(int col = 0;col <= w;col++) {
+            BOOL edge = col < w && [self isSolidAtColumn:col row:row - 1] != [self isSolidAtColumn:col row:row];
+            
+            if (edge && start < 0) {
+                start = col;
+            } else if (edge == NO && start >= 0) {
+                [self addSegmentFrom:cpv(start * m_tileWidth, y) to:cpv(col * m_tileWidth, y)];
+                
+                start = -1;
+            }
+        }
+    }
+    
+    // vertical edges between each pair of columns, merged across rows
+    for(int col = 0;col <= w;col++) {
+        float x = col * m_tileWidth;
+        int start = -1;
+        
+        for(int row = 0;row <= h;row++) {
+            BOOL edge = row < h && [self isSolidAtColumn:col - 1 row:row] != [self isSolidAtColumn:col row:row];
+            
+            if (edge && start < 0) {
+                start = row;
+            } else if (edge == NO && start >= 0) {
+                [self addSegmentFrom:cpv(x, (h - start) * m_tileHeight) to:cpv(x, (h - row) * m_tileHeight)];
+                
+                start = -1;
+            }
+        }
+    }
+}
+
+- (void)freeShapes
+{
+    // shapes are in the world from start until they're freed
+    for(unsigned int i = 0;i < m_shapeCount;i++) {
+        [theWorld removeStaticShape:m_shapes[i]];
+        cpShapeFree(m_shapes[i]);
+    }
+    
+    free(m_shapes);
+    
+    if (m_body != NULL) {
+        cpBodyFree(m_body);
+    }
+    
+    m_body = NULL;
+    m_shapes = NULL;
+    m_shapeCount = 0;
+}
+
+- (void)reset
+{
+    // start builds them again for the actor reusing the tilemap
+    [self freeChunks];
+    [self freeShapes];
+}
+
+- (BOOL)bounds:(NSRect*)rect
+{
+    if (m_tiles == NULL) {
+        return NO;
+    }
+    
+    *rect = [m_actor transformRect:NSMakeRect(0.0f, 0.0f, m_width * m_tileWidth, m_height * m_tileHeight)];
+    
+    return YES;
+}
+
+- (void)start
+{
+    if (m_tiles == NULL || m_atlas == nil) {
+        return;
+    }
+    
+    [self buildChunks];
+    [self buildShapes];
+    
+    for(unsigned int i = 0;i < m_shapeCount;i++) {
+        [theWorld addStaticShape:m_shapes[i]];
+    }
+}
+
+- (void)leave
+{
+    [self freeShapes];
+}
+
+- (void)render
+{
+    NSRect view = [Layer renderView];
+    GLuint tex;
+    
+    if (m_chunks == NULL) {
+        return;
+    }
+    
+    tex = [[m_atlas texture] handle];
+    
+    batchSetColor(1.0f, 1.0f, 1.0f, 1.0f);
+    
+    // only chunks overlapping the view are drawn
+    for(unsigned int cy = 0;cy < m_chunkRows;cy++) {
+        for(unsigned int cx = 0;cx < m_chunkCols;cx++) {
+            BatchMesh* mesh = m_chunks[cy * m_chunkCols + cx];
+            
+            if (mesh != NULL && NSIntersectsRect([m_actor transformRect:[self rectOfChunk:cx row:cy]], view)) {
+                batchMesh(tex, mesh);
+            }
+        }
+    }
+}
+
+/*
+ * LUA INTERFACE
+ */
+
+- (int)l_tileAt:(lua_State*)L
+{
+    int col = (int)lua_tointeger(L, 1);
+    int row = (int)lua_tointeger(L, 2);
+    
+    return lua_pushinteger(L, [self tileAtColumn:col row:row] & GBMAP_FRAME_MASK), 1;
+}
+
+- (int)l_isSolid:(lua_State*)L
+{
+    int col = (int)lua_tointeger(L, 1);
+    int row = (int)lua_tointeger(L, 2);
+    
+    return lua_pushboolean(L, [self isSolidAtColumn:col row:row]), 1;
+}
+
+@end
@@ -0,0 +1,31 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+#include <stdint.h>
+
+// cooked tilemaps are a grid of 16-bit tiles
+#define GBMAP_EXTENSION "gbmap"
+#define GBMAP_VERSION 1
+
+// tiles are atlas frame numbers (0 is empty), the top bit marks solid tiles
+#define GBMAP_SOLID 0x8000
+#define GBMAP_FRAME_MASK 0x7FFF
+
+typedef struct {
+    char magic[4];          // "GBTM"
+    uint32_t version;
+    
+    // size of the map in tiles
+    uint32_t width;
+    uint32_t height;
+    
+    // size of a tile in world units
+    uint32_t tileWidth;
+    uint32_t tileHeight;
+    
+    // byte offset from the start of the file to the tiles, row-major from the top row
+    uint32_t offset;
+} GBMapHeader;
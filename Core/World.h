@@ -27,6 +27,10 @@
 - (void)addCollider:(Collider*)collider;
 - (void)removeCollider:(Collider*)collider;
 
+// add and remove static shapes not owned by a collider, only outside of a step
+- (void)addStaticShape:(cpShape*)shape;
+- (void)removeStaticShape:(cpShape*)shape;
+
 // collision handlers - DO NOT CALL DIRECTLY!
 - (BOOL)beginCollision:(struct cpArbiter*)arbiter;
 - (void)endCollision:(struct cpArbiter*)arbiter;
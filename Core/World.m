@@ -1,3 +1,4 @@
+#import "Profiler.h"
 #import "World.h"
 
 static void worldPostStepFunc(cpSpace* space, void* obj, void* data)
@@ -39,12 +40,6 @@ static void worldSeparateFunc(cpArbiter* arbiter, cpSpace* space, void* data)
     // initialize members
     m_shapeRemovalQueue = [[NSMutableArray alloc] init];
     m_bodyRemovalQueue = [[NSMutableArray alloc] init];
-    
-    // add a post-step callback for safe removals when done
-    cpSpaceAddPostStepCallback(m_space, 
-                               worldPostStepFunc, 
-                               self, 
-                               NULL);
         
     // setup the default collision handlers
     cpSpaceSetDefaultCollisionHandler(m_space, 
@@ -76,12 +71,16 @@ static void worldSeparateFunc(cpArbiter* arbiter, cpSpace* space, void* data)
 {
     // first remove all collider shapes
     for(Collider* collider in m_shapeRemovalQueue) {
-        cpSpaceAddShape(m_space, [collider shape]);
+        if (cpSpaceContainsShape(m_space, [collider shape])) {
+            cpSpaceRemoveShape(m_space, [collider shape]);
+        }
     }
     
     // now remove rigid bodies
     for(Actor* actor in m_bodyRemovalQueue) {
-        cpSpaceRemoveBody(m_space, [actor body]);
+        if (cpSpaceContainsBody(m_space, [actor body])) {
+            cpSpaceRemoveBody(m_space, [actor body]);
+        }
     }
     
     // flush the lists
@@ -97,6 +96,13 @@ static void worldSeparateFunc(cpArbiter* arbiter, cpSpace* space, void* data)
 - (void)removeRigidBody:(Actor*)actor
 {
     [m_bodyRemovalQueue addObject:actor];
+    
+    // right away unless the space is stepping, pooled actors may be reused soon
+    if (cpSpaceIsLocked(m_space)) {
+        cpSpaceAddPostStepCallback(m_space, worldPostStepFunc, self, NULL);
+    } else {
+        [self removeShapesAndBodies];
+    }
 }
 
 - (void)addCollider:(Collider*)collider
@@ -107,6 +113,23 @@ static void worldSeparateFunc(cpArbiter* arbiter, cpSpace* space, void* data)
 - (void)removeCollider:(Collider*)collider
 {
     [m_shapeRemovalQueue addObject:collider];
+    
+    // post-step callbacks only run once, so add it for every step with removals
+    if (cpSpaceIsLocked(m_space)) {
+        cpSpaceAddPostStepCallback(m_space, worldPostStepFunc, self, NULL);
+    } else {
+        [self removeShapesAndBodies];
+    }
+}
+
+- (void)addStaticShape:(cpShape*)shape
+{
+    cpSpaceAddStaticShape(m_space, shape);
+}
+
+- (void)removeStaticShape:(cpShape*)shape
+{
+    cpSpaceRemoveStaticShape(m_space, shape);
 }
 
 - (BOOL)beginCollision:(struct cpArbiter*)arbiter
@@ -149,7 +172,11 @@ static void worldSeparateFunc(cpArbiter* arbiter, cpSpace* space, void* data)
 
 - (void)step:(float)dt
 {
-	cpSpaceStep(m_space, dt);
+    profile_BEGIN("World step", NULL);
+    {
+        cpSpaceStep(m_space, dt);
+    }
+    profile_END();
 }
 
 /*
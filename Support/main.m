@@ -6,6 +6,7 @@
 
 #import <Cocoa/Cocoa.h>
 #import "Engine.h"
+#import "Particles.h"
 
 #define ASTEROIDS @"/Users/jeff/Projects/asteroids/DerivedData/asteroids/Build/Products/Debug/asteroids.bundle"
 
@@ -19,6 +20,17 @@ int main(int argc, char *argv[])
     //    bundle = [[NSString alloc] initWithUTF8String:argv[1]];
     //}
     
+    // greybox -headless <ticks> runs the simulation without a display
+    if (argc >= 3 && strcmp(argv[1], "-headless") == 0) {
+        return [Engine runHeadlessWithProject:bundle ticks:atoi(argv[2])] ? 0 : 1;
+    }
+    
+    // greybox -bench-particles <count> times the particle update kernels
+    if (argc >= 3 && strcmp(argv[1], "-bench-particles") == 0) {
+        particlesBenchmark(atoi(argv[2]), 1000);
+        return 0;
+    }
+    
     [Engine launchWithProject:bundle];
     [bundle release];
 }
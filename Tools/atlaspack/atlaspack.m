@@ -0,0 +1,483 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+// Packs every image referenced by atlas and font assets into a few shared
+// texture pages, and writes the page table the engine loads with the
+// "Texture Pages" project setting.
+//
+// build: clang -fobjc-arc -O2 -framework Cocoa -o atlaspack atlaspack.m
+//
+// usage: atlaspack [-size 2048] [-pad 2] [-name pages] <resources> <group.xml>...
+
+#import <Cocoa/Cocoa.h>
+
+// a span of the skyline, everything below y is already used
+typedef struct {
+    int x, y, w;
+} Span;
+
+@interface Page : NSObject
+{
+@public
+    int size;
+    int pad;
+    int usedWidth;
+    int usedHeight;
+    
+    // skyline of the packed area
+    NSMutableData* skyline;
+    
+    // images placed in this page
+    NSMutableArray* images;
+}
+@end
+
+@interface PackedImage : NSObject
+{
+@public
+    NSString* file;
+    NSBitmapImageRep* rep;
+    int x, y, w, h;
+}
+@end
+
+@implementation Page
+@end
+
+@implementation PackedImage
+@end
+
+static Span* spans(Page* page)
+{
+    return (Span*)[page->skyline mutableBytes];
+}
+
+static int spanCount(Page* page)
+{
+    return (int)([page->skyline length] / sizeof(Span));
+}
+
+static int skylineFit(Page* page, int i, int w, int h)
+{
+    Span* s = spans(page);
+    int n = spanCount(page);
+    int x = s[i].x;
+    int y = s[i].y;
+    int left = w;
+    
+    if (x + w > page->size) {
+        return -1;
+    }
+    
+    // the image rests on the highest span it covers
+    for(int j = i;left > 0;j++) {
+        if (j >= n) {
+            return -1;
+        }
+        
+        if (s[j].y > y) {
+            y = s[j].y;
+        }
+        
+        if (y + h > page->size) {
+            return -1;
+        }
+        
+        left -= s[j].w;
+    }
+    
+    return y;
+}
+
+static BOOL skylineInsert(Page* page, int w, int h, int* outX, int* outY)
+{
+    int best = -1;
+    int bestY = INT_MAX;
+    int bestW = INT_MAX;
+    Span span;
+    
+    // bottom-left: lowest resulting top edge, then narrowest span
+    for(int i = 0;i < spanCount(page);i++) {
+        int y = skylineFit(page, i, w, h);
+        
+        if (y >= 0 && (y + h < bestY || (y + h == bestY && spans(page)[i].w < bestW))) {
+            best = i;
+            bestY = y + h;
+            bestW = spans(page)[i].w;
+        }
+    }
+    
+    if (best < 0) {
+        return NO;
+    }
+    
+    *outX = spans(page)[best].x;
+    *outY = bestY - h;
+    
+    // raise the skyline where the image was placed
+    span.x = *outX;
+    span.y = bestY;
+    span.w = w;
+    
+    [page->skyline replaceBytesInRange:NSMakeRange(best * sizeof(Span), 0)
+                             withBytes:&span
+                                length:sizeof(Span)];
+    
+    // trim the spans now underneath it
+    for(int i = best + 1;i < spanCount(page);i++) {
+        Span* s = spans(page);
+        int overlap = (s[i - 1].x + s[i - 1].w) - s[i].x;
+        
+        if (overlap <= 0) {
+            break;
+        }
+        
+        s[i].x += overlap;
+        s[i].w -= overlap;
+        
+        if (s[i].w > 0) {
+            break;
+        }
+        
+        [page->skyline replaceBytesInRange:NSMakeRange(i * sizeof(Span), sizeof(Span))
+                                 withBytes:NULL
+                                    length:0];
+        i--;
+    }
+    
+    // merge neighbors at the same height
+    for(int i = 0;i < spanCount(page) - 1;i++) {
+        Span* s = spans(page);
+        
+        if (s[i].y == s[i + 1].y) {
+            s[i].w += s[i + 1].w;
+            
+            [page->skyline replaceBytesInRange:NSMakeRange((i + 1) * sizeof(Span), sizeof(Span))
+                                     withBytes:NULL
+                                        length:0];
+            i--;
+        }
+    }
+    
+    return YES;
+}
+
+static Page* newPage(int size, int pad)
+{
+    Page* page = [[Page alloc] init];
+    Span span = { 0, 0, size };
+    
+    page->size = size;
+    page->pad = pad;
+    page->skyline = [NSMutableData dataWithBytes:&span length:sizeof(Span)];
+    page->images = [NSMutableArray array];
+    
+    return page;
+}
+
+static int nextPow2(int n)
+{
+    int p = 1;
+    
+    while (p < n) {
+        p <<= 1;
+    }
+    
+    return p;
+}
+
+static NSXMLDocument* loadXML(NSString* path)
+{
+    NSError* err = nil;
+    NSXMLDocument* doc;
+    
+    doc = [[NSXMLDocument alloc] initWithContentsOfURL:[NSURL fileURLWithPath:path]
+                                               options:0
+                                                 error:&err];
+    
+    if (doc == nil) {
+        fprintf(stderr, "%s: %s\n", [path UTF8String], [[err localizedDescription] UTF8String]);
+    }
+    
+    return doc;
+}
+
+static void collectImages(NSString* resources, NSString* groupFile, NSMutableOrderedSet* files)
+{
+    NSXMLDocument* group = loadXML([resources stringByAppendingPathComponent:groupFile]);
+    
+    for(NSXMLElement* asset in [[group rootElement] elementsForName:@"asset"]) {
+        NSString* type = [[[asset attributeForName:@"type"] stringValue] lowercaseString];
+        NSString* file = [[asset attributeForName:@"file"] stringValue];
+        NSXMLElement* root;
+        
+        if (file == nil || ([type isEqualToString:@"atlas"] == NO && [type isEqualToString:@"font"] == NO)) {
+            continue;
+        }
+        
+        if ((root = [loadXML([resources stringByAppendingPathComponent:file]) rootElement]) == nil) {
+            continue;
+        }
+        
+        // atlases reference a single texture
+        if ([root attributeForName:@"texture"] != nil) {
+            [files addObject:[[root attributeForName:@"texture"] stringValue]];
+        }
+        
+        // fonts have a texture per page
+        for(NSXMLElement* pages in [root elementsForName:@"pages"]) {
+            for(NSXMLElement* page in [pages elementsForName:@"page"]) {
+                if ([page attributeForName:@"texture"] != nil) {
+                    [files addObject:[[page attributeForName:@"texture"] stringValue]];
+                }
+            }
+        }
+    }
+}
+
+static void extrudeImage(NSBitmapImageRep* rep, PackedImage* image, int pad)
+{
+    uint32_t* pixels = (uint32_t*)[rep bitmapData];
+    int stride = (int)[rep bytesPerRow] / 4;
+    int left = image->x;
+    int right = image->x + image->w - 1;
+    int top = image->y;
+    int bottom = image->y + image->h - 1;
+    
+    // padding around the image, split between the sides
+    int x0 = MAX(left - pad / 2, 0);
+    int x1 = MIN(right + pad - pad / 2, (int)[rep pixelsWide] - 1);
+    int y0 = MAX(top - pad / 2, 0);
+    int y1 = MIN(bottom + pad - pad / 2, (int)[rep pixelsHigh] - 1);
+    
+    // repeat the first and last texel of each row out to the sides
+    for(int y = top;y <= bottom;y++) {
+        uint32_t* row = pixels + y * stride;
+        
+        for(int x = x0;x < left;x++) {
+            row[x] = row[left];
+        }
+        
+        for(int x = right + 1;x <= x1;x++) {
+            row[x] = row[right];
+        }
+    }
+    
+    // then the first and last rows, corners included, up and down
+    for(int y = y0;y < top;y++) {
+        memcpy(pixels + y * stride + x0, pixels + top * stride + x0, (x1 - x0 + 1) * 4);
+    }
+    
+    for(int y = bottom + 1;y <= y1;y++) {
+        memcpy(pixels + y * stride + x0, pixels + bottom * stride + x0, (x1 - x0 + 1) * 4);
+    }
+}
+
+static BOOL writePage(Page* page, NSString* path)
+{
+    int w = nextPow2(page->usedWidth);
+    int h = nextPow2(page->usedHeight);
+    NSBitmapImageRep* rep;
+    NSData* png;
+    
+    rep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes:NULL
+                                                  pixelsWide:w
+                                                  pixelsHigh:h
+                                               bitsPerSample:8
+                                             samplesPerPixel:4
+                                                    hasAlpha:YES
+                                                    isPlanar:NO
+                                              colorSpaceName:NSDeviceRGBColorSpace
+                                                 bytesPerRow:w * 4
+                                                bitsPerPixel:32];
+    
+    // shrink the page to the smallest power of two that holds everything
+    page->usedWidth = w;
+    page->usedHeight = h;
+    
+    [NSGraphicsContext saveGraphicsState];
+    [NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithBitmapImageRep:rep]];
+    {
+        for(PackedImage* image in page->images) {
+            NSRect dest = NSMakeRect(image->x, h - image->y - image->h, image->w, image->h);
+            
+            // images are placed from the top-left, cocoa draws from the bottom-left
+            [image->rep drawInRect:dest
+                          fromRect:NSZeroRect
+                         operation:NSCompositeCopy
+                          fraction:1.0f
+                    respectFlipped:NO
+                             hints:nil];
+        }
+        
+        [[NSGraphicsContext currentContext] flushGraphics];
+    }
+    [NSGraphicsContext restoreGraphicsState];
+    
+    // filtering and mipmaps sample past the edges, so they should see the image and not its neighbors
+    for(PackedImage* image in page->images) {
+        extrudeImage(rep, image, page->pad);
+    }
+    
+    png = [rep representationUsingType:NSPNGFileType properties:[NSDictionary dictionary]];
+    
+    return [png writeToFile:path atomically:YES];
+}
+
+int main(int argc, char* argv[])
+{
+    @autoreleasepool {
+        NSMutableOrderedSet* files = [NSMutableOrderedSet orderedSet];
+        NSMutableArray* images = [NSMutableArray array];
+        NSMutableArray* pages = [NSMutableArray array];
+        NSXMLElement* table = [NSXMLElement elementWithName:@"pages"];
+        NSString* name = @"pages";
+        NSString* resources = nil;
+        int size = 2048;
+        int pad = 2;
+        int i;
+        
+        // parse options
+        for(i = 1;i < argc && argv[i][0] == '-';i += 2) {
+            if (i + 1 >= argc) {
+                break;
+            } else if (strcmp(argv[i], "-size") == 0) {
+                size = nextPow2(atoi(argv[i + 1]));
+            } else if (strcmp(argv[i], "-pad") == 0) {
+                pad = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "-name") == 0) {
+                name = [NSString stringWithUTF8String:argv[i + 1]];
+            }
+        }
+        
+        if (i + 1 >= argc) {
+            fprintf(stderr, "usage: atlaspack [-size 2048] [-pad 2] [-name pages] <resources> <group.xml>...\n");
+            return 1;
+        }
+        
+        resources = [NSString stringWithUTF8String:argv[i++]];
+        
+        // find every image used by an atlas or a font
+        for(;i < argc;i++) {
+            collectImages(resources, [NSString stringWithUTF8String:argv[i]], files);
+        }
+        
+        // load them all
+        for(NSString* file in files) {
+            NSString* path = [resources stringByAppendingPathComponent:file];
+            NSBitmapImageRep* rep = (NSBitmapImageRep*)[NSBitmapImageRep imageRepWithContentsOfFile:path];
+            PackedImage* image;
+            
+            if (rep == nil) {
+                fprintf(stderr, "Failed to load %s\n", [path UTF8String]);
+                continue;
+            }
+            
+            // images that don't fit a page are left as they are
+            if ([rep pixelsWide] + pad > size || [rep pixelsHigh] + pad > size) {
+                fprintf(stderr, "%s is larger than a page, skipping\n", [file UTF8String]);
+                continue;
+            }
+            
+            image = [[PackedImage alloc] init];
+            image->file = file;
+            image->rep = rep;
+            image->w = (int)[rep pixelsWide];
+            image->h = (int)[rep pixelsHigh];
+            
+            [images addObject:image];
+        }
+        
+        // tallest images first pack the skyline tightest
+        [images sortUsingComparator:^NSComparisonResult(PackedImage* a, PackedImage* b) {
+            if (a->h != b->h) {
+                return (a->h > b->h) ? NSOrderedAscending : NSOrderedDescending;
+            }
+            
+            return (a->w > b->w) ? NSOrderedAscending : (a->w < b->w) ? NSOrderedDescending : NSOrderedSame;
+        }];
+        
+        // place each image in the first page it fits
+        for(PackedImage* image in images) {
+            Page* target = nil;
+            
+            for(Page* page in pages) {
+                if (skylineInsert(page, image->w + pad, image->h + pad, &image->x, &image->y)) {
+                    target = page;
+                    break;
+                }
+            }
+            
+            if (target == nil) {
+                target = newPage(size, pad);
+                
+                // a fresh page always fits an image smaller than a page
+                skylineInsert(target, image->w + pad, image->h + pad, &image->x, &image->y);
+                
+                [pages addObject:target];
+            }
+            
+            // track the extents, padding included, so the page can be shrunk
+            target->usedWidth = MAX(target->usedWidth, image->x + image->w + pad);
+            target->usedHeight = MAX(target->usedHeight, image->y + image->h + pad);
+            
+            // the image sits in the middle of its padding
+            image->x += pad / 2;
+            image->y += pad / 2;
+            
+            [target->images addObject:image];
+        }
+        
+        // write the pages and the table
+        for(i = 0;i < [pages count];i++) {
+            Page* page = [pages objectAtIndex:i];
+            NSString* file = [NSString stringWithFormat:@"%@%d.png", name, i];
+            NSXMLElement* elt = [NSXMLElement elementWithName:@"page"];
+            long area = 0;
+            
+            if (writePage(page, [resources stringByAppendingPathComponent:file]) == NO) {
+                fprintf(stderr, "Failed to write %s\n", [file UTF8String]);
+                return 1;
+            }
+            
+            [elt addAttribute:[NSXMLNode attributeWithName:@"texture" stringValue:file]];
+            
+            for(PackedImage* image in page->images) {
+                NSXMLElement* img = [NSXMLElement elementWithName:@"image"];
+                
+                [img addAttribute:[NSXMLNode attributeWithName:@"file" stringValue:image->file]];
+                [img addAttribute:[NSXMLNode attributeWithName:@"x" stringValue:[NSString stringWithFormat:@"%d", image->x]]];
+                [img addAttribute:[NSXMLNode attributeWithName:@"y" stringValue:[NSString stringWithFormat:@"%d", image->y]]];
+                [img addAttribute:[NSXMLNode attributeWithName:@"w" stringValue:[NSString stringWithFormat:@"%d", image->w]]];
+                [img addAttribute:[NSXMLNode attributeWithName:@"h" stringValue:[NSString stringWithFormat:@"%d", image->h]]];
+                [elt addChild:img];
+                
+                area += image->w * image->h;
+            }
+            
+            [table addChild:elt];
+            
+            printf("%s: %dx%d, %lu images, %.1f%% used\n",
+                   [file UTF8String],
+                   page->usedWidth,
+                   page->usedHeight,
+                   (unsigned long)[page->images count],
+                   100.0 * area / ((double)page->usedWidth * page->usedHeight));
+        }
+        
+        NSXMLDocument* doc = [NSXMLDocument documentWithRootElement:table];
+        NSString* tableFile = [resources stringByAppendingPathComponent:[name stringByAppendingPathExtension:@"xml"]];
+        
+        [doc setCharacterEncoding:@"UTF-8"];
+        
+        if ([[doc XMLDataWithOptions:NSXMLNodePrettyPrint] writeToFile:tableFile atomically:YES] == NO) {
+            fprintf(stderr, "Failed to write %s\n", [tableFile UTF8String]);
+            return 1;
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+// Cooks CSV tile grids into .gbmap files (see Core/TilemapFile.h). Each cell
+// is an atlas frame number (0 or blank is empty) and a trailing * marks the
+// tile as solid. The first line of the CSV is the top row of the map.
+//
+// build: clang -fobjc-arc -O2 -framework Foundation -o gbmap gbmap.m
+//
+// usage: gbmap [-tile WxH] <csv>...
+
+#import <Foundation/Foundation.h>
+#import "../../Core/TilemapFile.h"
+
+static BOOL parseCell(NSString* cell, uint16_t* tile)
+{
+    NSString* text = [cell stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    BOOL solid = [text hasSuffix:@"*"];
+    int frame;
+    
+    if (solid) {
+        text = [text substringToIndex:[text length] - 1];
+    }
+    
+    frame = [text intValue];
+    
+    if (frame < 0 || frame > GBMAP_FRAME_MASK) {
+        return NO;
+    }
+    
+    *tile = frame | (solid ? GBMAP_SOLID : 0);
+    
+    return YES;
+}
+
+static BOOL cook(NSString* path, uint32_t tileWidth, uint32_t tileHeight)
+{
+    NSString* csv = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+    NSString* outPath = [[path stringByDeletingPathExtension] stringByAppendingPathExtension:@GBMAP_EXTENSION];
+    NSMutableArray* rows = [NSMutableArray array];
+    NSMutableData* file;
+    GBMapHeader header;
+    uint32_t width = 0;
+    
+    if (csv == nil) {
+        fprintf(stderr, "Failed to load %s\n", [path UTF8String]);
+        return NO;
+    }
+    
+    // skip blank lines, the widest row sets the width of the map
+    for(NSString* line in [csv componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]]) {
+        NSArray* cells = [line componentsSeparatedByString:@","];
+        
+        if ([[line stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]] length] == 0) {
+            continue;
+        }
+        
+        [rows addObject:cells];
+        
+        width = MAX(width, (uint32_t)[cells count]);
+    }
+    
+    memcpy(header.magic, "GBTM", 4);
+    header.version = GBMAP_VERSION;
+    header.width = width;
+    header.height = (uint32_t)[rows count];
+    header.tileWidth = tileWidth;
+    header.tileHeight = tileHeight;
+    header.offset = sizeof(GBMapHeader);
+    
+    file = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+    
+    for(NSArray* cells in rows) {
+        for(uint32_t col = 0;col < width;col++) {
+            uint16_t tile = 0;
+            
+            // short rows are padded with empty tiles
+            if (col < [cells count] && parseCell([cells objectAtIndex:col], &tile) == NO) {
+                fprintf(stderr, "Invalid tile '%s' in %s\n", [[cells objectAtIndex:col] UTF8String], [path UTF8String]);
+                return NO;
+            }
+            
+            [file appendBytes:&tile length:sizeof(tile)];
+        }
+    }
+    
+    if ([file writeToFile:outPath atomically:YES] == NO) {
+        fprintf(stderr, "Failed to write %s\n", [outPath UTF8String]);
+        return NO;
+    }
+    
+    printf("%s: %ux%u tiles of %ux%u\n", [outPath UTF8String], header.width, header.height, tileWidth, tileHeight);
+    
+    return YES;
+}
+
+int main(int argc, char* argv[])
+{
+    @autoreleasepool {
+        uint32_t tileWidth = 16;
+        uint32_t tileHeight = 16;
+        int failed = 0;
+        int i = 1;
+        
+        if (i + 1 < argc && strcmp(argv[i], "-tile") == 0) {
+            if (sscanf(argv[i + 1], "%ux%u", &tileWidth, &tileHeight) != 2 || tileWidth == 0 || tileHeight == 0) {
+                fprintf(stderr, "Invalid tile size %s\n", argv[i + 1]);
+                return 1;
+            }
+            
+            i += 2;
+        }
+        
+        if (i >= argc) {
+            fprintf(stderr, "usage: gbmap [-tile WxH] <csv>...\n");
+            return 1;
+        }
+        
+        for(;i < argc;i++) {
+            if (cook([NSString stringWithUTF8String:argv[i]], tileWidth, tileHeight) == NO) {
+                failed++;
+            }
+        }
+        
+        return failed ? 1 : 0;
+    }
+}
@@ -0,0 +1,148 @@
+// Greybox 2D Game Engine
+//
+// Copyright (c) 2011 by Jeffrey Massung.
+// All rights reserved.
+//
+
+// Cooks images into .gbtex files (see Core/TextureFile.h). The pixels are
+// laid out exactly like the bitmap Texture draws images into at runtime, so
+// a cooked texture is memory-mapped and uploaded without any decoding.
+//
+// build: clang -fobjc-arc -O2 -framework Cocoa -o gbtex gbtex.m
+//
+// usage: gbtex [-format rgba8888|rgba4444|rgb565] <image>...
+
+#import <Cocoa/Cocoa.h>
+#import "../../Core/TextureFile.h"
+
+static uint32_t nextPow2(uint32_t n)
+{
+    uint32_t p = 1;
+    
+    while (p < n) {
+        p <<= 1;
+    }
+    
+    return p;
+}
+
+static uint32_t formatNamed(const char* name)
+{
+    if (strcmp(name, "rgba4444") == 0) {
+        return GBTEX_RGBA4444;
+    } else if (strcmp(name, "rgb565") == 0) {
+        return GBTEX_RGB565;
+    }
+    
+    return GBTEX_RGBA8888;
+}
+
+static void packPixels(const uint8_t* src, uint16_t* dst, size_t count, uint32_t format)
+{
+    for(size_t i = 0;i < count;i++, src += 4) {
+        if (format == GBTEX_RGBA4444) {
+            dst[i] = ((src[0] >> 4) << 12) | ((src[1] >> 4) << 8) | ((src[2] >> 4) << 4) | (src[3] >> 4);
+        } else {
+            dst[i] = ((src[0] >> 3) << 11) | ((src[1] >> 2) << 5) | (src[2] >> 3);
+        }
+    }
+}
+
+static BOOL cook(NSString* path, uint32_t format)
+{
+    NSImage* image = [[NSImage alloc] initWithContentsOfFile:path];
+    NSString* outPath = [[path stringByDeletingPathExtension] stringByAppendingPathExtension:@GBTEX_EXTENSION];
+    NSMutableData* file;
+    CGImageRef ref;
+    CGContextRef context;
+    CGColorSpaceRef colorSpace;
+    GBTexHeader header;
+    uint8_t* rgba;
+    
+    if (image == nil) {
+        fprintf(stderr, "Failed to load %s\n", [path UTF8String]);
+        return NO;
+    }
+    
+    // same sizes the runtime uses for an NSImage
+    memcpy(header.magic, "GBTX", 4);
+    header.version = GBTEX_VERSION;
+    header.format = format;
+    header.width = [image size].width;
+    header.height = [image size].height;
+    header.texWidth = nextPow2(header.width);
+    header.texHeight = nextPow2(header.height);
+    header.offset = sizeof(GBTexHeader);
+    
+    if ((ref = [image CGImageForProposedRect:NULL context:nil hints:nil]) == NULL) {
+        fprintf(stderr, "Failed to decode %s\n", [path UTF8String]);
+        return NO;
+    }
+    
+    rgba = calloc(header.texHeight, header.texWidth * 4);
+    
+    // draw premultiplied RGBA into the bottom-left, exactly like Texture
+    colorSpace = CGColorSpaceCreateDeviceRGB();
+    context = CGBitmapContextCreate(rgba,
+                                    header.texWidth,
+                                    header.texHeight,
+                                    8,
+                                    header.texWidth * 4,
+                                    colorSpace,
+                                    kCGImageAlphaPremultipliedLast);
+    
+    CGContextDrawImage(context, CGRectMake(0, 0, header.width, header.height), ref);
+    CGContextRelease(context);
+    CGColorSpaceRelease(colorSpace);
+    
+    file = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+    
+    if (format == GBTEX_RGBA8888) {
+        [file appendBytes:rgba length:header.texWidth * header.texHeight * 4];
+    } else {
+        size_t count = header.texWidth * header.texHeight;
+        uint16_t* packed = malloc(count * sizeof(uint16_t));
+        
+        packPixels(rgba, packed, count, format);
+        [file appendBytes:packed length:count * sizeof(uint16_t)];
+        free(packed);
+    }
+    
+    free(rgba);
+    
+    if ([file writeToFile:outPath atomically:YES] == NO) {
+        fprintf(stderr, "Failed to write %s\n", [outPath UTF8String]);
+        return NO;
+    }
+    
+    printf("%s: %ux%u (%ux%u)\n", [outPath UTF8String], header.width, header.height, header.texWidth, header.texHeight);
+    
+    return YES;
+}
+
+int main(int argc, char* argv[])
+{
+    @autoreleasepool {
+        uint32_t format = GBTEX_RGBA8888;
+        int failed = 0;
+        int i = 1;
+        
+        if (i + 1 < argc && strcmp(argv[i], "-format") == 0) {
+            format = formatNamed(argv[i + 1]);
+            i += 2;
+        }
+        
+        if (i >= argc) {
+            fprintf(stderr, "usage: gbtex [-format rgba8888|rgba4444|rgb565] <image>...\n");
+            return 1;
+        }
+        
+        for(;i < argc;i++) {
+            if (cook([NSString stringWithUTF8String:argv[i]], format) == NO) {
+                failed++;
+            }
+        }
+        
+        return failed ? 1 : 0;
+    }
+}